@@ -0,0 +1,83 @@
+/* Copyright (c) 2012, Richard Osborne, All rights reserved
+ * This software is freely distributable under a derivative of the
+ * University of Illinois/NCSA Open Source License posted in
+ * LICENSE.txt and at <http://github.xcore.com/>
+ */
+
+#ifndef _AXEPlugin_h_
+#define _AXEPlugin_h_
+
+/* Interface between axe and peripheral plugins. A plugin is a shared object
+ * loaded with --plugin which models a device attached to the pins of ports.
+ * It exports axe_plugin_init(), which attaches to ports and registers
+ * callbacks. The plugin is told about changes to the value on the pins of its
+ * ports in batches and drives values back onto the pins. It is only called
+ * when something happens: when the pins change or at times it asked to be
+ * woken. All times are in 400MHz processor cycles. */
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Incremented whenever the interface changes incompatibly. */
+#define AXE_PLUGIN_API_VERSION 1
+
+/** Name of the function each plugin exports. */
+#define AXE_PLUGIN_INIT_SYMBOL "axe_plugin_init"
+
+typedef uint64_t axe_ticks_t;
+
+/** Handle for a loaded plugin, passed back to the host functions. */
+typedef struct AXEPlugin AXEPlugin;
+
+/** A change to the value driven on the pins of a port. If halfPeriod is zero
+ * the pins take the value at the specified time. Otherwise the port is
+ * driving a clock which is low in the interval [value, value + halfPeriod) and
+ * high in the interval [value + halfPeriod, value + 2 * halfPeriod) modulo
+ * 2 * halfPeriod. */
+typedef struct {
+  axe_ticks_t time;
+  uint32_t value;
+  uint32_t halfPeriod;
+} AXEPinChange;
+
+typedef struct {
+  /** Called with the changes driven by the port with the specified handle
+   * since the last call, in order. May be null. */
+  void (*pinsChanged)(void *data, int port, const AXEPinChange *changes,
+                      unsigned numChanges);
+  /** Called at a time requested with wakeAt. May be null. */
+  void (*wake)(void *data, axe_ticks_t time);
+  /** Called when the simulation ends. May be null. */
+  void (*finish)(void *data);
+} AXEPluginCallbacks;
+
+typedef struct {
+  unsigned version;
+  /** Set the callbacks of the plugin and the data passed to them. */
+  void (*setCallbacks)(AXEPlugin *plugin, const AXEPluginCallbacks *callbacks,
+                       void *data);
+  /** Attach to a port. The core is given by name or number, or may be null
+   * for the first core. Returns a handle for the port or -1 on failure. */
+  int (*attachPort)(AXEPlugin *plugin, const char *core, uint32_t portID);
+  /** Drive a value onto the pins of a port at the specified time. Values
+   * can't be driven earlier than the time the port has been simulated up to,
+   * so they should be driven from a callback at or after the current time. */
+  void (*drivePins)(AXEPlugin *plugin, int port, uint32_t value,
+                    axe_ticks_t time);
+  /** Ask to be woken at the specified time. */
+  void (*wakeAt)(AXEPlugin *plugin, axe_ticks_t time);
+} AXEPluginHost;
+
+/** Initialise a plugin. argv holds the arguments given on the command line.
+ * Returns zero on success. */
+typedef int (*AXEPluginInitFn)(AXEPlugin *plugin, const AXEPluginHost *host,
+                               int argc, char **argv);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _AXEPlugin_h_ */
@@ -0,0 +1,605 @@
+// Copyright (c) 2012, Richard Osborne, All rights reserved
+// This software is freely distributable under a derivative of the
+// University of Illinois/NCSA Open Source License posted in
+// LICENSE.txt and at <http://github.xcore.com/>
+
+#include "BinaryTrace.h"
+#include "SymbolInfo.h"
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+
+using namespace BinaryTrace;
+
+const char BinaryTrace::magic[8] = { 'A', 'X', 'E', 'T', 'R', 'A', 'C', 'E' };
+
+/// Maximum size of an encoded 64 bit integer.
+const size_t maxVarintSize = 10;
+
+BinaryTraceWriter::BinaryTraceWriter(TraceSink &sink) :
+  buffer(sink),
+  lastTime(0),
+  lastPC(0)
+{
+  start = pos = buffer.getBlock();
+  end = start + TraceBuffer::blockSize;
+  std::memcpy(pos, magic, sizeof(magic));
+  pos += sizeof(magic);
+  writeUnsigned(version);
+}
+
+BinaryTraceWriter::~BinaryTraceWriter()
+{
+  flush();
+}
+
+void BinaryTraceWriter::switchBuffer()
+{
+  buffer.commit(pos - start);
+  start = pos = buffer.getBlock();
+  end = start + TraceBuffer::blockSize;
+}
+
+void BinaryTraceWriter::writeString(const std::string &s)
+{
+  reserve(maxVarintSize);
+  writeUnsigned(s.size());
+  const char *p = s.data();
+  size_t remaining = s.size();
+  while (remaining) {
+    if (pos == end)
+      switchBuffer();
+    size_t size = std::min(remaining, size_t(end - pos));
+    std::memcpy(pos, p, size);
+    pos += size;
+    p += size;
+    remaining -= size;
+  }
+}
+
+void BinaryTraceWriter::
+writeRegRecord(RecordType type, Register reg, uint32_t value)
+{
+  reserve(2 + maxVarintSize);
+  writeByte(type);
+  writeByte(reg);
+  writeUnsigned(value);
+}
+
+void BinaryTraceWriter::
+addCore(unsigned core, const std::string &name, const CoreSymbolInfo *symbols)
+{
+  writeRecord(ADD_CORE);
+  reserve(maxVarintSize);
+  writeUnsigned(core);
+  writeString(name);
+  if (!symbols) {
+    reserve(1);
+    writeByte(0);
+    return;
+  }
+  const std::vector<ElfSymbol> &syms = symbols->getSymbols();
+  reserve(1 + maxVarintSize);
+  writeByte(1);
+  writeUnsigned(syms.size());
+  for (std::vector<ElfSymbol>::const_iterator it = syms.begin(),
+       e = syms.end(); it != e; ++it) {
+    writeString(it->name);
+    reserve(maxVarintSize + 1);
+    writeUnsigned(it->value);
+    writeByte(it->info);
+  }
+}
+
+void BinaryTraceWriter::startLine()
+{
+  writeRecord(START_LINE);
+}
+
+void BinaryTraceWriter::startThreadLine(ticks_t time, unsigned core,
+                                        unsigned thread)
+{
+  reserve(1 + 3 * maxVarintSize);
+  writeByte(START_THREAD_LINE);
+  writeSigned(int64_t(time - lastTime));
+  writeUnsigned(core);
+  writeUnsigned(thread);
+  lastTime = time;
+}
+
+void BinaryTraceWriter::startNodeLine(unsigned nodeID)
+{
+  reserve(1 + maxVarintSize);
+  writeByte(START_NODE_LINE);
+  writeUnsigned(nodeID);
+}
+
+void BinaryTraceWriter::setLineThread(unsigned core, unsigned thread)
+{
+  reserve(1 + 2 * maxVarintSize);
+  writeByte(SET_LINE_THREAD);
+  writeUnsigned(core);
+  writeUnsigned(thread);
+}
+
+void BinaryTraceWriter::pushLine()
+{
+  writeRecord(PUSH_LINE);
+}
+
+void BinaryTraceWriter::popLine()
+{
+  writeRecord(POP_LINE);
+}
+
+void BinaryTraceWriter::endLine()
+{
+  writeRecord(END_LINE);
+}
+
+void BinaryTraceWriter::threadName()
+{
+  writeRecord(THREAD_NAME);
+}
+
+void BinaryTraceWriter::pc(uint32_t address)
+{
+  reserve(1 + maxVarintSize);
+  writeByte(PC);
+  writeSigned(int32_t(address - lastPC));
+  lastPC = address;
+}
+
+void BinaryTraceWriter::alignMnemonic()
+{
+  writeRecord(ALIGN_MNEMONIC);
+}
+
+void BinaryTraceWriter::colour(Colour c)
+{
+  reserve(2);
+  writeByte(COLOUR);
+  writeByte(c);
+}
+
+void BinaryTraceWriter::text(const char *s)
+{
+  std::pair<std::map<const char*,unsigned>::iterator,bool> result =
+    staticStrings.insert(std::make_pair(s, staticStrings.size()));
+  reserve(1 + maxVarintSize);
+  writeByte(STATIC_TEXT);
+  writeUnsigned(result.first->second);
+  // The first reference to a string is followed by its contents.
+  if (result.second)
+    writeString(s);
+}
+
+void BinaryTraceWriter::text(const std::string &s)
+{
+  writeRecord(TEXT);
+  writeString(s);
+}
+
+void BinaryTraceWriter::unsignedValue(uint32_t value)
+{
+  reserve(1 + maxVarintSize);
+  writeByte(UNSIGNED_VALUE);
+  writeUnsigned(value);
+}
+
+void BinaryTraceWriter::signedValue(int32_t value)
+{
+  reserve(1 + maxVarintSize);
+  writeByte(SIGNED_VALUE);
+  writeSigned(value);
+}
+
+void BinaryTraceWriter::hexValue(uint32_t value)
+{
+  reserve(1 + maxVarintSize);
+  writeByte(HEX_VALUE);
+  writeUnsigned(value);
+}
+
+void BinaryTraceWriter::reg(Register reg)
+{
+  reserve(2);
+  writeByte(REG);
+  writeByte(reg);
+}
+
+void BinaryTraceWriter::srcReg(Register reg, uint32_t value)
+{
+  writeRegRecord(SRC_REG, reg, value);
+}
+
+void BinaryTraceWriter::cpRelOffset(uint32_t offset, uint32_t cpValue)
+{
+  reserve(1 + 2 * maxVarintSize);
+  writeByte(CP_REL_OFFSET);
+  writeUnsigned(offset);
+  writeUnsigned(cpValue);
+}
+
+void BinaryTraceWriter::dpRelOffset(uint32_t offset, uint32_t dpValue)
+{
+  reserve(1 + 2 * maxVarintSize);
+  writeByte(DP_REL_OFFSET);
+  writeUnsigned(offset);
+  writeUnsigned(dpValue);
+}
+
+void BinaryTraceWriter::regWrite(Register reg, uint32_t value)
+{
+  writeRegRecord(REG_WRITE, reg, value);
+}
+
+void BinaryTraceWriter::flush()
+{
+  if (pos != start)
+    switchBuffer();
+  buffer.flush();
+}
+
+void BinaryTraceWriter::flushFromSignal()
+{
+  buffer.flushFromSignal(pos - start);
+  start = pos;
+}
+
+BinaryTraceReader::BinaryTraceReader() :
+  readHeader(false),
+  lastTime(0),
+  lastPC(0),
+  pos(0),
+  end(0)
+{
+}
+
+BinaryTraceReader::~BinaryTraceReader()
+{
+  for (std::vector<CoreSymbolInfo*>::iterator it = symbols.begin(),
+       e = symbols.end(); it != e; ++it) {
+    delete *it;
+  }
+}
+
+bool BinaryTraceReader::setError(const std::string &message)
+{
+  error = message;
+  return false;
+}
+
+bool BinaryTraceReader::readByte(uint8_t &value)
+{
+  if (pos == end)
+    return false;
+  value = *pos++;
+  return true;
+}
+
+bool BinaryTraceReader::readUnsigned(uint64_t &value)
+{
+  value = 0;
+  for (unsigned shift = 0; shift < 64; shift += 7) {
+    uint8_t byte;
+    if (!readByte(byte))
+      return false;
+    value |= uint64_t(byte & 0x7f) << shift;
+    if (!(byte & 0x80))
+      return true;
+  }
+  return setError("malformed integer");
+}
+
+bool BinaryTraceReader::readUnsigned(uint32_t &value)
+{
+  uint64_t value64;
+  if (!readUnsigned(value64))
+    return false;
+  value = value64;
+  return true;
+}
+
+bool BinaryTraceReader::readSigned(int64_t &value)
+{
+  uint64_t encoded;
+  if (!readUnsigned(encoded))
+    return false;
+  value = int64_t(encoded >> 1) ^ -int64_t(encoded & 1);
+  return true;
+}
+
+bool BinaryTraceReader::readString(std::string &s)
+{
+  uint32_t size;
+  if (!readUnsigned(size))
+    return false;
+  if (size_t(end - pos) < size)
+    return false;
+  s.assign(reinterpret_cast<const char*>(pos), size);
+  pos += size;
+  return true;
+}
+
+bool BinaryTraceReader::readRegister(Register &reg)
+{
+  uint8_t value;
+  if (!readByte(value))
+    return false;
+  if (value >= NUM_REGISTERS)
+    return setError("invalid register");
+  reg = Register(value);
+  return true;
+}
+
+bool BinaryTraceReader::readFileHeader()
+{
+  if (size_t(end - pos) < sizeof(magic))
+    return false;
+  if (std::memcmp(pos, magic, sizeof(magic)) != 0)
+    return setError("not a binary trace");
+  pos += sizeof(magic);
+  uint32_t fileVersion;
+  if (!readUnsigned(fileVersion))
+    return false;
+  if (fileVersion != version)
+    return setError("unsupported binary trace version");
+  readHeader = true;
+  return true;
+}
+
+bool BinaryTraceReader::readCore(TraceOutput &out)
+{
+  uint32_t core;
+  std::string name;
+  uint8_t hasSymbols;
+  if (!readUnsigned(core) || !readString(name) || !readByte(hasSymbols))
+    return false;
+  if (!hasSymbols) {
+    out.addCore(core, name, 0);
+    return true;
+  }
+  uint32_t numSymbols;
+  if (!readUnsigned(numSymbols))
+    return false;
+  CoreSymbolInfoBuilder builder;
+  std::string symName;
+  for (uint32_t i = 0; i < numSymbols; i++) {
+    uint32_t value;
+    uint8_t info;
+    if (!readString(symName) || !readUnsigned(value) || !readByte(info))
+      return false;
+    builder.addSymbol(symName.c_str(), value, info);
+  }
+  symbols.push_back(builder.getSymbolInfo().release());
+  out.addCore(core, name, symbols.back());
+  return true;
+}
+
+bool BinaryTraceReader::readRecord(TraceOutput &out)
+{
+  uint8_t type;
+  if (!readByte(type))
+    return false;
+  switch (type) {
+  default: {
+    std::ostringstream message;
+    message << "unknown record type " << unsigned(type);
+    return setError(message.str());
+  }
+  case ADD_CORE:
+    return readCore(out);
+  case START_LINE:
+    out.startLine();
+    return true;
+  case START_THREAD_LINE: {
+    int64_t delta;
+    uint32_t core, thread;
+    if (!readSigned(delta) || !readUnsigned(core) || !readUnsigned(thread))
+      return false;
+    lastTime += delta;
+    out.startThreadLine(lastTime, core, thread);
+    return true;
+  }
+  case START_NODE_LINE: {
+    uint32_t nodeID;
+    if (!readUnsigned(nodeID))
+      return false;
+    out.startNodeLine(nodeID);
+    return true;
+  }
+  case SET_LINE_THREAD: {
+    uint32_t core, thread;
+    if (!readUnsigned(core) || !readUnsigned(thread))
+      return false;
+    out.setLineThread(core, thread);
+    return true;
+  }
+  case PUSH_LINE:
+    out.pushLine();
+    return true;
+  case POP_LINE:
+    out.popLine();
+    return true;
+  case END_LINE:
+    out.endLine();
+    return true;
+  case THREAD_NAME:
+    out.threadName();
+    return true;
+  case PC: {
+    int64_t delta;
+    if (!readSigned(delta))
+      return false;
+    lastPC += delta;
+    out.pc(lastPC);
+    return true;
+  }
+  case ALIGN_MNEMONIC:
+    out.alignMnemonic();
+    return true;
+  case COLOUR: {
+    uint8_t c;
+    if (!readByte(c))
+      return false;
+    out.colour(TraceOutput::Colour(c));
+    return true;
+  }
+  case STATIC_TEXT: {
+    uint32_t index;
+    if (!readUnsigned(index))
+      return false;
+    if (index == staticStrings.size()) {
+      std::string s;
+      if (!readString(s))
+        return false;
+      staticStrings.push_back(s);
+    } else if (index > staticStrings.size()) {
+      return setError("invalid string index");
+    }
+    out.text(staticStrings[index]);
+    return true;
+  }
+  case TEXT: {
+    std::string s;
+    if (!readString(s))
+      return false;
+    out.text(s);
+    return true;
+  }
+  case UNSIGNED_VALUE:
+  case HEX_VALUE: {
+    uint32_t value;
+    if (!readUnsigned(value))
+      return false;
+    if (type == UNSIGNED_VALUE)
+      out.unsignedValue(value);
+    else
+      out.hexValue(value);
+    return true;
+  }
+  case SIGNED_VALUE: {
+    int64_t value;
+    if (!readSigned(value))
+      return false;
+    out.signedValue(value);
+    return true;
+  }
+  case REG: {
+    Register reg;
+    if (!readRegister(reg))
+      return false;
+    out.reg(reg);
+    return true;
+  }
+  case SRC_REG:
+  case REG_WRITE: {
+    Register reg;
+    uint32_t value;
+    if (!readRegister(reg) || !readUnsigned(value))
+      return false;
+    if (type == SRC_REG)
+      out.srcReg(reg, value);
+    else
+      out.regWrite(reg, value);
+    return true;
+  }
+  case CP_REL_OFFSET:
+  case DP_REL_OFFSET: {
+    uint32_t offset, base;
+    if (!readUnsigned(offset) || !readUnsigned(base))
+      return false;
+    if (type == CP_REL_OFFSET)
+      out.cpRelOffset(offset, base);
+    else
+      out.dpRelOffset(offset, base);
+    return true;
+  }
+  }
+}
+
+bool BinaryTraceReader::
+decode(const uint8_t *data, size_t size, TraceOutput &out)
+{
+  pos = data;
+  end = data + size;
+  while (pos != end) {
+    const uint8_t *recordStart = pos;
+    if (!(readHeader ? readRecord(out) : readFileHeader())) {
+      if (!error.empty())
+        return false;
+      // Keep the incomplete record until more data arrives.
+      pending.assign(recordStart, end);
+      break;
+    }
+  }
+  return true;
+}
+
+bool BinaryTraceReader::
+addData(const uint8_t *data, size_t size, TraceOutput &out)
+{
+  if (!error.empty())
+    return false;
+  if (pending.empty())
+    return decode(data, size, out);
+  std::vector<uint8_t> buf;
+  std::swap(buf, pending);
+  buf.insert(buf.end(), data, data + size);
+  return decode(&buf[0], buf.size(), out);
+}
+
+bool BinaryTraceReader::finish()
+{
+  if (!error.empty())
+    return false;
+  if (!readHeader)
+    return setError("not a binary trace");
+  if (!pending.empty())
+    return setError("unexpected end of trace");
+  return true;
+}
+
+bool BinaryTraceReader::read(std::FILE *file, TraceOutput &out)
+{
+  std::vector<uint8_t> buf(1 << 16);
+  size_t size;
+  while ((size = std::fread(&buf[0], 1, buf.size(), file)) != 0) {
+    if (!addData(&buf[0], size, out))
+      return false;
+  }
+  return finish();
+}
+
+BinaryTraceFileSink::~BinaryTraceFileSink()
+{
+  if (file)
+    std::fclose(file);
+}
+
+bool BinaryTraceFileSink::open(const std::string &filename)
+{
+  file = std::fopen(filename.c_str(), "wb");
+  return file != 0;
+}
+
+void BinaryTraceFileSink::write(const uint8_t *data, size_t size)
+{
+  std::fwrite(data, 1, size, file);
+}
+
+void BinaryTraceFileSink::flush()
+{
+  std::fflush(file);
+}
+
+void BinaryTraceDecodingSink::write(const uint8_t *data, size_t size)
+{
+  reader.addData(data, size, out);
+}
+
+void BinaryTraceDecodingSink::flush()
+{
+  out.flush();
+}
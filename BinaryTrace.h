@@ -0,0 +1,197 @@
+// Copyright (c) 2012, Richard Osborne, All rights reserved
+// This software is freely distributable under a derivative of the
+// University of Illinois/NCSA Open Source License posted in
+// LICENSE.txt and at <http://github.xcore.com/>
+
+#ifndef _BinaryTrace_h_
+#define _BinaryTrace_h_
+
+#include "TraceOutput.h"
+#include "TraceBuffer.h"
+#include <cstdio>
+#include <map>
+#include <string>
+#include <vector>
+
+// A binary trace is a header followed by a stream of records, one for each
+// call on the TraceOutput interface. Each record starts with a byte giving
+// its type followed by its fields. Integers are encoded as LEB128 varints.
+// Times and PCs are encoded as the signed difference from the previous time
+// or PC. Static strings (mnemonics and punctuation) are sent once and
+// referred to by index afterwards.
+
+namespace BinaryTrace {
+  enum RecordType {
+    ADD_CORE,
+    START_LINE,
+    START_THREAD_LINE,
+    START_NODE_LINE,
+    SET_LINE_THREAD,
+    PUSH_LINE,
+    POP_LINE,
+    END_LINE,
+    THREAD_NAME,
+    PC,
+    ALIGN_MNEMONIC,
+    COLOUR,
+    STATIC_TEXT,
+    TEXT,
+    UNSIGNED_VALUE,
+    SIGNED_VALUE,
+    HEX_VALUE,
+    REG,
+    SRC_REG,
+    CP_REL_OFFSET,
+    DP_REL_OFFSET,
+    REG_WRITE
+  };
+  extern const char magic[8];
+  const unsigned version = 1;
+}
+
+/// Encodes the trace in the binary trace format. Records are written in place
+/// into the blocks of a TraceBuffer which passes them to a sink.
+class BinaryTraceWriter : public TraceOutput {
+private:
+  TraceBuffer buffer;
+  uint8_t *start;
+  uint8_t *pos;
+  uint8_t *end;
+  ticks_t lastTime;
+  uint32_t lastPC;
+  std::map<const char*,unsigned> staticStrings;
+
+  BinaryTraceWriter(const BinaryTraceWriter &); // Not implemented.
+  void operator=(const BinaryTraceWriter &); // Not implemented.
+
+  void switchBuffer();
+  /// Ensure there is space for at least size bytes in the current block.
+  void reserve(size_t size)
+  {
+    if (size > size_t(end - pos))
+      switchBuffer();
+  }
+  void writeByte(uint8_t value)
+  {
+    *pos++ = value;
+  }
+  void writeUnsigned(uint64_t value)
+  {
+    while (value >= 0x80) {
+      *pos++ = value | 0x80;
+      value >>= 7;
+    }
+    *pos++ = value;
+  }
+  void writeSigned(int64_t value)
+  {
+    writeUnsigned((uint64_t(value) << 1) ^ uint64_t(value >> 63));
+  }
+  void writeRecord(BinaryTrace::RecordType type)
+  {
+    reserve(1);
+    writeByte(type);
+  }
+  void writeString(const std::string &s);
+  void writeRegRecord(BinaryTrace::RecordType type, Register reg,
+                      uint32_t value);
+public:
+  BinaryTraceWriter(TraceSink &sink);
+  ~BinaryTraceWriter();
+
+  virtual void addCore(unsigned core, const std::string &name,
+                       const CoreSymbolInfo *symbols);
+  virtual void startLine();
+  virtual void startThreadLine(ticks_t time, unsigned core, unsigned thread);
+  virtual void startNodeLine(unsigned nodeID);
+  virtual void setLineThread(unsigned core, unsigned thread);
+  virtual void pushLine();
+  virtual void popLine();
+  virtual void endLine();
+  virtual void threadName();
+  virtual void pc(uint32_t address);
+  virtual void alignMnemonic();
+  virtual void colour(Colour c);
+  virtual void text(const char *s);
+  virtual void text(const std::string &s);
+  virtual void unsignedValue(uint32_t value);
+  virtual void signedValue(int32_t value);
+  virtual void hexValue(uint32_t value);
+  virtual void reg(Register reg);
+  virtual void srcReg(Register reg, uint32_t value);
+  virtual void cpRelOffset(uint32_t offset, uint32_t cpValue);
+  virtual void dpRelOffset(uint32_t offset, uint32_t dpValue);
+  virtual void regWrite(Register reg, uint32_t value);
+  virtual void flush();
+  /// Flush from a signal handler. No further records may be written.
+  void flushFromSignal();
+};
+
+/// Decodes a binary trace and replays it on a TraceOutput. The trace may be
+/// passed in pieces of any size.
+class BinaryTraceReader {
+private:
+  std::string error;
+  bool readHeader;
+  ticks_t lastTime;
+  uint32_t lastPC;
+  std::vector<std::string> staticStrings;
+  std::vector<CoreSymbolInfo*> symbols;
+  /// Data from the end of the last piece that didn't form a complete record.
+  std::vector<uint8_t> pending;
+  const uint8_t *pos;
+  const uint8_t *end;
+
+  BinaryTraceReader(const BinaryTraceReader &); // Not implemented.
+  void operator=(const BinaryTraceReader &); // Not implemented.
+
+  // The following functions return false if there is not enough data or if
+  // the data is malformed, in which case the error is set.
+  bool readByte(uint8_t &value);
+  bool readUnsigned(uint64_t &value);
+  bool readUnsigned(uint32_t &value);
+  bool readSigned(int64_t &value);
+  bool readString(std::string &s);
+  bool readRegister(Register &reg);
+  bool readFileHeader();
+  bool readCore(TraceOutput &out);
+  bool readRecord(TraceOutput &out);
+  bool setError(const std::string &message);
+  bool decode(const uint8_t *data, size_t size, TraceOutput &out);
+public:
+  BinaryTraceReader();
+  ~BinaryTraceReader();
+  /// Decode the next piece of the trace. Returns false if the trace is
+  /// malformed.
+  bool addData(const uint8_t *data, size_t size, TraceOutput &out);
+  /// Returns false if the trace ended part way through a record.
+  bool finish();
+  /// Decode a whole trace file.
+  bool read(std::FILE *file, TraceOutput &out);
+  const std::string &getError() const { return error; }
+};
+
+/// Writes a binary trace to a file.
+class BinaryTraceFileSink : public TraceSink {
+private:
+  std::FILE *file;
+public:
+  BinaryTraceFileSink() : file(0) {}
+  ~BinaryTraceFileSink();
+  bool open(const std::string &filename);
+  virtual void write(const uint8_t *data, size_t size);
+  virtual void flush();
+};
+
+/// Decodes a binary trace and replays it on a TraceOutput.
+class BinaryTraceDecodingSink : public TraceSink {
+private:
+  BinaryTraceReader reader;
+  TraceOutput &out;
+public:
+  BinaryTraceDecodingSink(TraceOutput &o) : out(o) {}
+  virtual void write(const uint8_t *data, size_t size);
+  virtual void flush();
+};
+
+#endif // _BinaryTrace_h_
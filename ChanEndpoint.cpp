@@ -23,7 +23,7 @@ bool ChanEndpoint::claim(ChanEndpoint *newSource, bool &junkPacket)
   }
   // Check if we are already in the middle of a packet.
   if (source) {
-    queue.push(newSource);
+    queue.push_back(newSource);
     return false;
   }
   // Claim the channel
@@ -38,6 +38,6 @@ void ChanEndpoint::release(ticks_t time)
     return;
   }
   source = queue.front();
-  queue.pop();
+  queue.pop_front();
   source->notifyDestClaimed(time);
 }
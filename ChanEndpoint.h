@@ -6,7 +6,7 @@
 #ifndef _ChanEndpoint_h_
 #define _ChanEndpoint_h_
 
-#include <queue>
+#include "small_vector.h"
 #include "Config.h"
 
 class ChanEndpoint {
@@ -14,7 +14,7 @@ private:
   /// Should incoming packets be junked?
   bool junkIncoming;
   /// Chanends blocked on the route to this channel end becoming free.
-  std::queue<ChanEndpoint *> queue;
+  small_vector<ChanEndpoint *, 1> queue;
   /// The source of the current packet, 0 if not receiving a packet.
   ChanEndpoint *source;
 protected:
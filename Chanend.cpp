@@ -281,6 +281,8 @@ bool Chanend::setData(Thread &thread, uint32_t value, ticks_t time)
 
 ticks_t Chanend::getLatency(Chanend *dest, int numTokens, bool inPacket,
     ticks_t time) {
+  if (!LatencyModel::get().isEnabled())
+    return 0;
   // Might be a switch
   if (dest->hasOwner()) {
     uint32_t sourceCore = getOwner().getParent().getCoreNumber();
@@ -102,6 +102,9 @@ private:
   void debug();
 
 public:
+  /// Returns whether the thread is paused on an output to the chanend.
+  bool isPausedOut(const Thread &t) const { return pausedOut == &t; }
+
   Chanend() : EventableResource(RES_TYPE_CHANEND), lastTime(0), lastLatency(0) {}
 
   bool alloc(Thread &t)
@@ -5,21 +5,99 @@
 
 #include "ClockBlock.h"
 #include "Port.h"
+#include "SystemState.h"
+#include <algorithm>
 
 
 ClockBlock::ClockBlock() :
   Resource(RES_TYPE_CLKBLK),
   source(0),
   readyIn(0),
-  running(false)
+  running(false),
+  system(0),
+  updateScheduled(false),
+  updatingPorts(false)
 {
 }
 
+void ClockBlock::cancelPortUpdate(Port *port)
+{
+  for (unsigned i = 0; i < pendingUpdates.size(); i++) {
+    if (pendingUpdates[i].port == port) {
+      pendingUpdates.swap_erase(pendingUpdates.begin() + i);
+      rescheduleUpdates();
+      return;
+    }
+  }
+}
+
+void ClockBlock::rescheduleUpdates()
+{
+  if (updatingPorts)
+    return;
+  if (pendingUpdates.empty()) {
+    if (updateScheduled) {
+      updateScheduled = false;
+      system->unschedule(*this);
+    }
+    return;
+  }
+  ticks_t wakeTime = pendingUpdates[0].time;
+  for (unsigned i = 1; i < pendingUpdates.size(); i++)
+    wakeTime = std::min(wakeTime, pendingUpdates[i].time);
+  if (updateScheduled && wakeUpTime == wakeTime)
+    return;
+  updateScheduled = true;
+  system->scheduleOther(*this, wakeTime);
+}
+
+void ClockBlock::
+schedulePortUpdate(Port &port, ticks_t time, SystemState &sys)
+{
+  system = &sys;
+  for (unsigned i = 0; i < pendingUpdates.size(); i++) {
+    if (pendingUpdates[i].port == &port) {
+      if (pendingUpdates[i].time == time)
+        return;
+      pendingUpdates[i].time = time;
+      rescheduleUpdates();
+      return;
+    }
+  }
+  PendingUpdate update;
+  update.port = &port;
+  update.time = time;
+  pendingUpdates.push_back(update);
+  rescheduleUpdates();
+}
+
+void ClockBlock::run(ticks_t time)
+{
+  updateScheduled = false;
+  updatingPorts = true;
+  // Updating a port may schedule or cancel updates of other ports so search
+  // for the earliest due port again after each update.
+  while (true) {
+    int next = -1;
+    for (unsigned i = 0; i < pendingUpdates.size(); i++) {
+      if (pendingUpdates[i].time <= time &&
+          (next < 0 || pendingUpdates[i].time < pendingUpdates[next].time))
+        next = i;
+    }
+    if (next < 0)
+      break;
+    PendingUpdate update = pendingUpdates[next];
+    pendingUpdates.swap_erase(pendingUpdates.begin() + next);
+    update.port->run(update.time);
+  }
+  updatingPorts = false;
+  rescheduleUpdates();
+}
+
 void ClockBlock::updateAttachedPorts(ticks_t time)
 {
-  for (std::set<Port*>::iterator it = ports.begin(), e = ports.end();
-       it != e; ++it) {
-    (*it)->update(time);
+  for (unsigned i = 0; i < ports.size(); i++) {
+    ports[i]->update(time);
   }
 }
 
@@ -28,17 +106,15 @@ seeChangeOnAttachedPorts(ticks_t time)
 {
   if (!running)
     return;
-  for (std::set<Port*>::iterator it = ports.begin(), e = ports.end();
-       it != e; ++it) {
-    (*it)->seeClockChange(time);
+  for (unsigned i = 0; i < ports.size(); i++) {
+    ports[i]->seeClockChange(time);
   }
 }
 
 void ClockBlock::
 seeEdgeOnAttachedPorts(Edge::Type edgeType, ticks_t time) {
-  for (std::set<Port*>::iterator it = ports.begin(), e = ports.end();
-       it != e; ++it) {
-    (*it)->seeEdge(edgeType, time);
+  for (unsigned i = 0; i < ports.size(); i++) {
+    ports[i]->seeEdge(edgeType, time);
   }
 }
   
@@ -146,10 +222,9 @@ void ClockBlock::start(Thread &thread, ticks_t time)
   if (!source) {
     value.changeFrequency(time, 0, getHalfPeriod());
   }
-  for (std::set<Port*>::iterator it = ports.begin(), e = ports.end();
-       it != e; ++it) {
+  for (unsigned i = 0; i < ports.size(); i++) {
     // Update ports to current time
-    (*it)->seeClockStart(time);
+    ports[i]->seeClockStart(time);
   }
 }
 
@@ -7,13 +7,22 @@
 #define _ClockBlock_h_
 
 #include "Resource.h"
+#include "Runnable.h"
 #include "Signal.h"
-#include <set>
+#include "small_vector.h"
 
 class Port;
+class SystemState;
 
-class ClockBlock : public Resource {
+/// A clock block. The clock block is scheduled on behalf of its attached ports
+/// so the ports that need updating on the same edge are updated together
+/// from a single scheduler event.
+class ClockBlock : public Resource, public Runnable {
 private:
+  struct PendingUpdate {
+    Port *port;
+    ticks_t time;
+  };
   /// Clock source, 0 if source is reference clock.
   Port *source;
   /// Ready in port, 0 if no ready in.
@@ -21,12 +30,22 @@ private:
   /// Clock divide
   unsigned divide;
   /// Attached ports
-  std::set<Port*> ports;
+  small_vector<Port*, 4> ports;
   /// Current value.
   Signal value;
   /// Has the clock been started?
   bool running;
   Signal readyInValue;
+  /// Attached ports waiting to be updated and the times they are due.
+  small_vector<PendingUpdate, 4> pendingUpdates;
+  SystemState *system;
+  /// Is the clock block in the scheduler's queue?
+  bool updateScheduled;
+  /// Set while the due ports are updated in run().
+  bool updatingPorts;
+
+  /// Keep the clock block scheduled for exactly the earliest pending update.
+  void rescheduleUpdates();
 
   void updateAttachedPorts(ticks_t time);
   
@@ -64,13 +83,24 @@ public:
   }
 
   void attachPort(Port *port) {
-    ports.insert(port);
+    ports.insert_unique(port);
   }
 
   void detachPort(Port *port) {
-    ports.erase(port);
+    ports.erase_value(port);
+    cancelPortUpdate(port);
   }
 
+  /// Schedule an update of an attached port at the specified time, replacing
+  /// any update of the port already scheduled.
+  void schedulePortUpdate(Port &port, ticks_t time, SystemState &sys);
+
+  /// Cancel any update of an attached port.
+  void cancelPortUpdate(Port *port);
+
+  /// Update the attached ports that are due.
+  void run(ticks_t time);
+
   void setValue(const Signal &value, ticks_t time);
   Signal getValue() const;
   bool getValue(ticks_t time) const {
@@ -25,6 +25,39 @@ do { \
 
 Config Config::instance;
 
+bool CoreParams::validate() const
+{
+  const unsigned max = MAX_RESOURCES_PER_TYPE;
+  // Thread 0 and clock block 0 always exist.
+  const struct {
+    const char *name;
+    unsigned value;
+    unsigned min;
+    unsigned max;
+  } params[] = {
+    { "num-threads", numThreads, 1, max },
+    { "num-synchronisers", numSyncs, 0, max },
+    { "num-locks", numLocks, 0, max },
+    { "num-timers", numTimers, 0, max },
+    { "num-chanends", numChanends, 0, max },
+    { "num-clock-blocks", numClkBlks, 1, max },
+    { "num-1bit-ports", num1BitPorts, 0, max },
+    { "num-4bit-ports", num4BitPorts, 0, max },
+    { "num-8bit-ports", num8BitPorts, 0, max },
+    { "num-16bit-ports", num16BitPorts, 0, max },
+    { "num-32bit-ports", num32BitPorts, 0, max },
+    { "ram-size-log", ramSizeLog, 10, 30 },
+  };
+  for (unsigned i = 0; i < sizeof(params) / sizeof(params[0]); i++) {
+    if (params[i].value < params[i].min || params[i].value > params[i].max) {
+      std::cout << "Error: " << params[i].name << " must be in the range "
+                << params[i].min << " to " << params[i].max << ".\n";
+      return false;
+    }
+  }
+  return true;
+}
+
 int Config::read(const std::string &file) {
   FILE *fp = fopen(file.c_str(), "r");
   char line[BUF_LEN];
@@ -52,6 +85,18 @@ int Config::read(const std::string &file) {
     READ_U_PARAM("latency-serialisation",    latencySerialisation);
     READ_U_PARAM("latency-link-on-chip",     latencyLinkOnChip);
     READ_U_PARAM("latency-link-off-chip",    latencyLinkOffChip);
+    READ_U_PARAM("num-threads",              coreParams.numThreads);
+    READ_U_PARAM("num-synchronisers",        coreParams.numSyncs);
+    READ_U_PARAM("num-locks",                coreParams.numLocks);
+    READ_U_PARAM("num-timers",               coreParams.numTimers);
+    READ_U_PARAM("num-chanends",             coreParams.numChanends);
+    READ_U_PARAM("num-clock-blocks",         coreParams.numClkBlks);
+    READ_U_PARAM("num-1bit-ports",           coreParams.num1BitPorts);
+    READ_U_PARAM("num-4bit-ports",           coreParams.num4BitPorts);
+    READ_U_PARAM("num-8bit-ports",           coreParams.num8BitPorts);
+    READ_U_PARAM("num-16bit-ports",          coreParams.num16BitPorts);
+    READ_U_PARAM("num-32bit-ports",          coreParams.num32BitPorts);
+    READ_U_PARAM("ram-size-log",             coreParams.ramSizeLog);
     if (!strncmp("latency-model", line, strlen("latency-model"))) {
       sscanf(line, "latency-model%[^\"]\"%[^\"]\"", junk, str);
       if (!strncmp("sp-mesh", str, strlen("sp-mesh"))) {
@@ -74,6 +119,9 @@ int Config::read(const std::string &file) {
     return 0;
   }
   
+  if (!coreParams.validate())
+    return 0;
+
   // (Re)calculate consequential parameters
   latencyGlobalMemory *= CYCLES_PER_TICK;
   latencyLocalMemory *= CYCLES_PER_TICK;
@@ -87,22 +135,22 @@ int Config::read(const std::string &file) {
 
 void Config::display() {
   // Fixed system parameters
-  double ramSizeKB = (double) RAM_SIZE / 1000.0;
+  double ramSizeKB = (double) coreParams.getRamSize() / 1000.0;
   double coreFreqMHz = (double) CYCLES_PER_SEC / 1000000.0;
   std::cout.fill('=');
   std::cout.width(38);
   std::cout << std::left << "System parameters " << std::endl;
   std::cout.fill(' ');
   std::cout << "Num threads per core:         " 
-    << NUM_THREADS << std::endl;
+    << coreParams.numThreads << std::endl;
   std::cout << "Num synchronisers per core:   " 
-    << NUM_SYNCS << std::endl;
+    << coreParams.numSyncs << std::endl;
   std::cout << "Num locks per core:           " 
-    << NUM_LOCKS << std::endl;
+    << coreParams.numLocks << std::endl;
   std::cout << "Num timers per core:          " 
-    << NUM_TIMERS << std::endl;
+    << coreParams.numTimers << std::endl;
   std::cout << "Num channel ends per core:    " 
-    << NUM_CHANENDS << std::endl;
+    << coreParams.numChanends << std::endl;
   std::cout << "Memory size per core:         " 
     << std::setprecision(4) << ramSizeKB << "KB" << std::endl;
   std::cout << "Core frequency:               " 
@@ -10,25 +10,33 @@
 #include <string>
 #include <boost/detail/endian.hpp>
 
-/// Number of threads per core.
+// The resource counts below are the defaults. They can be overridden with
+// the -c configuration file or per core in the XE configuration. See
+// CoreParams.
+
+/// Default number of threads per core.
 #define NUM_THREADS 20
 
-/// Number of synchronisers per core.
+/// Default number of synchronisers per core.
 // TODO Check number.
 #define NUM_SYNCS 20
 
-/// Number of locks per core.
+/// Default number of locks per core.
 #define NUM_LOCKS 4
 
-/// Number of timers per core.
+/// Default number of timers per core.
 #define NUM_TIMERS 10
 
-/// Number of channel ends per core.
+/// Default number of channel ends per core.
 #define NUM_CHANENDS 32
 
-/// Number of clock blocks per core.
+/// Default number of clock blocks per core.
 #define NUM_CLKBLKS 6
 
+/// Maximum number of each type of resource. This is limited by the size of the
+/// resource number field in a resource ID.
+#define MAX_RESOURCES_PER_TYPE 256
+
 #define NUM_1BIT_PORTS 16
 #define NUM_4BIT_PORTS 6
 #define NUM_8BIT_PORTS 4
@@ -38,7 +46,7 @@
 (NUM_1BIT_PORTS + NUM_4BIT_PORTS + NUM_8BIT_PORTS +\
  NUM_16BIT_PORTS + NUM_32BIT_PORTS)
 
-/// Log base 2 of memory size in bytes.
+/// Default log base 2 of memory size in bytes.
 #define RAM_SIZE_LOG 18
 
 /// Default size of ram in bytes
@@ -68,7 +76,9 @@ typedef uint64_t ticks_t;
 #define EXPENSIVE_CHECKS 0
 
 #ifdef __GNUC__
+#ifndef TAIL_CALL_DISPATCH
 #define DIRECT_THREADED
+#endif
 #define UNUSED(x) x __attribute__((__unused__))
 #endif // __GNUC__
 
@@ -76,6 +86,24 @@ typedef uint64_t ticks_t;
 #define UNUSED(x) x
 #endif
 
+// When the tail call dispatcher is used each instruction handler ends in a
+// call to the next handler. The call must be compiled as a jump whatever the
+// optimisation level, otherwise the stack grows with every instruction.
+#if !defined(MUSTTAIL) && defined(__has_cpp_attribute)
+#if __has_cpp_attribute(clang::musttail)
+#define MUSTTAIL [[clang::musttail]]
+#elif __has_cpp_attribute(gnu::musttail)
+#define MUSTTAIL [[gnu::musttail]]
+#endif
+#endif
+
+#ifndef MUSTTAIL
+#ifdef TAIL_CALL_DISPATCH
+#error "The tail call dispatcher requires a compiler with guaranteed tail calls"
+#endif
+#define MUSTTAIL
+#endif
+
 #if defined(BOOST_LITTLE_ENDIAN)
 #define HOST_LITTLE_ENDIAN 1
 #elif defined(BOOST_BIG_ENDIAN)
@@ -84,6 +112,40 @@ typedef uint64_t ticks_t;
 #error "Unknown endianness"
 #endif
 
+/// Number of resources of each type and memory size for a core.
+struct CoreParams {
+  unsigned numThreads;
+  unsigned numSyncs;
+  unsigned numLocks;
+  unsigned numTimers;
+  unsigned numChanends;
+  unsigned numClkBlks;
+  unsigned num1BitPorts;
+  unsigned num4BitPorts;
+  unsigned num8BitPorts;
+  unsigned num16BitPorts;
+  unsigned num32BitPorts;
+  unsigned ramSizeLog;
+
+  CoreParams() :
+    numThreads(NUM_THREADS),
+    numSyncs(NUM_SYNCS),
+    numLocks(NUM_LOCKS),
+    numTimers(NUM_TIMERS),
+    numChanends(NUM_CHANENDS),
+    numClkBlks(NUM_CLKBLKS),
+    num1BitPorts(NUM_1BIT_PORTS),
+    num4BitPorts(NUM_4BIT_PORTS),
+    num8BitPorts(NUM_8BIT_PORTS),
+    num16BitPorts(NUM_16BIT_PORTS),
+    num32BitPorts(NUM_32BIT_PORTS),
+    ramSizeLog(RAM_SIZE_LOG) {}
+
+  uint32_t getRamSize() const { return 1 << ramSizeLog; }
+  /// Returns false and prints an error if the parameters are out of range.
+  bool validate() const;
+};
+
 class Config {
 public:
   enum LatencyModelType {
@@ -111,6 +173,8 @@ public:
   unsigned latencyLinkOffChip;
   bool     contention;
   LatencyModelType latencyModelType;
+  /// Default parameters for cores.
+  CoreParams coreParams;
   
   int read(const std::string &file);
   void display();
@@ -6,6 +6,8 @@
 #include "Core.h"
 #include "SystemState.h"
 #include "Node.h"
+#include "Profiler.h"
+#include "SpinLoop.h"
 #include <iostream>
 #include <iomanip>
 #include <sstream>
@@ -20,14 +22,108 @@ bool Core::allocatable[LAST_STD_RES_TYPE + 1] = {
   false, // RES_TYPE_CLKBLK
 };
 
+Core::~Core()
+{
+  for (int i = 0; i <= LAST_STD_RES_TYPE; i++) {
+    for (unsigned j = 0; j < resourceNum[i]; j++) {
+      delete resource[i][j];
+    }
+    delete[] resource[i];
+  }
+  for (unsigned width = 0; width < 33; width++) {
+    for (unsigned j = 0; j < portNum[width]; j++) {
+      delete port[width][j];
+    }
+    delete[] port[width];
+  }
+  HugePageAllocator &allocator = HugePageAllocator::get();
+  allocator.freeArray(opcode, (ram_size >> 1) + ILLEGAL_PC_THREAD_ADDR_OFFSET);
+  allocator.freeArray(operands, ram_size >> 1);
+  if (tracingOpcode) {
+    allocator.freeArray(tracingOpcode,
+                        (ram_size >> 1) + ILLEGAL_PC_THREAD_ADDR_OFFSET);
+    allocator.freeArray(tracingOperands, ram_size >> 1);
+  }
+  allocator.freeArray(memory, ram_size >> 2);
+  delete[] pcProfile;
+  for (std::map<uint32_t,SpinLoop*>::iterator it = spinLoops.begin(),
+       e = spinLoops.end(); it != e; ++it) {
+    delete it->second;
+  }
+}
+
+void Core::setSpinLoop(uint32_t pc, SpinLoop *loop)
+{
+  std::map<uint32_t,SpinLoop*>::iterator it = spinLoops.find(pc);
+  if (it != spinLoops.end()) {
+    delete it->second;
+    if (!loop) {
+      spinLoops.erase(it);
+      return;
+    }
+    it->second = loop;
+    return;
+  }
+  if (loop)
+    spinLoops.insert(std::make_pair(pc, loop));
+}
+
+Resource *Core::createResource(ResourceType type, unsigned num)
+{
+  assert(type != RES_TYPE_PORT && num < resourceNum[type]);
+  Resource *res = 0;
+  switch (type) {
+  default: assert(0 && "Unexpected resource type");
+  case RES_TYPE_TIMER:
+    res = new Timer;
+    break;
+  case RES_TYPE_CHANEND:
+    res = new Chanend;
+    break;
+  case RES_TYPE_SYNC:
+    res = new Synchroniser(getNumThreads());
+    break;
+  case RES_TYPE_THREAD:
+    {
+      Thread *t = new Thread;
+      t->setParent(*this);
+      res = t;
+      break;
+    }
+  case RES_TYPE_LOCK:
+    res = new Lock;
+    break;
+  case RES_TYPE_CLKBLK:
+    res = new ClockBlock;
+    break;
+  }
+  res->setNum(num);
+  if (type == RES_TYPE_CHANEND && parent)
+    res->setNode(getCoreID());
+  resource[type][num] = res;
+  return res;
+}
+
+Port *Core::createPort(unsigned width, unsigned num)
+{
+  assert(num < portNum[width] && !port[width][num]);
+  Port *p = new Port;
+  p->setNum(num);
+  p->setWidth(width);
+  p->setClkInitial(
+    static_cast<ClockBlock*>(getResource(RES_TYPE_CLKBLK, 0)));
+  port[width][num] = p;
+  return p;
+}
+
 void Core::dumpPaused() const
 {
-  for (unsigned i = 0; i < NUM_THREADS; i++) {
-    Thread *t = static_cast<Thread*>(resource[RES_TYPE_THREAD][i]);
-    if (!t->isInUse())
+  for (unsigned i = 0; i < getNumThreads(); i++) {
+    const Thread *t = findThread(i);
+    if (!t || !t->isInUse())
       continue;
     std::cout << "Thread " << std::dec << i;
-    Thread &ts = *t;
+    const Thread &ts = *t;
     if (Resource *res = ts.pausedOn) {
       std::cout << " paused on ";
       std::cout << Resource::getResourceName(res->getType());
@@ -45,7 +141,7 @@ void Core::dumpPaused() const
   }
 }
 
-const Port *Core::getPortByID(ResourceID ID) const
+Port *Core::getPortByID(ResourceID ID)
 {
   assert(ID.type() == RES_TYPE_PORT);
   unsigned width = ID.width();
@@ -54,18 +150,43 @@ const Port *Core::getPortByID(ResourceID ID) const
   unsigned num = ID.num();
   if (num > portNum[width])
     return 0;
+  // Ports connected to other ports use the port model.
+  if (num < portNum[width]) {
+    Port *p = port[width][num];
+    if (p && p->isConnected())
+      return p;
+  }
   //std::cout<<"getPortByID ID="<<ID<<", width="<<width<<", num="<<num<<std::endl;
   if (ID < 256) {
     //std::cout<<"port "<<std::hex<<ID<<" to 0"<<std::endl;
-    return &port[width][0];
+    num = 0;
   } else {
     //std::cout<<"port "<<std::hex<<ID<<" to 1"<<std::endl;
-    return &port[width][1];
+    num = 1;
   }
-  return &port[width][num];
+  if (num >= portNum[width])
+    return 0;
+  if (Port *p = port[width][num])
+    return p;
+  return createPort(width, num);
 }
 
-const Resource *Core::getResourceByID(ResourceID ID) const
+Port *Core::getPhysicalPort(ResourceID ID)
+{
+  if (ID.type() != RES_TYPE_PORT)
+    return 0;
+  unsigned width = ID.width();
+  if (width > 32)
+    return 0;
+  unsigned num = ID.num();
+  if (num >= portNum[width])
+    return 0;
+  if (Port *p = port[width][num])
+    return p;
+  return createPort(width, num);
+}
+
+Resource *Core::getResourceByID(ResourceID ID)
 {
   ResourceType type = ID.type();
   if (type > LAST_STD_RES_TYPE) {
@@ -78,14 +199,7 @@ const Resource *Core::getResourceByID(ResourceID ID) const
   if (num >= resourceNum[type]) {
     return 0;
   }
-  return resource[type][num];
-}
-
-Resource *Core::getResourceByID(ResourceID ID)
-{
-  return const_cast<Resource *>(
-    static_cast<const Core *>(this)->getResourceByID(ID)
-  );
+  return getResource(type, num);
 }
 
 bool Core::setSyscallAddress(uint32_t value)
@@ -106,23 +220,112 @@ bool Core::setExceptionAddress(uint32_t value)
   return true;
 }
 
+void Core::clearCache(OPCODE_TYPE *cache)
+{
+  for (unsigned i = 0; i < (ram_size >> 1) + ILLEGAL_PC_THREAD_ADDR_OFFSET;
+       ++i) {
+#if defined(DIRECT_THREADED) || defined(TAIL_CALL_DISPATCH)
+    cache[i] = 0;
+#else
+    cache[i] = INITIALIZE;
+#endif
+  }
+}
+
+void Core::allocTracingCacheSlowPath()
+{
+  HugePageAllocator &allocator = HugePageAllocator::get();
+  tracingOpcode = allocator.allocArray<OPCODE_TYPE>(
+    (ram_size >> 1) + ILLEGAL_PC_THREAD_ADDR_OFFSET);
+  tracingOperands = allocator.allocArray<Operands>(ram_size >> 1);
+  clearCache(tracingOpcode);
+}
+
 void Core::
-initCache(OPCODE_TYPE decode, OPCODE_TYPE illegalPC,
+initCache(bool tracing, OPCODE_TYPE decode, OPCODE_TYPE illegalPC,
           OPCODE_TYPE illegalPCThread, OPCODE_TYPE syscall,
           OPCODE_TYPE exception)
 {
   const uint32_t ramSizeShorts = ram_size >> 1;
+  OPCODE_TYPE *cache = getOpcodeCache(tracing);
+  if (tracing)
+    tracingDecodeOpcode = decode;
+  else
+    decodeOpcode = decode;
   // Initialise instruction cache.
   for (unsigned i = 0; i < ramSizeShorts; i++) {
-    opcode[i] = decode;
+    cache[i] = decode;
   }
-  opcode[ramSizeShorts] = illegalPC;
-  opcode[getIllegalPCThreadAddr()] = illegalPCThread;
+  cache[ramSizeShorts] = illegalPC;
+  cache[getIllegalPCThreadAddr()] = illegalPCThread;
   if (syscallAddress < ramSizeShorts)
-    opcode[syscallAddress] = syscall;
+    cache[syscallAddress] = syscall;
   if (exceptionAddress < ramSizeShorts)
-    opcode[exceptionAddress] = exception;
+    cache[exceptionAddress] = exception;
+}
+
+#ifdef TAIL_CALL_DISPATCH
+static bool compareNativeBlocks(const NativeBlock &a, const NativeBlock &b)
+{
+  return a.address < b.address;
+}
+
+static bool compareNativeBlockAddress(uint32_t address, const NativeBlock &b)
+{
+  return address < b.address;
+}
+
+bool Core::setNativeCode(const NativeImage &image)
+{
+  if (image.ramBase != ram_base || image.ramSize != ram_size)
+    return false;
+  uint32_t codeAddress = image.codeAddress - ram_base;
+  if (codeAddress > ram_size || image.codeSize > ram_size - codeAddress)
+    return false;
+  if (nativeCodeChecksum(mem() + codeAddress, image.codeSize) !=
+      image.checksum)
+    return false;
+  nativeBlocks.assign(image.blocks, image.blocks + image.numBlocks);
+  for (std::vector<NativeBlock>::iterator it = nativeBlocks.begin(),
+       e = nativeBlocks.end(); it != e; ++it) {
+    it->address -= ram_base;
+  }
+  std::sort(nativeBlocks.begin(), nativeBlocks.end(), compareNativeBlocks);
+  // Round down so stores to any part of a word are checked.
+  nativeCodeAddress = codeAddress & ~3;
+  nativeCodeSize = image.codeSize + (codeAddress & 3);
+  return true;
+}
+
+void Core::installNativeCode()
+{
+  for (std::vector<NativeBlock>::iterator it = nativeBlocks.begin(),
+       e = nativeBlocks.end(); it != e; ++it) {
+    uint32_t pc = it->address >> 1;
+    uint32_t size = it->size >> 1;
+    // Leave the syscall and exception pseudo instructions in place.
+    if (syscallAddress - pc < size || exceptionAddress - pc < size)
+      continue;
+    opcode[pc] = it->handler;
+  }
+}
+
+void Core::invalidateNativeCode(uint32_t address)
+{
+  // Visit blocks that start at or before the end of the word containing the
+  // address. Blocks are at most MAX_NATIVE_BLOCK_SIZE bytes.
+  std::vector<NativeBlock>::iterator it =
+    std::upper_bound(nativeBlocks.begin(), nativeBlocks.end(), address | 3,
+                     compareNativeBlockAddress);
+  while (it != nativeBlocks.begin()) {
+    --it;
+    if (it->address + MAX_NATIVE_BLOCK_SIZE <= address)
+      break;
+    if (address < it->address + it->size)
+      opcode[it->address >> 1] = decodeOpcode;
+  }
 }
+#endif
 
 bool Core::getLocalChanendDest(ResourceID ID, ChanEndpoint *&result)
 {
@@ -170,8 +373,9 @@ ChanEndpoint *Core::getChanendDest(ResourceID ID)
 void Core::updateIDs()
 {
   unsigned coreID = getCoreID();
-  for (unsigned i = 0; i < NUM_CHANENDS; i++) {
-    resource[RES_TYPE_CHANEND][i]->setNode(coreID);
+  for (unsigned i = 0; i < resourceNum[RES_TYPE_CHANEND]; i++) {
+    if (Resource *res = resource[RES_TYPE_CHANEND][i])
+      res->setNode(coreID);
   }    
 }
 
@@ -24,11 +24,17 @@
 #include "Instruction.h"
 #include "Trace.h"
 #include "RunnableQueue.h"
+#include "HugePages.h"
+#include "NativeCode.h"
+#include <map>
 #include <string>
+#include <vector>
 
 #define ARRAY_SIZE(x) (sizeof(x)/sizeof(x[0]))
 
 class Node;
+class SpinLoop;
+struct PCProfile;
 
 class Core {
 public:
@@ -36,23 +42,42 @@ public:
     ILLEGAL_PC_THREAD_ADDR_OFFSET = 2,
   };
 private:
-  Thread * const thread;
-  Synchroniser * const sync;
-  Lock * const lock;
-  Chanend * const chanend;
-  Timer * const timer;
-  ClockBlock * const clkBlk;
-  Port ** const port;
-  unsigned *portNum;
-  Resource ***resource;
-  unsigned *resourceNum;
+  /// Ports indexed by width and number. Ports are created on first use.
+  Port **port[33];
+  unsigned portNum[33];
+  /// Resources indexed by type and number. Resources other than ports are
+  /// created on first use. They are allocated individually rather than from
+  /// a per core pool since a program typically touches a few resources of
+  /// each type and the unused tail of a pool block would outweigh the saving
+  /// in allocator overhead.
+  Resource **resource[LAST_STD_RES_TYPE + 1];
+  unsigned resourceNum[LAST_STD_RES_TYPE + 1];
   static bool allocatable[LAST_STD_RES_TYPE + 1];
   uint32_t * const memory;
   unsigned coreNumber;
   Node *parent;
   std::string codeReference;
+  /// Timer polling loops found when decoding, indexed by the pc of the
+  /// backward branch that closes the loop.
+  std::map<uint32_t,SpinLoop*> spinLoops;
+  /// The value marking an instruction as needing decode in each cache. Before
+  /// a cache is initialised this is the value the cache is cleared to.
+  OPCODE_TYPE decodeOpcode;
+  OPCODE_TYPE tracingDecodeOpcode;
+#ifdef TAIL_CALL_DISPATCH
+  /// Translated blocks sorted by physical address.
+  std::vector<NativeBlock> nativeBlocks;
+  uint32_t nativeCodeAddress;
+  uint32_t nativeCodeSize;
+#endif
 
   bool hasMatchingNodeID(ResourceID ID);
+  /// Fill an opcode cache with the value that causes it to be initialised on
+  /// first use.
+  void clearCache(OPCODE_TYPE *cache);
+  void allocTracingCacheSlowPath();
+  Resource *createResource(ResourceType type, unsigned num);
+  Port *createPort(unsigned width, unsigned num);
 public:
   // The opcode cache is bigger than the memory size. We place an ILLEGAL_PC
   // pseudo instruction just past the end of memory. This saves
@@ -61,6 +86,15 @@ public:
   // are use for communicating illegal states.
   OPCODE_TYPE *opcode;
   Operands *operands;
+  /// Caches used by dispatch loops that trace. Instructions are decoded
+  /// differently when tracing so traced and untraced threads on the same core
+  /// need separate caches. Allocated on first use.
+  OPCODE_TYPE *tracingOpcode;
+  Operands *tracingOperands;
+  /// Execution counts indexed by pc, or null if the exact profiler is off.
+  PCProfile *pcProfile;
+  /// Number of instructions decoded into the opcode caches.
+  uint64_t decodeCount;
 
   const uint32_t ram_size;
   const uint32_t ram_base;
@@ -69,125 +103,121 @@ public:
   uint32_t syscallAddress;
   uint32_t exceptionAddress;
 
-  Core(uint32_t RamSize, uint32_t RamBase) :
-    thread(new Thread[NUM_THREADS]),
-    sync(new Synchroniser[NUM_SYNCS]),
-    lock(new Lock[NUM_LOCKS]),
-    chanend(new Chanend[NUM_CHANENDS]),
-    timer(new Timer[NUM_TIMERS]),
-    clkBlk(new ClockBlock[NUM_CLKBLKS]),
-    port(new Port*[33]),
-    portNum(new unsigned[33]),
-    resource(new Resource**[LAST_STD_RES_TYPE + 1]),
-    resourceNum(new unsigned[LAST_STD_RES_TYPE + 1]),
-    memory(new uint32_t[RamSize >> 2]),
+  Core(uint32_t RamSize, uint32_t RamBase, const CoreParams &params) :
+    memory(HugePageAllocator::get().allocArray<uint32_t>(RamSize >> 2)),
     coreNumber(0),
     parent(0),
-    opcode(new OPCODE_TYPE[(RamSize >> 1) + ILLEGAL_PC_THREAD_ADDR_OFFSET]),
-    operands(new Operands[RamSize >> 1]),
+    opcode(HugePageAllocator::get().allocArray<OPCODE_TYPE>(
+             (RamSize >> 1) + ILLEGAL_PC_THREAD_ADDR_OFFSET)),
+    operands(HugePageAllocator::get().allocArray<Operands>(RamSize >> 1)),
+    tracingOpcode(0),
+    tracingOperands(0),
+    pcProfile(0),
+    decodeCount(0),
     ram_size(RamSize),
     ram_base(RamBase),
     syscallAddress(~0),
     exceptionAddress(~0)
   {
-    resource[RES_TYPE_PORT] = 0;
-    resourceNum[RES_TYPE_PORT] = 0;
-
-    resource[RES_TYPE_TIMER] = new Resource*[NUM_TIMERS];
-    for (unsigned i = 0; i < NUM_TIMERS; i++) {
-      resource[RES_TYPE_TIMER][i] = &timer[i];
-    }
-    resourceNum[RES_TYPE_TIMER] = NUM_TIMERS;
-
-    resource[RES_TYPE_CHANEND] = new Resource*[NUM_CHANENDS];
-    for (unsigned i = 0; i < NUM_CHANENDS; i++) {
-      resource[RES_TYPE_CHANEND][i] = &chanend[i];
-    }
-    resourceNum[RES_TYPE_CHANEND] = NUM_CHANENDS;
-
-    resource[RES_TYPE_SYNC] = new Resource*[NUM_SYNCS];
-    for (unsigned i = 0; i < NUM_SYNCS; i++) {
-      resource[RES_TYPE_SYNC][i] = &sync[i];
-    }
-    resourceNum[RES_TYPE_SYNC] = NUM_SYNCS;
-
-    resource[RES_TYPE_THREAD] = new Resource*[NUM_THREADS];
-    for (unsigned i = 0; i < NUM_THREADS; i++) {
-      thread[i].setParent(*this);
-      resource[RES_TYPE_THREAD][i] = &thread[i];
-    }
-    resourceNum[RES_TYPE_THREAD] = NUM_THREADS;
-    
-    resource[RES_TYPE_LOCK] = new Resource*[NUM_LOCKS];
-    for (unsigned i = 0; i < NUM_LOCKS; i++) {
-      resource[RES_TYPE_LOCK][i] = &lock[i];
-    }
-    resourceNum[RES_TYPE_LOCK] = NUM_LOCKS;
-
-    resource[RES_TYPE_CLKBLK] = new Resource*[NUM_CLKBLKS];
-    for (unsigned i = 0; i < RES_TYPE_CLKBLK; i++) {
-      resource[RES_TYPE_CLKBLK][i] = &clkBlk[i];
-    }
-    resourceNum[RES_TYPE_CLKBLK] = NUM_CLKBLKS;
-
-    for (int i = RES_TYPE_TIMER; i <= LAST_STD_RES_TYPE; i++) {
-      for (unsigned j = 0; j < resourceNum[i]; j++) {
-        resource[i][j]->setNum(j);
-      }
+#ifdef TAIL_CALL_DISPATCH
+    nativeCodeAddress = 0;
+    nativeCodeSize = 0;
+#endif
+    const unsigned resourceSpec[][2] = {
+      {RES_TYPE_PORT, 0},
+      {RES_TYPE_TIMER, params.numTimers},
+      {RES_TYPE_CHANEND, params.numChanends},
+      {RES_TYPE_SYNC, params.numSyncs},
+      {RES_TYPE_THREAD, params.numThreads},
+      {RES_TYPE_LOCK, params.numLocks},
+      {RES_TYPE_CLKBLK, params.numClkBlks},
+    };
+    for (unsigned i = 0; i < ARRAY_SIZE(resourceSpec); i++) {
+      unsigned type = resourceSpec[i][0];
+      unsigned num = resourceSpec[i][1];
+      resource[type] = num ? new Resource*[num]() : 0;
+      resourceNum[type] = num;
     }
 
-    std::memset(port, 0, sizeof(port[0]) * 33);
-    std::memset(portNum, 0, sizeof(portNum[0]) * 33);
+    std::memset(port, 0, sizeof(port));
+    std::memset(portNum, 0, sizeof(portNum));
     const unsigned portSpec[][2] = {
-      {1, NUM_1BIT_PORTS},
-      {4, NUM_4BIT_PORTS},
-      {8, NUM_8BIT_PORTS},
-      {16, NUM_16BIT_PORTS},
-      {32, NUM_32BIT_PORTS},
+      {1, params.num1BitPorts},
+      {4, params.num4BitPorts},
+      {8, params.num8BitPorts},
+      {16, params.num16BitPorts},
+      {32, params.num32BitPorts},
     };
     for (unsigned i = 0; i < ARRAY_SIZE(portSpec); i++) {
       unsigned width = portSpec[i][0];
       unsigned num = portSpec[i][1];
-      port[width] = new Port[num];
-      for (unsigned j = 0; j < num; j++) {
-        port[width][j].setNum(j);
-        port[width][j].setWidth(width);
-        port[width][j].setClkInitial(&clkBlk[0]);
-      }
+      port[width] = new Port*[num]();
       portNum[width] = num;
     }
-    thread[0].alloc(0);
+    getThread(0).alloc(0);
 
     // Initialise instruction cache.
-    for (unsigned i = 0; i < (RamSize >> 1) + ILLEGAL_PC_THREAD_ADDR_OFFSET;
-         ++i) {
-#ifdef DIRECT_THREADED
-      opcode[i] = 0;
-#else
-      opcode[i] = INITIALIZE;
-#endif
-    }
+    clearCache(opcode);
+    decodeOpcode = opcode[0];
+    tracingDecodeOpcode = opcode[0];
   }
 
   bool setSyscallAddress(uint32_t value);
   bool setExceptionAddress(uint32_t value);
 
-  void initCache(OPCODE_TYPE decode, OPCODE_TYPE illegalPC,
+  void initCache(bool tracing, OPCODE_TYPE decode, OPCODE_TYPE illegalPC,
                  OPCODE_TYPE illegalPCThread, OPCODE_TYPE syscall,
                  OPCODE_TYPE exception);
 
-  ~Core() {
-    delete[] opcode;
-    delete[] operands;
-    //delete[] thread;
-    //delete[] sync;
-    //delete[] lock;
-    //delete[] chanend;
-    //delete[] timer;
-    //delete[] resource;
-    //delete[] resourceNum;
-    delete[] memory;
+  /// Allocate the tracing caches if they haven't been allocated already.
+  void allocTracingCache()
+  {
+    if (!tracingOpcode)
+      allocTracingCacheSlowPath();
+  }
+  OPCODE_TYPE *getOpcodeCache(bool tracing)
+  {
+    return tracing ? tracingOpcode : opcode;
+  }
+  Operands *getOperandsCache(bool tracing)
+  {
+    return tracing ? tracingOperands : operands;
+  }
+  /// Mark the instruction at the specified index as needing decode in the
+  /// cache that is not used by the caller.
+  void invalidateOtherCache(bool tracing, uint32_t index)
+  {
+    if (tracing)
+      opcode[index] = decodeOpcode;
+    else if (tracingOpcode)
+      tracingOpcode[index] = tracingDecodeOpcode;
+  }
+
+  ~Core();
+
+  SpinLoop *getSpinLoop(uint32_t pc) const
+  {
+    std::map<uint32_t,SpinLoop*>::const_iterator it = spinLoops.find(pc);
+    return it == spinLoops.end() ? 0 : it->second;
+  }
+  /// Set the spin loop closed by the branch at the specified pc, replacing any
+  /// existing loop. The loop may be null.
+  void setSpinLoop(uint32_t pc, SpinLoop *loop);
+
+#ifdef TAIL_CALL_DISPATCH
+  /// Use the translated blocks in the image. Returns false if the image was
+  /// translated for a different memory layout or different code.
+  bool setNativeCode(const NativeImage &image);
+  /// Point the opcode cache at the translated blocks. Must be called after
+  /// the cache is initialised.
+  void installNativeCode();
+  bool isNativeCode(uint32_t address) const {
+    return address - nativeCodeAddress < nativeCodeSize;
   }
+  /// Fall back to the interpreter for translated blocks containing the
+  /// specified physical address.
+  void invalidateNativeCode(uint32_t address);
+#endif
   
   uint32_t targetPc(unsigned pc) const
   {
@@ -261,16 +291,26 @@ public:
     mem()[address] = value;
   }
   
+  /// Returns the specified resource, creating it if this is the first use.
+  Resource *getResource(ResourceType type, unsigned num)
+  {
+    Resource *res = resource[type][num];
+    if (!res)
+      res = createResource(type, num);
+    return res;
+  }
+
   Resource *allocResource(Thread &current, ResourceType type)
   {
     if (type > LAST_STD_RES_TYPE || !allocatable[type])
       return 0;
     for (unsigned i = 0; i < resourceNum[type]; i++) {
-      if (!resource[type][i]->isInUse()) {
-        bool allocated = resource[type][i]->alloc(current);
+      Resource *res = getResource(type, i);
+      if (!res->isInUse()) {
+        bool allocated = res->alloc(current);
         assert(allocated);
         (void)allocated; // Silence compiler.
-        return resource[type][i];
+        return res;
       }
     }
     return 0;
@@ -281,12 +321,16 @@ public:
     return static_cast<Thread*>(allocResource(current, RES_TYPE_THREAD));
   }
 
-  const Port *getPortByID(ResourceID ID) const;
+  Port *getPortByID(ResourceID ID);
+  /// Returns the port with the specified ID, bypassing the mapping of
+  /// unconnected ports onto host I/O. Returns NULL if the ID is not a valid
+  /// port ID. The port is created if this is its first use.
+  Port *getPhysicalPort(ResourceID ID);
 
   /// Returns the resource associated with the resource ID or NULL if the
-  /// the resource ID is invalid.
+  /// the resource ID is invalid. The resource is created if this is its first
+  /// use.
   Resource *getResourceByID(ResourceID ID);
-  const Resource *getResourceByID(ResourceID ID) const;
 
   bool getLocalChanendDest(ResourceID ID, ChanEndpoint *&result);
   ChanEndpoint *getChanendDest(ResourceID ID);
@@ -309,8 +353,14 @@ public:
   const Node *getParent() const { return parent; }
   Node *getParent() { return parent; }
   void dumpPaused() const;
-  Thread &getThread(unsigned num) { return thread[num]; }
-  const Thread &getThread(unsigned num) const { return thread[num]; }
+  unsigned getNumThreads() const { return resourceNum[RES_TYPE_THREAD]; }
+  Thread &getThread(unsigned num) {
+    return *static_cast<Thread*>(getResource(RES_TYPE_THREAD, num));
+  }
+  /// Returns the specified thread or NULL if it has never been used.
+  const Thread *findThread(unsigned num) const {
+    return static_cast<const Thread*>(resource[RES_TYPE_THREAD][num]);
+  }
   void setCodeReference(const std::string &value) { codeReference = value; }
   const std::string &getCodeReference() const { return codeReference; }
   std::string getCoreName() const;
@@ -345,7 +395,9 @@ public:
       return !(*this == other);
     }
     Port *operator*() {
-      return &core->port[width][num];
+      if (Port *p = core->port[width][num])
+        return p;
+      return core->createPort(width, num);
     }
   };
   port_iterator port_begin() { return port_iterator(this, 1, 0); }
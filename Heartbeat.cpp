@@ -0,0 +1,243 @@
+// Copyright (c) 2012, Richard Osborne, All rights reserved
+// This software is freely distributable under a derivative of the
+// University of Illinois/NCSA Open Source License posted in
+// LICENSE.txt and at <http://github.xcore.com/>
+
+#include "Heartbeat.h"
+#include "HostTime.h"
+#include "SystemState.h"
+#include "Node.h"
+#include "Core.h"
+#include <iostream>
+#include <sstream>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#ifndef _WIN32
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
+
+Heartbeat::Heartbeat(SystemState &s) :
+  sys(s),
+  fd(-1),
+  isSocket(false),
+  interval(0),
+  lastWall(0),
+  lastCount(0)
+{
+#ifndef _WIN32
+  stopping = false;
+  threadStarted = false;
+  pthread_mutex_init(&mutex, 0);
+  pthread_cond_init(&cond, 0);
+#endif
+}
+
+Heartbeat::~Heartbeat()
+{
+#ifndef _WIN32
+  if (threadStarted) {
+    pthread_mutex_lock(&mutex);
+    stopping = true;
+    pthread_cond_broadcast(&cond);
+    pthread_mutex_unlock(&mutex);
+    pthread_join(thread, 0);
+  }
+  pthread_cond_destroy(&cond);
+  pthread_mutex_destroy(&mutex);
+  if (fd >= 0)
+    close(fd);
+#endif
+}
+
+bool Heartbeat::open(const std::string &dest)
+{
+#ifndef _WIN32
+  const std::string prefix("unix:");
+  if (dest.compare(0, prefix.size(), prefix) == 0) {
+    std::string path = dest.substr(prefix.size());
+    struct sockaddr_un addr;
+    if (path.size() >= sizeof(addr.sun_path)) {
+      std::cerr << "Error: socket path \"" << path << "\" is too long"
+                << std::endl;
+      return false;
+    }
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    std::strcpy(addr.sun_path, path.c_str());
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+      std::cerr << "Error connecting to \"" << path << "\": "
+                << std::strerror(errno) << std::endl;
+      return false;
+    }
+    isSocket = true;
+    return true;
+  }
+  fd = ::open(dest.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    std::cerr << "Error opening \"" << dest << "\": " << std::strerror(errno)
+              << std::endl;
+    return false;
+  }
+  return true;
+#else
+  std::cerr << "Error: heartbeat is not supported on this platform"
+            << std::endl;
+  return false;
+#endif
+}
+
+#ifndef _WIN32
+void *Heartbeat::threadEntry(void *arg)
+{
+  static_cast<Heartbeat*>(arg)->run();
+  return 0;
+}
+
+void Heartbeat::run()
+{
+  pthread_mutex_lock(&mutex);
+  while (!stopping) {
+    struct timeval now;
+    gettimeofday(&now, 0);
+    long long usec = now.tv_usec + (long long)(interval * 1000000);
+    struct timespec timeout;
+    timeout.tv_sec = now.tv_sec + usec / 1000000;
+    timeout.tv_nsec = (usec % 1000000) * 1000;
+    if (pthread_cond_timedwait(&cond, &mutex, &timeout) == ETIMEDOUT &&
+        !stopping) {
+      sys.requestHeartbeat();
+    }
+  }
+  pthread_mutex_unlock(&mutex);
+}
+#endif
+
+bool Heartbeat::start(double seconds)
+{
+#ifndef _WIN32
+  interval = seconds;
+  lastWall = HostTime::now().wall;
+  threadStarted = pthread_create(&thread, 0, threadEntry, this) == 0;
+  if (threadStarted)
+    sys.setHeartbeat(this);
+  return threadStarted;
+#else
+  return false;
+#endif
+}
+
+void Heartbeat::writeString(const std::string &s)
+{
+#ifndef _WIN32
+  if (fd < 0)
+    return;
+  const char *p = s.data();
+  size_t left = s.size();
+  while (left) {
+    ssize_t written;
+    if (isSocket) {
+#ifdef MSG_NOSIGNAL
+      written = send(fd, p, left, MSG_NOSIGNAL);
+#else
+      written = send(fd, p, left, 0);
+#endif
+    } else {
+      written = ::write(fd, p, left);
+    }
+    if (written < 0) {
+      if (errno == EINTR)
+        continue;
+      // Stop reporting if the reader has gone away.
+      close(fd);
+      fd = -1;
+      return;
+    }
+    p += written;
+    left -= written;
+  }
+#endif
+}
+
+static const char *getStallReasonKey(unsigned reason)
+{
+  static const char *keys[Thread::NUM_STALL_REASONS] = {
+    "chanend_in",
+    "chanend_out",
+    "port",
+    "timer",
+    "lock",
+    "sync",
+    "event",
+    "other"
+  };
+  return keys[reason];
+}
+
+void Heartbeat::write(ticks_t time)
+{
+  unsigned blocked[Thread::NUM_STALL_REASONS] = { 0 };
+  unsigned numBlocked = 0;
+  unsigned numRunning = 0;
+  uint64_t totalCount = 0;
+  std::ostringstream cores;
+  bool firstCore = true;
+  for (SystemState::node_iterator outerIt = sys.node_begin(),
+       outerE = sys.node_end(); outerIt != outerE; ++outerIt) {
+    Node &node = **outerIt;
+    for (Node::core_iterator innerIt = node.core_begin(),
+         innerE = node.core_end(); innerIt != innerE; ++innerIt) {
+      Core &core = **innerIt;
+      uint64_t coreCount = 0;
+      ticks_t coreTime = 0;
+      for (unsigned i = 0, e = core.getNumThreads(); i != e; ++i) {
+        // Don't create threads which have never been used.
+        const Thread *thread = core.findThread(i);
+        if (!thread)
+          continue;
+        const Thread &t = *thread;
+        coreCount += t.count;
+        coreTime = std::max(coreTime, t.time);
+        if (!t.isInUse())
+          continue;
+        if (t.waiting()) {
+          blocked[t.stallReason]++;
+          numBlocked++;
+        } else {
+          numRunning++;
+        }
+      }
+      totalCount += coreCount;
+      cores << (firstCore ? "" : ", ") << "{\"name\": \""
+            << core.getCoreName() << "\", \"instructions\": " << coreCount
+            << ", \"time\": " << coreTime << "}";
+      firstCore = false;
+    }
+  }
+  double now = HostTime::now().wall;
+  double elapsed = now - lastWall;
+  double mips = elapsed > 0 ? (totalCount - lastCount) / elapsed / 1000000.0
+                            : 0;
+  lastWall = now;
+  lastCount = totalCount;
+
+  std::ostringstream buf;
+  buf << "{\"time\": " << time
+      << ", \"instructions\": " << totalCount
+      << ", \"mips\": " << mips
+      << ", \"queue_depth\": " << sys.getScheduler().size()
+      << ", \"running_threads\": " << numRunning
+      << ", \"blocked_threads\": " << numBlocked
+      << ", \"blocked\": {";
+  for (unsigned i = 0; i < Thread::NUM_STALL_REASONS; i++) {
+    buf << (i ? ", " : "") << '"' << getStallReasonKey(i) << "\": "
+        << blocked[i];
+  }
+  buf << "}, \"cores\": [" << cores.str() << "]}\n";
+  writeString(buf.str());
+}
@@ -0,0 +1,58 @@
+// Copyright (c) 2012, Richard Osborne, All rights reserved
+// This software is freely distributable under a derivative of the
+// University of Illinois/NCSA Open Source License posted in
+// LICENSE.txt and at <http://github.xcore.com/>
+
+#ifndef _Heartbeat_h_
+#define _Heartbeat_h_
+
+#include "Config.h"
+#include <string>
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+class SystemState;
+
+/// Periodically reports the progress of the simulation to a file or a Unix
+/// domain socket. A background thread asks the system for a report every
+/// interval. The system writes the report the next time it takes a runnable
+/// from the scheduler, so the simulation state is only read by the thread
+/// that runs the simulation. Each report is a line of JSON.
+class Heartbeat {
+  SystemState &sys;
+  int fd;
+  bool isSocket;
+  double interval;
+  double lastWall;
+  uint64_t lastCount;
+#ifndef _WIN32
+  volatile bool stopping;
+  bool threadStarted;
+  pthread_t thread;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+
+  static void *threadEntry(void *arg);
+  void run();
+#endif
+
+  Heartbeat(const Heartbeat &); // Not implemented.
+  void operator=(const Heartbeat &); // Not implemented.
+
+  void writeString(const std::string &s);
+public:
+  Heartbeat(SystemState &s);
+  ~Heartbeat();
+  /// Open the destination. Destinations of the form unix:path are connected
+  /// to as a Unix domain socket, anything else is opened as a file. Returns
+  /// false on failure.
+  bool open(const std::string &dest);
+  /// Start requesting a report every interval seconds. Returns false if
+  /// this isn't supported on the host.
+  bool start(double seconds);
+  /// Write a report. The time is the current simulated time.
+  void write(ticks_t time);
+};
+
+#endif // _Heartbeat_h_
@@ -0,0 +1,215 @@
+// Copyright (c) 2012, Richard Osborne, All rights reserved
+// This software is freely distributable under a derivative of the
+// University of Illinois/NCSA Open Source License posted in
+// LICENSE.txt and at <http://github.xcore.com/>
+
+#include "HostPort.h"
+#include "SystemState.h"
+#include <algorithm>
+#include <cstring>
+#ifndef _MSC_VER
+#include <unistd.h>
+#else
+#include <io.h>
+#define read _read
+#define write _write
+#define fileno _fileno
+#endif
+#ifndef _WIN32
+#include <poll.h>
+#endif
+
+const size_t bufferSize = 1 << 20;
+
+/// Returns whether a read from the file descriptor won't block.
+static bool canReadWithoutBlocking(int fd)
+{
+#ifdef _WIN32
+  return true;
+#else
+  struct pollfd p;
+  p.fd = fd;
+  p.events = POLLIN;
+  p.revents = 0;
+  return poll(&p, 1, 0) > 0;
+#endif
+}
+
+static void writeAll(int fd, const unsigned char *p, size_t size)
+{
+  while (size != 0) {
+    int written = write(fd, p, size);
+    if (written <= 0)
+      return;
+    p += written;
+    size -= written;
+  }
+}
+
+HostPort::HostPort(Port &p, std::FILE *f, ticks_t samplePeriod) :
+  port(p),
+  file(f),
+  period(samplePeriod),
+  bytesPerSample((p.getPortWidth() + 7) / 8),
+  buffer(bufferSize),
+  pos(0),
+  size(0)
+{
+}
+
+HostPort::~HostPort()
+{
+  if (file != stdin && file != stdout)
+    std::fclose(file);
+}
+
+ticks_t HostPort::getPeriod(uint64_t rate)
+{
+  const uint64_t ticksPerSecond = uint64_t(100000000) * CYCLES_PER_TICK;
+  if (rate == 0)
+    return 0;
+  return std::max(ticksPerSecond / rate, uint64_t(1));
+}
+
+std::FILE *HostPort::open(const std::string &filename, bool input)
+{
+  if (filename == "-")
+    return input ? stdin : stdout;
+  return std::fopen(filename.c_str(), input ? "rb" : "wb");
+}
+
+HostPortInput::
+HostPortInput(SystemState &sys, Port &p, std::FILE *f, ticks_t samplePeriod) :
+  HostPort(p, f, samplePeriod),
+  system(sys),
+  value(0),
+  pending(0),
+  hasPending(false),
+  nextTime(0),
+  eof(false)
+{
+}
+
+bool HostPortInput::readSample(uint32_t &sample, bool wait)
+{
+  if (size - pos < bytesPerSample) {
+    // Move any partial sample to the start of the buffer.
+    size_t remaining = size - pos;
+    std::memmove(&buffer[0], &buffer[pos], remaining);
+    pos = 0;
+    size = remaining;
+    // Take whatever has arrived rather than waiting for the buffer to fill.
+    int fd = fileno(file);
+    while (size < bytesPerSample && !eof) {
+      if (!canReadWithoutBlocking(fd)) {
+        if (!wait)
+          return false;
+        HostPortOutput::flushAll();
+      }
+      int count = read(fd, &buffer[size], buffer.size() - size);
+      if (count <= 0)
+        eof = true;
+      else
+        size += count;
+    }
+    if (size < bytesPerSample)
+      return false;
+  }
+  sample = 0;
+  for (unsigned i = 0; i < bytesPerSample; i++)
+    sample |= uint32_t(buffer[pos++]) << (8 * i);
+  sample &= port.portWidthMask();
+  return true;
+}
+
+void HostPortInput::scheduleNextChange()
+{
+  uint32_t sample;
+  while (readSample(sample, false)) {
+    ticks_t time = nextTime;
+    nextTime += period;
+    if (sample != value) {
+      pending = sample;
+      hasPending = true;
+      system.scheduleOther(*this, time);
+      return;
+    }
+  }
+  hasPending = false;
+  if (!eof)
+    system.scheduleOther(*this, nextTime);
+}
+
+void HostPortInput::start()
+{
+  scheduleNextChange();
+}
+
+void HostPortInput::run(ticks_t time)
+{
+  if (!hasPending) {
+    // The sample for this time is needed so wait for it to arrive.
+    uint32_t sample;
+    if (!readSample(sample, true))
+      return;
+    nextTime += period;
+    if (sample == value) {
+      scheduleNextChange();
+      return;
+    }
+    pending = sample;
+  }
+  value = pending;
+  port.seePinsChange(Signal(value), time);
+  scheduleNextChange();
+}
+
+std::vector<HostPortOutput*> HostPortOutput::outputs;
+
+HostPortOutput::HostPortOutput(Port &p, std::FILE *f, ticks_t samplePeriod) :
+  HostPort(p, f, samplePeriod),
+  nextTime(0)
+{
+  outputs.push_back(this);
+}
+
+HostPortOutput::~HostPortOutput()
+{
+  // Finish with a sample of the final value.
+  if (period != 0)
+    writeSample(value.getValue(nextTime));
+  flush();
+  outputs.erase(std::find(outputs.begin(), outputs.end(), this));
+}
+
+void HostPortOutput::flush()
+{
+  writeAll(fileno(file), &buffer[0], pos);
+  pos = 0;
+}
+
+void HostPortOutput::flushAll()
+{
+  for (unsigned i = 0; i < outputs.size(); i++)
+    outputs[i]->flush();
+}
+
+void HostPortOutput::writeSample(uint32_t sample)
+{
+  if (buffer.size() - pos < bytesPerSample)
+    flush();
+  for (unsigned i = 0; i < bytesPerSample; i++)
+    buffer[pos++] = sample >> (8 * i);
+}
+
+void HostPortOutput::drive(Signal newValue, ticks_t time)
+{
+  if (period == 0) {
+    writeSample(newValue.getValue(time));
+    value = newValue;
+    return;
+  }
+  for (; nextTime < time; nextTime += period)
+    writeSample(value.getValue(nextTime));
+  value = newValue;
+}
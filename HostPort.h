@@ -0,0 +1,95 @@
+// Copyright (c) 2012, Richard Osborne, All rights reserved
+// This software is freely distributable under a derivative of the
+// University of Illinois/NCSA Open Source License posted in
+// LICENSE.txt and at <http://github.xcore.com/>
+
+#ifndef _HostPort_h_
+#define _HostPort_h_
+
+#include "Port.h"
+#include "Runnable.h"
+#include <cstdio>
+#include <string>
+#include <vector>
+
+class SystemState;
+
+/// Binds the pins of a port to a file, FIFO or pipe on the host. Samples are
+/// stored in the smallest number of bytes that hold the port width, least
+/// significant byte first. The file is read and written in large blocks, but
+/// the simulation only waits for input when it needs a sample which hasn't
+/// arrived, so a FIFO or pipe can be fed while the simulation runs.
+class HostPort : public PortConnection {
+protected:
+  Port &port;
+  std::FILE *file;
+  /// Time between samples, or 0 to sample on every change.
+  ticks_t period;
+  unsigned bytesPerSample;
+  std::vector<unsigned char> buffer;
+  /// Position of the next byte in the buffer.
+  size_t pos;
+  /// Number of valid bytes in the buffer when reading.
+  size_t size;
+
+  HostPort(Port &p, std::FILE *f, ticks_t samplePeriod);
+public:
+  virtual ~HostPort();
+  /// Returns the time between samples at the specified rate in Hz.
+  static ticks_t getPeriod(uint64_t rate);
+  /// Opens a file for a binding, "-" is stdin or stdout. Returns 0 on
+  /// failure.
+  static std::FILE *open(const std::string &filename, bool input);
+};
+
+/// Reads a sample every period and drives it onto the pins of the port. The
+/// pins keep their last value at the end of the file.
+class HostPortInput : public HostPort, public Runnable {
+  SystemState &system;
+  /// Value on the pins.
+  uint32_t value;
+  /// Value to drive on the pins when the input next runs, valid if
+  /// hasPending is set. Otherwise the input runs at the time of the next
+  /// sample, which hasn't been read yet.
+  uint32_t pending;
+  bool hasPending;
+  /// Time of the next sample.
+  ticks_t nextTime;
+  /// Set when the end of the file has been reached.
+  bool eof;
+  /// Read the next sample. If wait is false only bytes which can be read
+  /// without blocking are used and false is returned if the sample hasn't
+  /// arrived yet.
+  bool readSample(uint32_t &sample, bool wait);
+  /// Skip samples which have arrived but don't change the pins and schedule
+  /// the next change, or the next sample if it hasn't arrived.
+  void scheduleNextChange();
+public:
+  HostPortInput(SystemState &sys, Port &p, std::FILE *f, ticks_t samplePeriod);
+  /// Schedule the first sample.
+  void start();
+  /// The input ignores values driven by the port.
+  void drive(Signal, ticks_t) {}
+  void run(ticks_t time);
+};
+
+/// Writes the value on the pins of the port every period, or every time it
+/// changes if the period is 0. A periodic output ends with one sample of the
+/// last value driven.
+class HostPortOutput : public HostPort {
+  Signal value;
+  /// Time of the next sample.
+  ticks_t nextTime;
+  static std::vector<HostPortOutput*> outputs;
+  void writeSample(uint32_t sample);
+  void flush();
+public:
+  HostPortOutput(Port &p, std::FILE *f, ticks_t samplePeriod);
+  ~HostPortOutput();
+  void drive(Signal value, ticks_t time);
+  /// Write the buffered samples of all outputs. Called before waiting for
+  /// input in case whatever produces the input is waiting for the output.
+  static void flushAll();
+};
+
+#endif // _HostPort_h_
@@ -0,0 +1,28 @@
+// Copyright (c) 2012, Richard Osborne, All rights reserved
+// This software is freely distributable under a derivative of the
+// University of Illinois/NCSA Open Source License posted in
+// LICENSE.txt and at <http://github.xcore.com/>
+
+#include "HostTime.h"
+#include <ctime>
+#ifndef _WIN32
+#include <sys/time.h>
+#include <sys/resource.h>
+#endif
+
+HostTime HostTime::now()
+{
+#ifdef _WIN32
+  double cpu = (double)std::clock() / CLOCKS_PER_SEC;
+  return HostTime(cpu, cpu);
+#else
+  struct timeval tv;
+  gettimeofday(&tv, 0);
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  double wall = tv.tv_sec + tv.tv_usec / 1000000.0;
+  double cpu = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1000000.0 +
+               usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1000000.0;
+  return HostTime(wall, cpu);
+#endif
+}
@@ -0,0 +1,32 @@
+// Copyright (c) 2012, Richard Osborne, All rights reserved
+// This software is freely distributable under a derivative of the
+// University of Illinois/NCSA Open Source License posted in
+// LICENSE.txt and at <http://github.xcore.com/>
+
+#ifndef _HostTime_h_
+#define _HostTime_h_
+
+/// Wall clock and CPU time of the host process in seconds.
+struct HostTime {
+  double wall;
+  double cpu;
+
+  HostTime() : wall(0), cpu(0) {}
+  HostTime(double w, double c) : wall(w), cpu(c) {}
+
+  /// Returns the current time.
+  static HostTime now();
+
+  HostTime operator-(const HostTime &other) const
+  {
+    return HostTime(wall - other.wall, cpu - other.cpu);
+  }
+  HostTime &operator+=(const HostTime &other)
+  {
+    wall += other.wall;
+    cpu += other.cpu;
+    return *this;
+  }
+};
+
+#endif // _HostTime_h_
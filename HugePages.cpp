@@ -0,0 +1,147 @@
+// Copyright (c) 2012, Richard Osborne, All rights reserved
+// This software is freely distributable under a derivative of the
+// University of Illinois/NCSA Open Source License posted in
+// LICENSE.txt and at <http://github.xcore.com/>
+
+#include "HugePages.h"
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+
+HugePageAllocator HugePageAllocator::instance;
+
+#ifndef _WIN32
+/// Size of a (non gigantic) huge page. Allocations are rounded up to a
+/// multiple of this and aligned to it so transparent huge pages can be used.
+const std::size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+static std::size_t roundUp(std::size_t size)
+{
+  return (size + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+}
+
+static void *mapAligned(std::size_t size)
+{
+  // Over allocate so the start of the mapping can be aligned.
+  std::size_t mapSize = size + HUGE_PAGE_SIZE;
+  void *p = mmap(0, mapSize, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (p == MAP_FAILED)
+    return 0;
+  uintptr_t start = reinterpret_cast<uintptr_t>(p);
+  uintptr_t aligned = (start + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+  if (aligned != start)
+    munmap(p, aligned - start);
+  std::size_t tail = (start + mapSize) - (aligned + size);
+  if (tail)
+    munmap(reinterpret_cast<void*>(aligned + size), tail);
+  return reinterpret_cast<void*>(aligned);
+}
+#endif
+
+bool HugePageAllocator::parseMode(const char *s, Mode &result)
+{
+  if (std::strcmp(s, "off") == 0) {
+    result = OFF;
+    return true;
+  }
+  if (std::strcmp(s, "transparent") == 0) {
+    result = TRANSPARENT;
+    return true;
+  }
+  if (std::strcmp(s, "explicit") == 0) {
+    result = EXPLICIT;
+    return true;
+  }
+  return false;
+}
+
+static void *allocPlain(std::size_t size)
+{
+  void *p = std::calloc(size, 1);
+  if (!p)
+    throw std::bad_alloc();
+  return p;
+}
+
+void *HugePageAllocator::alloc(std::size_t size)
+{
+#ifdef _WIN32
+  totalBytes += size;
+  return allocPlain(size);
+#else
+  // Leave the layout of memory alone unless huge pages are asked for.
+  if (mode == OFF) {
+    totalBytes += size;
+    return allocPlain(size);
+  }
+  // Count the rounded size so it can be compared with the bytes backed by
+  // huge pages.
+  size = roundUp(size);
+  totalBytes += size;
+#ifdef MAP_HUGETLB
+  if (mode == EXPLICIT) {
+    void *p = mmap(0, size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (p != MAP_FAILED) {
+      explicitBytes += size;
+      return p;
+    }
+    // Fall back to transparent huge pages.
+  }
+#endif
+  void *p = mapAligned(size);
+  if (!p)
+    throw std::bad_alloc();
+#ifdef MADV_HUGEPAGE
+  if (madvise(p, size, MADV_HUGEPAGE) == 0)
+    transparentBytes += size;
+#endif
+  return p;
+#endif
+}
+
+void HugePageAllocator::free(void *p, std::size_t size)
+{
+  if (!p)
+    return;
+#ifdef _WIN32
+  std::free(p);
+#else
+  if (mode == OFF)
+    std::free(p);
+  else
+    munmap(p, roundUp(size));
+#endif
+}
+
+/// Returns the number of bytes of anonymous memory currently backed by
+/// transparent huge pages or 0 if this can't be determined.
+static uint64_t getAnonHugePageBytes()
+{
+  std::ifstream smaps("/proc/self/smaps_rollup");
+  std::string line;
+  while (std::getline(smaps, line)) {
+    if (line.compare(0, 14, "AnonHugePages:") == 0)
+      return std::strtoull(line.c_str() + 14, 0, 10) * 1024;
+  }
+  return 0;
+}
+
+void HugePageAllocator::report() const
+{
+  const uint64_t MB = 1024 * 1024;
+  std::cerr << "Huge pages: " << (totalBytes / MB) << "MB allocated, ";
+  std::cerr << (explicitBytes / MB) << "MB explicit, ";
+  std::cerr << (transparentBytes / MB) << "MB transparent";
+  if (uint64_t anonHuge = getAnonHugePageBytes()) {
+    std::cerr << " (" << (anonHuge / MB) << "MB currently resident)";
+  }
+  std::cerr << std::endl;
+}
@@ -0,0 +1,62 @@
+// Copyright (c) 2012, Richard Osborne, All rights reserved
+// This software is freely distributable under a derivative of the
+// University of Illinois/NCSA Open Source License posted in
+// LICENSE.txt and at <http://github.xcore.com/>
+
+#ifndef _HugePages_h_
+#define _HugePages_h_
+
+#include <cassert>
+#include <cstddef>
+#include <stdint.h>
+
+/// Allocator for the large per core arrays (memory and the decode cache).
+/// Depending on the mode the arrays are backed by explicit huge pages, by
+/// transparent huge pages or by ordinary pages. If huge pages are unavailable
+/// the allocation falls back to ordinary pages.
+class HugePageAllocator {
+public:
+  enum Mode {
+    OFF,
+    TRANSPARENT,
+    EXPLICIT
+  };
+private:
+  Mode mode;
+  uint64_t totalBytes;
+  uint64_t explicitBytes;
+  uint64_t transparentBytes;
+  static HugePageAllocator instance;
+  HugePageAllocator() :
+    mode(OFF),
+    totalBytes(0),
+    explicitBytes(0),
+    transparentBytes(0) {}
+public:
+  static HugePageAllocator &get() { return instance; }
+  /// Set the mode. This must be done before anything is allocated since
+  /// memory is freed according to the mode it was allocated with.
+  void setMode(Mode value) {
+    assert(totalBytes == 0 && "Mode changed after allocation");
+    mode = value;
+  }
+  Mode getMode() const { return mode; }
+  static bool parseMode(const char *s, Mode &result);
+
+  /// Allocate size bytes of zero initialised memory.
+  void *alloc(std::size_t size);
+  void free(void *p, std::size_t size);
+
+  template <typename T> T *allocArray(std::size_t num) {
+    return static_cast<T*>(alloc(num * sizeof(T)));
+  }
+  template <typename T> void freeArray(T *p, std::size_t num) {
+    free(p, num * sizeof(T));
+  }
+
+  /// Print how much of the allocated memory is backed by huge pages to
+  /// stderr, so the report doesn't mix with the output of the program.
+  void report() const;
+};
+
+#endif // _HugePages_h_
@@ -4,7 +4,28 @@
 // LICENSE.txt and at <http://github.xcore.com/>
 
 #include "Instruction.h"
+#include "BitManip.h"
 #include <cassert>
+#include <cstring>
+
+static const char *instructionNames[] = {
+#define EMIT_INSTRUCTION_LIST
+#define DO_INSTRUCTION(inst) #inst,
+#include "InstructionGenOutput.inc"
+#undef EMIT_INSTRUCTION_LIST
+#undef DO_INSTRUCTION
+};
+
+const char *getInstructionName(InstructionOpcode opcode)
+{
+  return instructionNames[opcode];
+}
+
+bool isLongInstruction(InstructionOpcode opcode)
+{
+  const char *format = std::strrchr(instructionNames[opcode], '_');
+  return format && format[1] == 'l';
+}
 
 static inline uint32_t bits(uint32_t value, unsigned shift, unsigned size)
 {
@@ -1383,3 +1404,186 @@ instructionDecode(uint16_t low, uint16_t high, bool highValid, InstructionOpcode
       break;
   }
 }
+
+static inline bool checkPC(uint32_t pc, uint32_t ramSize)
+{
+  return pc < (ramSize << 1);
+}
+
+void
+instructionTransform(InstructionOpcode &opc, Operands &operands, uint32_t pc,
+                     uint32_t ramSize, bool tracing)
+{
+  switch (opc) {
+  default:
+    break;
+  case ADD_2rus:
+    if (operands.ops[2] == 0) {
+      opc = ADD_mov_2rus;
+    }
+    break;
+  case STW_2rus:
+  case LDW_2rus:
+  case LDAWF_l2rus:
+  case LDAWB_l2rus:
+    operands.ops[2] = operands.ops[2] << 2;
+    break;
+  case STWDP_ru6:
+  case STWSP_ru6:
+  case LDWDP_ru6:
+  case LDWSP_ru6:
+  case LDAWDP_ru6:
+  case LDAWSP_ru6:
+  case LDWCP_ru6:
+  case STWDP_lru6:
+  case STWSP_lru6:
+  case LDWDP_lru6:
+  case LDWSP_lru6:
+  case LDAWDP_lru6:
+  case LDAWSP_lru6:
+  case LDWCP_lru6:
+    operands.ops[1] = operands.ops[1] << 2;
+    break;
+  case EXTDP_u6:
+  case ENTSP_u6:
+  case EXTSP_u6:
+  case RETSP_u6:
+  case KENTSP_u6:
+  case KRESTSP_u6:
+  case LDAWCP_u6:
+  case LDWCPL_u10:
+  case EXTDP_lu6:
+  case ENTSP_lu6:
+  case EXTSP_lu6:
+  case RETSP_lu6:
+  case KENTSP_lu6:
+  case KRESTSP_lu6:
+  case LDAWCP_lu6:
+  case LDWCPL_lu10:
+    operands.ops[0] = operands.ops[0] << 2;
+    break;
+  case LDAPB_u10:
+  case LDAPF_u10:
+  case LDAPB_lu10:
+  case LDAPF_lu10:
+    operands.ops[0] = operands.ops[0] << 1;
+    break;
+  case SHL_2rus:
+    if (operands.ops[2] == 32) {
+      opc = SHL_32_2rus;
+    }
+    break;
+  case SHR_2rus:
+    if (operands.ops[2] == 32) {
+      opc = SHR_32_2rus;
+    }
+    break;
+  case ASHR_l2rus:
+    if (operands.ops[2] == 32) {
+      opc = ASHR_32_l2rus;
+    }
+    break;
+  case BRFT_ru6:
+    operands.ops[1] = pc + 1 + operands.ops[1];
+    if (!checkPC(operands.ops[1], ramSize)) {
+      opc = BRFT_illegal_ru6;
+    }
+    break;
+  case BRBT_ru6:
+    operands.ops[1] = pc + 1 - operands.ops[1];
+    if (!checkPC(operands.ops[1], ramSize)) {
+      opc = BRBT_illegal_ru6;
+    }
+    break;
+  case BRFU_u6:
+    operands.ops[0] = pc + 1 + operands.ops[0];
+    if (!checkPC(operands.ops[0], ramSize)) {
+      opc = BRFU_illegal_u6;
+    }
+    break;
+  case BRBU_u6:
+    operands.ops[0] = pc + 1 - operands.ops[0];
+    if (!checkPC(operands.ops[0], ramSize)) {
+      opc = BRBU_illegal_u6;
+    }
+    break;
+  case BRFF_ru6:
+    operands.ops[1] = pc + 1 + operands.ops[1];
+    if (!checkPC(operands.ops[1], ramSize)) {
+      opc = BRFF_illegal_ru6;
+    }
+    break;
+  case BRBF_ru6:
+    operands.ops[1] = pc + 1 - operands.ops[1];
+    if (!checkPC(operands.ops[1], ramSize)) {
+      opc = BRBF_illegal_ru6;
+    }
+    break;
+  case BLRB_u10:
+    operands.ops[0] = pc + 1 - operands.ops[0];
+    if (!checkPC(operands.ops[0], ramSize)) {
+      opc = BLRB_illegal_u10;
+    }
+    break;
+  case BLRF_u10:
+    operands.ops[0] = pc + 1 + operands.ops[0];
+    if (!checkPC(operands.ops[0], ramSize)) {
+      opc = BLRF_illegal_u10;
+    }
+    break;
+  case BRFT_lru6:
+    operands.ops[1] = pc + 2 + operands.ops[1];
+    if (!checkPC(operands.ops[1], ramSize)) {
+      opc = BRFT_illegal_lru6;
+    }
+    break;
+  case BRBT_lru6:
+    operands.ops[1] = pc + 2 - operands.ops[1];
+    if (!checkPC(operands.ops[1], ramSize)) {
+      opc = BRBT_illegal_lru6;
+    }
+    break;
+  case BRFU_lu6:
+    operands.ops[0] = pc + 2 + operands.ops[0];
+    if (!checkPC(operands.ops[0], ramSize)) {
+      opc = BRFU_illegal_lu6;
+    }
+    break;
+  case BRBU_lu6:
+    operands.ops[0] = pc + 2 - operands.ops[0];
+    if (!checkPC(operands.ops[0], ramSize)) {
+      opc = BRBU_illegal_lu6;
+    }
+    break;
+  case BRFF_lru6:
+    operands.ops[1] = pc + 2 + operands.ops[1];
+    if (!checkPC(operands.ops[1], ramSize)) {
+      opc = BRFF_illegal_lru6;
+    }
+    break;
+  case BRBF_lru6:
+    operands.ops[1] = pc + 2 - operands.ops[1];
+    if (!checkPC(operands.ops[1], ramSize)) {
+      opc = BRBF_illegal_lru6;
+    }
+    break;
+  case BLRB_lu10:
+    operands.ops[0] = pc + 2 - operands.ops[0];
+    if (!checkPC(operands.ops[0], ramSize)) {
+      opc = BLRB_illegal_lu10;
+    }
+    break;
+  case BLRF_lu10:
+    operands.ops[0] = pc + 2 + operands.ops[0];
+    if (!checkPC(operands.ops[0], ramSize)) {
+      opc = BLRF_illegal_lu10;
+    }
+    break;
+  case MKMSK_rus:
+    operands.ops[1] = makeMask(operands.ops[1]);
+    if (!tracing) {
+      opc = LDC_ru6;
+    }
+    break;
+  }
+}
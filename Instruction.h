@@ -34,7 +34,10 @@ enum InstructionOpcode {
 #undef DO_INSTRUCTION
 };
 
-#ifdef DIRECT_THREADED
+#if defined(TAIL_CALL_DISPATCH)
+class Thread;
+typedef void (*OPCODE_TYPE)(Thread &thread, uint32_t pc);
+#elif defined(DIRECT_THREADED)
 typedef ptrdiff_t OPCODE_TYPE;
 #else
 typedef InstructionOpcode OPCODE_TYPE;
@@ -51,4 +54,17 @@ void
 instructionDecode(uint16_t low, uint16_t high, bool highValid,
                   InstructionOpcode &opcode, Operands &operands);
 
+/// Rewrite a decoded instruction into the form expected by the interpreter.
+/// Immediates are scaled, relative branch targets are converted to absolute
+/// pcs and some instructions are replaced by more specialised versions.
+void
+instructionTransform(InstructionOpcode &opcode, Operands &operands,
+                     uint32_t pc, uint32_t ramSize, bool tracing);
+
+/// Returns the name of the instruction, for example "ADD_3r".
+const char *getInstructionName(InstructionOpcode opcode);
+
+/// Returns whether the instruction is 32 bits long.
+bool isLongInstruction(InstructionOpcode opcode);
+
 #endif //_Instruction_h_
@@ -155,6 +155,7 @@ private:
   std::string transformStr;
   std::string reverseTransformStr;
   std::string cyclesStr;
+  std::string profileHookStr;
   bool sync;
   bool canEvent;
   bool unimplemented;
@@ -185,6 +186,7 @@ public:
   const std::string &getTransform() const { return transformStr; }
   const std::string &getReverseTransform() const { return reverseTransformStr; }
   const std::string &getCycles() const { return cyclesStr; }
+  const std::string &getProfileHook() const { return profileHookStr; }
   bool getSync() const { return sync; }
   bool getCanEvent() const { return canEvent; }
   bool getUnimplemented() const { return unimplemented; }
@@ -204,6 +206,12 @@ public:
     cyclesStr = s;
     return *this;
   }
+  /// Code run by the profiling dispatch loops after the instruction
+  /// completes, used to maintain the call graph profiler's call stack.
+  Instruction &setProfileHook(const std::string &s) {
+    profileHookStr = s;
+    return *this;
+  }
   Instruction &setSync() {
     sync = true;
     return *this;
@@ -229,6 +237,7 @@ public:
   InstructionRefs &addImplicitOp(Register reg, OpType type);
   InstructionRefs &transform(const std::string &t, const std::string &rt);
   InstructionRefs &setCycles(const std::string &s);
+  InstructionRefs &setProfileHook(const std::string &s);
   InstructionRefs &setSync();
   InstructionRefs &setCanEvent();
   InstructionRefs &setUnimplemented();
@@ -264,6 +273,16 @@ setCycles(const std::string &s)
   return *this;
 }
 
+InstructionRefs &InstructionRefs::
+setProfileHook(const std::string &s)
+{
+  for (std::vector<Instruction*>::iterator it = refs.begin(), e = refs.end();
+       it != e; ++it) {
+    (*it)->setProfileHook(s);
+  }
+  return *this;
+}
+
 InstructionRefs &InstructionRefs::
 setSync()
 {
@@ -423,11 +442,32 @@ emitCount()
 static void emitStats(const Instruction &instruction)
 {
   const std::string &name = instruction.getName();
-  std::cout << "if (Stats::get().getEnabled()) {\n";
+  std::cout << "if (stats) {\n";
   std::cout << "  STATS(\"" << name << "\");\n";
   std::cout << "}\n";
 }
 
+static void emitProfile()
+{
+  std::cout << "if (profiling) {\n";
+  std::cout << "  PROFILE();\n";
+  std::cout << "}\n";
+}
+
+static void
+emitCode(const Instruction &instruction,
+         const std::string &code);
+
+static void emitProfileHook(const Instruction &instruction)
+{
+  const std::string &hook = instruction.getProfileHook();
+  if (hook.empty())
+    return;
+  std::cout << "if (profiling) {\n  ";
+  emitCode(instruction, hook);
+  std::cout << "\n}\n";
+}
+
 static void
 emitRegWriteBack(const Instruction &instruction)
 {
@@ -537,6 +577,7 @@ emitCode(const Instruction &instruction,
         emitCycles(instruction);
         emitCount();
         emitStats(instruction);
+        emitProfile();
         emitTraceEnd();
         std::cout << "EXCEPTION(";
         const char *close = scanClosingBracket(&s[i]);
@@ -551,6 +592,7 @@ emitCode(const Instruction &instruction,
         emitCycles(instruction);
         emitCount();
         emitStats(instruction);
+        emitProfile();
         emitRegWriteBack(instruction);
         emitTraceEnd();
         std::cout << "EXCEPTION(ET_KCALL, ";
@@ -566,6 +608,7 @@ emitCode(const Instruction &instruction,
         emitCycles(instruction);
         emitCount();
         emitStats(instruction);
+        emitProfile();
         emitTraceEnd();
         std::cout << "PAUSE_ON(PC, ";
         const char *close = scanClosingBracket(&s[i]);
@@ -580,6 +623,8 @@ emitCode(const Instruction &instruction,
         emitCycles(instruction);
         emitCount();
         emitStats(instruction);
+        emitProfile();
+        emitProfileHook(instruction);
         emitRegWriteBack(instruction);
         emitCheckEvents(instruction);
         emitTraceEnd();
@@ -591,6 +636,7 @@ emitCode(const Instruction &instruction,
         emitCycles(instruction);
         emitCount();
         emitStats(instruction);
+        emitProfile();
         emitCheckEventsOrDeschedule(instruction);
         emitTraceEnd();
         std::cout << "goto " << getEndLabel(instruction) << ";\n";
@@ -754,7 +800,7 @@ emitInstDispatch(Instruction &instruction)
     if (operands[i] == in)
       std::cout << "const ";
     if (isSR(instruction, i)) {
-      std::cout << "Thread::sr_t op" << i << ") = this->sr";
+      std::cout << "Thread::sr_t op" << i << ") = THREAD.sr";
     } else {
       std::cout << "uint32_t op" << i << ')';
       switch (operands[i]) {
@@ -787,6 +833,8 @@ emitInstDispatch(Instruction &instruction)
     emitCycles(instruction);
     emitCount();
     emitStats(instruction);
+    emitProfile();
+    emitProfileHook(instruction);
     emitRegWriteBack(instruction);
     emitCheckEvents(instruction);
     emitTraceEnd();
@@ -1154,7 +1202,7 @@ void add()
   // current thread.
   inst("TSETR_3r", 2, ops(imm, in, in), "set t[%2]:r%0, %1",
        "ResourceID resID(%2);\n"
-       "if (Thread *t = checkThread(*this, resID)) {\n"
+       "if (Thread *t = checkThread(THREAD, resID)) {\n"
        "  t->reg(%0) = %1;\n"
        "} else {\n"
        "  %exception(ET_ILLEGAL_RESOURCE, resID);\n"
@@ -1238,8 +1286,8 @@ void add()
   fl2rus("ASHR_32", "ashr %0, %1, 32", "%0 = (int32_t)%1 >> 31;");
   fl2rus_in("OUTPW", "outpw res[%1], %0, %2",
             "ResourceID resID(%1);\n"
-            "if (Port *res = checkPort(*this, resID)) {\n"
-            "  switch (res->outpw(*this, %0, %2, TIME)) {\n"
+            "if (Port *res = checkPort(THREAD, resID)) {\n"
+            "  switch (res->outpw(THREAD, %0, %2, TIME)) {\n"
             "  default: assert(0 && \"Unexpected outpw result\");\n"
             "  case Resource::CONTINUE:\n"
             "    break;\n"
@@ -1254,9 +1302,9 @@ void add()
     .setSync();
   fl2rus("INPW", "inpw %0, res[%1], %2",
          "ResourceID resID(%1);\n"
-         "if (Port *res = checkPort(*this, resID)) {\n"
+         "if (Port *res = checkPort(THREAD, resID)) {\n"
          "  uint32_t value;\n"
-         "  switch (res->inpw(*this, %2, TIME, value)) {\n"
+         "  switch (res->inpw(THREAD, %2, TIME, value)) {\n"
          "  default: assert(0 && \"Unexpected inpw result\");\n"
          "  case Resource::CONTINUE:\n"
          "    %0 = value;\n"
@@ -1416,8 +1464,23 @@ void add()
           "  %exception(ET_ILLEGAL_PC, FROM_PC(%1))\n"
           "}")
     .transform("%1 = %pc - %1;", "%1 = %pc - %1;");
+  // Backward branches closing loops which poll a timer, see SpinLoop.h.
+  fru6_in("BRBT_spin", "bt %0, -%1",
+          "if (%0) {\n"
+          "  %pc = %1;\n"
+          "  SKIP_SPIN_LOOP(PC);\n"
+          "  %next"
+          "}")
+    .transform("%1 = %pc - %1;", "%1 = %pc - %1;");
+  fru6_in("BRBF_spin", "bt %0, -%1",
+          "if (!%0) {\n"
+          "  %pc = %1;\n"
+          "  SKIP_SPIN_LOOP(PC);\n"
+          "  %next"
+          "}")
+    .transform("%1 = %pc - %1;", "%1 = %pc - %1;");
   fru6_in("SETC", "setc res[%0], %1",
-       "if (!setC(TIME, ResourceID(%0), %1)) {\n"
+       "if (!THREAD.setC(TIME, ResourceID(%0), %1)) {\n"
        "  %exception(ET_ILLEGAL_RESOURCE, %0)\n"
        "}\n")
     .setSync().setCanEvent();
@@ -1460,6 +1523,7 @@ void add()
       "%pc = target;\n"
       "%next"
       )
+    .setProfileHook("PROFILE_RETURN(%pc);")
     .addImplicitOp(sp, inout)
     .addImplicitOp(lr, inout)
     .transform("%0 = %0 << 2;", "%0 = %0 >> 2;")
@@ -1494,6 +1558,8 @@ void add()
     .transform("%0 = %pc + %0;", "%0 = %0 - %pc;");
   fu6("BRBU", "bu -%0", "%pc = %0;\n %next")
     .transform("%0 = %pc - %0;", "%0 = %pc - %0;");
+  fu6("BRBU_spin", "bu -%0", "%pc = %0;\n SKIP_SPIN_LOOP(PC);\n %next")
+    .transform("%0 = %pc - %0;", "%0 = %pc - %0;");
   fu6("BRBU_illegal", "bu -%0", "%exception(ET_ILLEGAL_PC, %0)")
     .transform("%0 = %pc - %0;", "%0 = %0 - %pc;");  
   fu6("LDAWCP", "ldaw %1, cp[%{cp}0]", "%1 = %2 + %0;")
@@ -1525,6 +1591,7 @@ void add()
       "%1 = FROM_PC(%pc);\n"
       "%pc = target;\n"
       "%next")
+    .setProfileHook("PROFILE_CALL(%pc);")
     .addImplicitOp(lr, out)
     .addImplicitOp(r11, in)
     // BLAT always causes an fnop.
@@ -1554,6 +1621,7 @@ void add()
   fu10("BLRF", "bl %0",
        "%1 = FROM_PC(%pc);\n"
        "%pc = %0;")
+    .setProfileHook("PROFILE_CALL(%pc);")
     .addImplicitOp(lr, out)
     .transform("%0 = %pc + %0;", "%0 = %0 - %pc;");
   fu10("BLRF_illegal", "bl %0", "%exception(ET_ILLEGAL_PC, FROM_PC(%0))")
@@ -1562,6 +1630,7 @@ void add()
        "%1 = FROM_PC(%pc);\n"
        "%pc = %0;\n"
        "%next")
+    .setProfileHook("PROFILE_CALL(%pc);")
     .addImplicitOp(lr, out)
     .transform("%0 = %pc - %0;", "%0 = %pc - %0;");
   fu10("BLRB_illegal", "bl -%0", "%exception(ET_ILLEGAL_PC, FROM_PC(%0))")
@@ -1587,6 +1656,7 @@ void add()
       "%next\n")
     .addImplicitOp(lr, out)
     .addImplicitOp(cp, in)
+    .setProfileHook("PROFILE_CALL(%pc);")
     // BLACP always causes an fnop.
     .setCycles("(2 * INSTRUCTION_CYCLES) + LOCAL_MEMORY_ACCESS_CYCLES");
   f2r("NOT", "not %0, %1", "%0 = ~%1;");
@@ -1603,14 +1673,14 @@ void add()
       "if (%1 > (uint32_t)LAST_STD_RES_TYPE)\n"
       "  %0 = 1;\n"
       "else if (Resource *res =\n"
-      "           core->allocResource(*this, (ResourceType)IMM(OP(1))))\n"
+      "           core->allocResource(THREAD, (ResourceType)IMM(OP(1))))\n"
       "  %0 = res->getID();\n"
       "else\n"
       "  %0 = 0;\n");
   f2r("GETST", "getst %0, res[%1]",
       "ResourceID resID(%1);\n"
-      "if (Synchroniser *sync = checkSync(*this, resID)) {\n"
-      "  if (Thread *t = core->allocThread(*this)) {\n"
+      "if (Synchroniser *sync = checkSync(THREAD, resID)) {\n"
+      "  if (Thread *t = core->allocThread(THREAD)) {\n"
       "    sync->addChild(*t);\n"
       "    t->setSync(*sync);\n"
       "    %0 = t->getID();\n"
@@ -1622,17 +1692,17 @@ void add()
       "}\n");
   f2r("PEEK", "peek %0, res[%1]",
       "ResourceID resID(%1);\n"
-      "if (Port *res = checkPort(*this, resID)) {\n"
-      "  %0 = res->peek(*this, TIME);\n"
+      "if (Port *res = checkPort(THREAD, resID)) {\n"
+      "  %0 = res->peek(THREAD, TIME);\n"
       "} else {\n"
       "  %exception(ET_ILLEGAL_RESOURCE, resID);\n"
       "}\n")
     .setSync();
   f2r("ENDIN", "endin %0, res[%1]",
       "ResourceID resID(%1);\n"
-      "if (Port *res = checkPort(*this, resID)) {\n"
+      "if (Port *res = checkPort(THREAD, resID)) {\n"
       "  uint32_t value;\n"
-      "  switch (res->endin(*this, TIME, value)) {\n"
+      "  switch (res->endin(THREAD, TIME, value)) {\n"
       "  default: assert(0 && \"Unexpected endin result\");\n"
       "  case Resource::CONTINUE:\n"
       "    %0 = value;\n"
@@ -1646,8 +1716,8 @@ void add()
     .setSync();
   f2r_in("SETPSC", "setpsc res[%1], %0",
          "ResourceID resID(%1);\n"
-         "if (Port *res = checkPort(*this, resID)) {\n"
-         "  switch (res->setpsc(*this, %0, TIME)) {\n"
+         "if (Port *res = checkPort(THREAD, resID)) {\n"
+         "  switch (res->setpsc(THREAD, %0, TIME)) {\n"
          "  default: assert(0 && \"Unexpected setpsc result\");\n"
          "  case Resource::CONTINUE:\n"
          "    break;\n"
@@ -1663,7 +1733,7 @@ void add()
   fl2r("CLZ", "clz %0, %1", "%0 = countLeadingZeros(%1);");
   fl2r_in("TINITLR", "init t[%1]:lr, %0", 
           "ResourceID resID(%1);\n"
-          "Thread *t = checkThread(*this, resID);\n"
+          "Thread *t = checkThread(THREAD, resID);\n"
           "if (t && t->inSSync()) {\n"
           "  t->reg(LR) = %0;\n"
           "} else {\n"
@@ -1692,27 +1762,27 @@ void add()
           "  ERROR();\n"
           "}\n");
   fl2r_in("SETC", "setc res[%0], %1",
-          "if (!setC(TIME, ResourceID(%0), %1)) {\n"
+          "if (!THREAD.setC(TIME, ResourceID(%0), %1)) {\n"
           "  %exception(ET_ILLEGAL_RESOURCE, %0);\n"
           "}\n").setSync().setCanEvent();
   fl2r_in("SETCLK", "setclk res[%1], %0",
-          "if (!setClock(ResourceID(%1), %0, TIME)) {\n"
+          "if (!THREAD.setClock(ResourceID(%1), %0, TIME)) {\n"
           "  %exception(ET_ILLEGAL_RESOURCE, %1);\n"
           "}\n").setSync();
   fl2r_in("SETTW", "settw res[%1], %0",
-          "Port *res = checkPort(*this, ResourceID(%1));\n"
-          "if (!res || !res->setTransferWidth(*this, %0, TIME)) {\n"
+          "Port *res = checkPort(THREAD, ResourceID(%1));\n"
+          "if (!res || !res->setTransferWidth(THREAD, %0, TIME)) {\n"
           "  %exception(ET_ILLEGAL_RESOURCE, %1);\n"
           "}\n").setSync();
   fl2r_in("SETRDY", "setrdy res[%1], %0",
-          "if (!threadSetReady(ResourceID(%1), %0, TIME)) {\n"
+          "if (!THREAD.threadSetReady(ResourceID(%1), %0, TIME)) {\n"
           "  %exception(ET_ILLEGAL_RESOURCE, %1);\n"
           "}\n").setSync();
   f2r("IN", "in %0, res[%1]",
       "ResourceID resID(%1);\n"
-      "if (Resource *res = checkResource(*this, resID)) {\n"
+      "if (Resource *res = checkResource(THREAD, resID)) {\n"
       "  uint32_t value;\n"
-      "  switch(res->in(*this, TIME, value)) {\n"
+      "  switch(res->in(THREAD, TIME, value)) {\n"
       "  default: assert(0 && \"Unexpected in result\");\n"
       "  case Resource::CONTINUE:\n"
       "    %0 = value;\n"
@@ -1728,8 +1798,8 @@ void add()
     .setSync();
   f2r_in("OUT", "out %0, res[%1]",
          "ResourceID resID(%1);\n"
-         "if (Resource *res = checkResource(*this, resID)) {\n"
-         "  switch (res->out(*this, %0, TIME)) {\n"
+         "if (Resource *res = checkResource(THREAD, resID)) {\n"
+         "  switch (res->out(THREAD, %0, TIME)) {\n"
          "  default: assert(0 && \"Unexpected out result\");\n"
          "  case Resource::CONTINUE:\n"
          "    break;\n"
@@ -1745,7 +1815,7 @@ void add()
     .setCanEvent();
   f2r_in("TINITPC", "init t[%1]:pc, %0",
          "ResourceID resID(%1);\n"
-         "Thread *t = checkThread(*this, resID);\n"
+         "Thread *t = checkThread(THREAD, resID);\n"
          "if (t && t->inSSync()) {\n"
          "  Thread &threadState = *t;\n"
          "  unsigned newPc = TO_PC(%0);\n"
@@ -1763,7 +1833,7 @@ void add()
          "}\n");
   f2r_in("TINITDP", "init t[%1]:dp, %0",
          "ResourceID resID(%1);\n"
-         "Thread *t = checkThread(*this, resID);\n"
+         "Thread *t = checkThread(THREAD, resID);\n"
          "if (t && t->inSSync()) {\n"
          "  t->reg(DP) = %0;\n"
          "} else {\n"
@@ -1771,7 +1841,7 @@ void add()
          "}\n");
   f2r_in("TINITSP", "init t[%1]:sp, %0",
          "ResourceID resID(%1);\n"
-         "Thread *t = checkThread(*this, resID);\n"
+         "Thread *t = checkThread(THREAD, resID);\n"
          "if (t && t->inSSync()) {\n"
          "  t->reg(SP) = %0;\n"
          "} else {\n"
@@ -1779,7 +1849,7 @@ void add()
          "}\n");
   f2r_in("TINITCP", "init t[%1]:cp, %0",
          "ResourceID resID(%1);\n"
-         "Thread *t = checkThread(*this, resID);\n"
+         "Thread *t = checkThread(THREAD, resID);\n"
          "if (t && t->inSSync()) {\n"
          "  t->reg(CP) = %0;\n"
          "} else {\n"
@@ -1790,14 +1860,14 @@ void add()
   
   f2r_in("SETD", "setd res[%1], %0",
          "ResourceID resID(%1);\n"
-         "Resource *res = checkResource(*this, resID);\n"
-         "if (!res || !res->setData(*this, %0, TIME)) {\n"
+         "Resource *res = checkResource(THREAD, resID);\n"
+         "if (!res || !res->setData(THREAD, %0, TIME)) {\n"
          "  %exception(ET_ILLEGAL_RESOURCE, resID);\n"
          "};\n").setSync();
   f2r_in("OUTCT", "outct res[%0], %1",
          "ResourceID resID(%0);\n"
-         "if (Chanend *chanend = checkChanend(*this, resID)) {\n"
-         "  switch (chanend->outct(*this, %1, TIME)) {\n"
+         "if (Chanend *chanend = checkChanend(THREAD, resID)) {\n"
+         "  switch (chanend->outct(THREAD, %1, TIME)) {\n"
          "  default: assert(0 && \"Unexpected outct result\");\n"
          "  case Resource::CONTINUE:\n"
          "    break;\n"
@@ -1811,8 +1881,8 @@ void add()
     .setCanEvent();
   frus_in("OUTCT", "outct res[%0], %1",
           "ResourceID resID(%0);\n"
-          "if (Chanend *chanend = checkChanend(*this, resID)) {\n"
-          "  switch (chanend->outct(*this, %1, TIME)) {\n"
+          "if (Chanend *chanend = checkChanend(THREAD, resID)) {\n"
+          "  switch (chanend->outct(THREAD, %1, TIME)) {\n"
           "  default: assert(0 && \"Unexpected outct result\");\n"
           "  case Resource::CONTINUE:\n"
           "    break;\n"
@@ -1826,8 +1896,8 @@ void add()
     .setCanEvent();
   f2r_in("OUTT", "outt res[%1], %0",
          "ResourceID resID(%1);\n"
-         "if (Chanend *chanend = checkChanend(*this, resID)) {\n"
-         "  switch (chanend->outt(*this, %0, TIME)) {\n"
+         "if (Chanend *chanend = checkChanend(THREAD, resID)) {\n"
+         "  switch (chanend->outt(THREAD, %0, TIME)) {\n"
          "  default: assert(0 && \"Unexpected outct result\");\n"
          "  case Resource::CONTINUE:\n"
          "    break;\n"
@@ -1841,9 +1911,9 @@ void add()
     .setCanEvent();
   f2r("INT", "int %0, res[%1]",
       "ResourceID resID(%1);\n"
-      "if (Chanend *chanend = checkChanend(*this, resID)) {\n"
+      "if (Chanend *chanend = checkChanend(THREAD, resID)) {\n"
       "  uint32_t value;\n"
-      "  switch (chanend->intoken(*this, TIME, value)) {\n"
+      "  switch (chanend->intoken(THREAD, TIME, value)) {\n"
       "    default: assert(0 && \"Unexpected int result\");\n"
       "    case Resource::DESCHEDULE:\n"
       "      %pause_on(chanend);\n"
@@ -1858,9 +1928,9 @@ void add()
       "}\n");
   f2r("INCT", "inct %0, res[%1]",
       "ResourceID resID(%1);\n"
-      "if (Chanend *chanend = checkChanend(*this, resID)) {\n"
+      "if (Chanend *chanend = checkChanend(THREAD, resID)) {\n"
       "  uint32_t value;\n"
-      "  switch (chanend->inct(*this, TIME, value)) {\n"
+      "  switch (chanend->inct(THREAD, TIME, value)) {\n"
       "    default: assert(0 && \"Unexpected int result\");\n"
       "    case Resource::DESCHEDULE:\n"
       "      %pause_on(chanend);\n"
@@ -1876,8 +1946,8 @@ void add()
       "};\n");
   f2r_in("CHKCT", "chkct res[%0], %1",
          "ResourceID resID(%0);\n"
-         "if (Chanend *chanend = checkChanend(*this, resID)) {\n"
-         "  switch (chanend->chkct(*this, TIME, %1)) {\n"
+         "if (Chanend *chanend = checkChanend(THREAD, resID)) {\n"
+         "  switch (chanend->chkct(THREAD, TIME, %1)) {\n"
          "    default: assert(0 && \"Unexpected chkct result\");\n"
          "    case Resource::DESCHEDULE:\n"
          "      %pause_on(chanend);\n"
@@ -1891,8 +1961,8 @@ void add()
          "}\n");
   frus_in("CHKCT", "chkct res[%0], %1",
           "ResourceID resID(%0);\n"
-          "if (Chanend *chanend = checkChanend(*this, resID)) {\n"
-          "  switch (chanend->chkct(*this, TIME, %1)) {\n"
+          "if (Chanend *chanend = checkChanend(THREAD, resID)) {\n"
+          "  switch (chanend->chkct(THREAD, TIME, %1)) {\n"
           "    default: assert(0 && \"Unexpected chkct result\");\n"
           "    case Resource::DESCHEDULE:\n"
           "      %pause_on(chanend);\n"
@@ -1906,9 +1976,9 @@ void add()
           "}\n");
   f2r("TESTCT", "testct %0, res[%1]",
       "ResourceID resID(%1);\n"
-      "if (Chanend *chanend = checkChanend(*this, resID)) {\n"
+      "if (Chanend *chanend = checkChanend(THREAD, resID)) {\n"
       "  bool isCt;\n"
-      "  if (chanend->testct(*this, TIME, isCt)) {\n"
+      "  if (chanend->testct(THREAD, TIME, isCt)) {\n"
       "    %0 = isCt;\n"
       "  } else {\n"
       "    %pause_on(chanend);\n"
@@ -1918,9 +1988,9 @@ void add()
       "}\n");
   f2r("TESTWCT", "testwct %0, res[%0]",
       "ResourceID resID(%1);\n"
-      "if (Chanend *chanend = checkChanend(*this, resID)) {\n"
+      "if (Chanend *chanend = checkChanend(THREAD, resID)) {\n"
       "  uint32_t value;\n"
-      "  if (chanend->testwct(*this, TIME, value)) {\n"
+      "  if (chanend->testwct(THREAD, TIME, value)) {\n"
       "    %0 = value;\n"
       "  } else {\n"
       "    %pause_on(chanend);\n"
@@ -1930,11 +2000,11 @@ void add()
       "}\n");
   f2r_in("EET", "eet res[%1], %0",
          "ResourceID resID(%1);\n"
-         "if (EventableResource *res = checkEventableResource(*this, resID)) {\n"
+         "if (EventableResource *res = checkEventableResource(THREAD, resID)) {\n"
          "  if (%0 != 0) {\n"
-         "    res->eventEnable(*this);\n"
+         "    res->eventEnable(THREAD);\n"
          "  } else {\n"
-         "    res->eventDisable(*this);\n"
+         "    res->eventDisable(THREAD);\n"
          "  }\n"
          "} else {\n"
          "  %exception(ET_ILLEGAL_RESOURCE, resID);\n"
@@ -1943,11 +2013,11 @@ void add()
     .setCanEvent();
   f2r_in("EEF", "eef res[%1], %0",
          "ResourceID resID(%1);\n"
-         "if (EventableResource *res = checkEventableResource(*this, resID)) {\n"
+         "if (EventableResource *res = checkEventableResource(THREAD, resID)) {\n"
          "  if (%0 == 0) {\n"
-         "    res->eventEnable(*this);\n"
+         "    res->eventEnable(THREAD);\n"
          "  } else {\n"
-         "    res->eventDisable(*this);\n"
+         "    res->eventDisable(THREAD);\n"
          "  }\n"
          "} else {\n"
          "  %exception(ET_ILLEGAL_RESOURCE, resID);\n"
@@ -1956,9 +2026,9 @@ void add()
     .setCanEvent();
   f2r_inout("INSHR", "inshr %0, res[%1]",
             "ResourceID resID(%1);\n"
-            "if (Port *res = checkPort(*this, resID)) {\n"
+            "if (Port *res = checkPort(THREAD, resID)) {\n"
             "  uint32_t value;\n"
-            "  Resource::ResOpResult result = res->in(*this, TIME, value);\n"
+            "  Resource::ResOpResult result = res->in(THREAD, TIME, value);\n"
             "  switch (result) {\n"
             "  default: assert(0 && \"Unexpected in result\");\n"
             "  case Resource::CONTINUE:\n"
@@ -1976,8 +2046,8 @@ void add()
     .setSync();
   f2r_inout("OUTSHR", "outshr %0, res[%1]",
             "ResourceID resID(%1);\n"
-            "if (Port *res = checkPort(*this, resID)) {\n"
-            "  Resource::ResOpResult result = res->out(*this, %0, TIME);\n"
+            "if (Port *res = checkPort(THREAD, resID)) {\n"
+            "  Resource::ResOpResult result = res->out(THREAD, %0, TIME);\n"
             "  switch (result) {\n"
             "  default: assert(0 && \"Unexpected outshr result\");\n"
             "  case Resource::CONTINUE:\n"
@@ -1992,15 +2062,15 @@ void add()
     .setSync();
   f2r("GETTS", "getts %0, res[%1]",
       "ResourceID resID(%1);\n"
-      "if (Port *res = checkPort(*this, resID)) {\n"
-      "  %0 = res->getTimestamp(*this, TIME);\n"
+      "if (Port *res = checkPort(THREAD, resID)) {\n"
+      "  %0 = res->getTimestamp(THREAD, TIME);\n"
       "} else {\n"
       "  %exception(ET_ILLEGAL_RESOURCE, %1);\n"
       "}\n").setSync();
   f2r_in("SETPT", "setpt res[%1], %0",
          "ResourceID resID(%1);\n"
-         "if (Port *res = checkPort(*this, resID)) {\n"
-         "  switch (res->setPortTime(*this, %0, TIME)) {\n"
+         "if (Port *res = checkPort(THREAD, resID)) {\n"
+         "  switch (res->setPortTime(THREAD, %0, TIME)) {\n"
          "  default: assert(0 && \"Unexpected setPortTime result\");\n"
          "  case Resource::CONTINUE:\n"
          "    break;\n"
@@ -2038,7 +2108,8 @@ void add()
       "  %exception(ET_ILLEGAL_PC, %0)\n"
       "}\n"
       "%pc = target;\n"
-      "%next\n");
+      "%next\n")
+    .setProfileHook("if (OP(0) == LR) PROFILE_RETURN(%pc);");
   f1r("BLA", "bla %0",
       "uint32_t target;\n"
       "if (%0 & 1) {\n"
@@ -2051,7 +2122,8 @@ void add()
       "%1 = FROM_PC(%pc);\n"
       "%pc = target;\n"
       "%next\n")
-    .addImplicitOp(lr, out);
+    .addImplicitOp(lr, out)
+    .setProfileHook("PROFILE_CALL(%pc);");
   f1r("BRU", "bru %0",
       "uint32_t target = %pc + %0;\n"
       "if (!CHECK_PC(target)) {\n"
@@ -2061,7 +2133,7 @@ void add()
       "%next\n");
   f1r("TSTART", "start t[%0]",
       "ResourceID resID(%0);\n"
-      "Thread *t = checkThread(*this, resID);\n"
+      "Thread *t = checkThread(THREAD, resID);\n"
       "if (t && t->inSSync() && !t->getSync()) {\n"
       "  t->setSSync(false);\n"
       "  t->pc++;"
@@ -2072,14 +2144,14 @@ void add()
   f1r_out("DGETREG", "dgetreg %0", "").setUnimplemented();
   f1r("KCALL",  "kcall %0", "%kcall(%0)");
   f1r("FREER", "freer res[%0]",
-      "Resource *res = checkResource(*this, ResourceID(%0));\n"
+      "Resource *res = checkResource(THREAD, ResourceID(%0));\n"
       "if (!res || !res->free()) {\n"
       "  %exception(ET_ILLEGAL_RESOURCE, %0);\n"
       "}\n");
   f1r("MSYNC", "msync res[%0]",
       "ResourceID resID(%0);\n"
-      "if (Synchroniser *sync = checkSync(*this, resID)) {\n"
-      "  switch (sync->msync(*this)) {\n"
+      "if (Synchroniser *sync = checkSync(THREAD, resID)) {\n"
+      "  switch (sync->msync(THREAD)) {\n"
       "  default: assert(0 && \"Unexpected sync result\");\n"
       "  case Synchroniser::SYNC_CONTINUE:\n"
       "    break;\n"
@@ -2091,8 +2163,8 @@ void add()
       "}\n");
   f1r("MJOIN", "mjoin res[%0]",
       "ResourceID resID(%0);\n"
-      "if (Synchroniser *sync = checkSync(*this, resID)) {\n"
-      "  switch (sync->mjoin(*this)) {\n"
+      "if (Synchroniser *sync = checkSync(THREAD, resID)) {\n"
+      "  switch (sync->mjoin(THREAD)) {\n"
       "    default: assert(0 && \"Unexpected mjoin result\");\n"
       "    case Synchroniser::SYNC_CONTINUE:\n"
       "      break;\n"
@@ -2105,10 +2177,10 @@ void add()
       "}\n");
   f1r("SETV", "setv res[%0], %1",
       "ResourceID resID(%0);\n"
-      "if (EventableResource *res = checkEventableResource(*this, resID)) {\n"
+      "if (EventableResource *res = checkEventableResource(THREAD, resID)) {\n"
       "  uint32_t target = TO_PC(%1);\n"
       "  if (CHECK_PC(target)) {\n"
-      "    res->setVector(*this, target);\n"
+      "    res->setVector(THREAD, target);\n"
       "  } else {\n"
       "    // TODO\n"
       "    ERROR();\n"
@@ -2118,39 +2190,39 @@ void add()
       "}\n").addImplicitOp(r11, in).setSync();
   f1r("SETEV", "setev res[%0], %1",
       "ResourceID resID(%0);\n"
-      "if (EventableResource *res = checkEventableResource(*this, resID)) {\n"
-      "  res->setEV(*this, %1);\n"
+      "if (EventableResource *res = checkEventableResource(THREAD, resID)) {\n"
+      "  res->setEV(THREAD, %1);\n"
       "} else {\n"
       "  %exception(ET_ILLEGAL_RESOURCE, resID);\n"
       "}\n").addImplicitOp(r11, in).setSync();
   f1r("EDU", "edu res[%0]",
       "ResourceID resID(%0);\n"
-      "if (EventableResource *res = checkEventableResource(*this, resID)) {\n"
-      "  res->eventDisable(*this);\n"
+      "if (EventableResource *res = checkEventableResource(THREAD, resID)) {\n"
+      "  res->eventDisable(THREAD);\n"
       "} else {\n"
       "  %exception(ET_ILLEGAL_RESOURCE, resID);\n"
       "}\n").setSync();
   f1r("EEU", "eeu res[%0]",
       "ResourceID resID(%0);\n"
-      "if (EventableResource *res = checkEventableResource(*this, resID)) {\n"
-      "  res->eventEnable(*this);\n"
+      "if (EventableResource *res = checkEventableResource(THREAD, resID)) {\n"
+      "  res->eventEnable(THREAD);\n"
       "} else {\n"
       "  %exception(ET_ILLEGAL_RESOURCE, resID);\n"
       "}\n").setSync().setCanEvent();
   f1r("WAITET", "waitet %0",
       "if (%0) {\n"
-      "  this->enableEvents();\n"
+      "  THREAD.enableEvents();\n"
       "  %deschedule\n"
       "}\n").setSync().setCanEvent();
   f1r("WAITEF", "waitef %0",
       "if (!%0) {\n"
-      "  this->enableEvents();\n"
+      "  THREAD.enableEvents();\n"
       "  %deschedule\n"
       "}\n").setSync().setCanEvent();
   f1r("SYNCR", "syncr res[%0]",
       "ResourceID resID(%0);\n"
-      "if (Port *port = checkPort(*this, resID)) {\n"
-      "  switch (port->sync(*this, TIME)) {\n"
+      "if (Port *port = checkPort(THREAD, resID)) {\n"
+      "  switch (port->sync(THREAD, TIME)) {\n"
       "  default: assert(0 && \"Unexpected syncr result\");\n"
       "  case Resource::CONTINUE: PC++; break;\n"
       "  case Resource::DESCHEDULE:\n"
@@ -2162,12 +2234,12 @@ void add()
       ).setSync();
   f1r("CLRPT", "clrpt res[%0]",
       "ResourceID resID(%0);\n"
-      "if (Port *res = checkPort(*this, resID)) {\n"
-      "  res->clearPortTime(*this, TIME);\n"
+      "if (Port *res = checkPort(THREAD, resID)) {\n"
+      "  res->clearPortTime(THREAD, TIME);\n"
       "} else {\n"
       "  %exception(ET_ILLEGAL_RESOURCE, resID);\n"
       "}\n").setSync();
-  f0r("GETID", "get %0, id", "%0 = this->getNum();")
+  f0r("GETID", "get %0, id", "%0 = THREAD.getNum();")
     .addImplicitOp(r11, out);
   f0r("GETET", "get %0, %1", "%0 = %1;")
     .addImplicitOp(r11, out)
@@ -2283,9 +2355,9 @@ void add()
   f0r("DCALL", "dcall", "").setUnimplemented();
   f0r("DRET", "dret", "").setUnimplemented();
   f0r("DENTSP", "dentsp", "").setUnimplemented();
-  f0r("CLRE", "clre", "this->clre();\n").setSync();
+  f0r("CLRE", "clre", "THREAD.clre();\n").setSync();
   f0r("WAITEU", "waiteu",
-      "this->enableEvents();\n"
+      "THREAD.enableEvents();\n"
       "%deschedule\n").setSync().setCanEvent();
   f0r("SSYNC", "", "").setCustom();
 
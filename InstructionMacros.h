@@ -0,0 +1,209 @@
+// Copyright (c) 2012, Richard Osborne, All rights reserved
+// This software is freely distributable under a derivative of the
+// University of Illinois/NCSA Open Source License posted in
+// LICENSE.txt and at <http://github.xcore.com/>
+
+#ifndef _InstructionMacros_h_
+#define _InstructionMacros_h_
+
+// Macros used by the instruction implementations emitted by instgen. They are
+// used inside Thread member functions, or static handlers in the tail call
+// dispatcher, where INST(), ENDINST and OPCODE() are defined by the
+// dispatcher. They are shared by the interpreter and the code
+// produced by axe-aot.
+
+// The thread executing the instruction. Tail call handlers are static
+// functions which are passed the thread.
+#ifdef TAIL_CALL_DISPATCH
+#define THREAD thread
+#else
+#define THREAD (*this)
+#endif
+
+// Locals available to every instruction. In the tail call dispatcher these are
+// recomputed by each handler, the compiler removes those that are unused.
+#define DISPATCH_LOCALS \
+  UNUSED(const bool tracing) = (features & DISPATCH_TRACING) != 0; \
+  UNUSED(const bool stats) = (features & DISPATCH_STATS) != 0; \
+  UNUSED(const bool memoryLatency) = \
+    (features & DISPATCH_MEMORY_LATENCY) != 0; \
+  UNUSED(const bool profiling) = (features & DISPATCH_PROFILING) != 0; \
+  UNUSED(const unsigned localMemoryLatency) = \
+    Config::get().latencyLocalMemory; \
+  UNUSED(const unsigned globalMemoryLatency) = \
+    Config::get().latencyGlobalMemory; \
+  UNUSED(SystemState &sys) = *THREAD.getParent().getParent()->getParent(); \
+  UNUSED(Core *core) = &THREAD.getParent(); \
+  UNUSED(OPCODE_TYPE *opcode) = core->getOpcodeCache(tracing); \
+  UNUSED(Operands *operands) = core->getOperandsCache(tracing);
+
+#ifdef TAIL_CALL_DISPATCH
+#define INVALIDATE_NATIVE_CODE(addr) \
+do { \
+  if (core->isNativeCode(addr)) \
+    core->invalidateNativeCode(addr); \
+} while(0)
+#else
+#define INVALIDATE_NATIVE_CODE(addr) do {} while(0)
+#endif
+
+#define CORE THREAD.getParent()
+#define LOAD_WORD(addr) core->loadWord(addr)
+#define LOAD_SHORT(addr) core->loadShort(addr)
+#define LOAD_BYTE(addr) core->loadByte(addr)
+#define INVALIDATE_WORD(addr) \
+do { \
+  opcode[(addr) >> 1] = OPCODE(DECODE); \
+  opcode[1 + ((addr) >> 1)] = OPCODE(DECODE); \
+  core->invalidateOtherCache(tracing, (addr) >> 1); \
+  core->invalidateOtherCache(tracing, 1 + ((addr) >> 1)); \
+  INVALIDATE_NATIVE_CODE(addr); \
+} while(0)
+#define INVALIDATE_SHORT(addr) \
+do { \
+  opcode[(addr) >> 1] = OPCODE(DECODE); \
+  core->invalidateOtherCache(tracing, (addr) >> 1); \
+  INVALIDATE_NATIVE_CODE(addr); \
+} while(0)
+#define INVALIDATE_BYTE(addr) INVALIDATE_SHORT(addr)
+
+#define STORE_WORD(value, addr) \
+do { \
+  INVALIDATE_WORD(addr); \
+  core->storeWord(value, addr); \
+} while(0)
+#define STORE_SHORT(value, addr) \
+do { \
+  INVALIDATE_SHORT(addr); \
+  core->storeShort(value, addr); \
+} while(0)
+#define STORE_BYTE(value, addr) \
+do { \
+  INVALIDATE_BYTE(addr); \
+  core->storeByte(value, addr); \
+} while(0)
+
+#define SAVE_CACHED() \
+do { \
+  THREAD.pc = PC;\
+} while(0)
+#define REG(Num) THREAD.regs[Num]
+#define IMM(Num) (Num)
+#define PC pc
+#define TIME THREAD.time
+#define COUNT THREAD.count
+#define LOCAL_MEMORY_ACCESS_CYCLES (memoryLatency ? localMemoryLatency : 0)
+#define GLOBAL_MEMORY_ACCESS_CYCLES (memoryLatency ? globalMemoryLatency : 0)
+#define TO_PC(addr) (core->physicalAddress(addr) >> 1)
+#define FROM_PC(addr) core->virtualAddress((addr) << 1)
+#define CHECK_PC(addr) ((addr) < (core->ram_size << 1))
+#define OP(n) (operands[PC].ops[(n)])
+#define LOP(n) (operands[PC].lops[(n)])
+#define ADDR(addr) core->physicalAddress(addr)
+#define PHYSICAL_ADDR(addr) core->physicalAddress(addr)
+#define VIRTUAL_ADDR(addr) core->virtualAddress(addr)
+#define CHECK_ADDR(addr) core->isValidAddress(addr)
+#define CHECK_ADDR_SHORT(addr) (!((addr) & 1) && CHECK_ADDR(addr))
+#define CHECK_ADDR_WORD(addr) (!((addr) & 3) && CHECK_ADDR(addr))
+#define EXCEPTION(et, ed) \
+do { \
+  PC = THREAD.exception(*core, PC, et, ed); \
+  NEXT_THREAD(PC); \
+} while(0);
+#define ERROR() \
+do { \
+  SAVE_CACHED(); \
+  internalError(THREAD, __FILE__, __LINE__); \
+} while(0)
+#define TRACE(...) \
+do { \
+  if (tracing) { \
+    SAVE_CACHED(); \
+    Tracer::get().trace(THREAD, __VA_ARGS__); \
+  } \
+} while(0)
+#define TRACE_REG_WRITE(register, value) \
+do { \
+  if (tracing) { \
+    Tracer::get().regWrite(register, value); \
+  } \
+} while(0)
+#define TRACE_END() \
+do { \
+  if (tracing) { \
+    Tracer::get().traceEnd(); \
+  } \
+} while(0)
+#define DESCHEDULE(pc) \
+do { \
+  SAVE_CACHED(); \
+  THREAD.beginStall(0); \
+  THREAD.waiting() = true; \
+  return; \
+} while(0)
+#define PAUSE_ON(pc, resource) \
+do { \
+  SAVE_CACHED(); \
+  THREAD.beginStall(resource); \
+  THREAD.waiting() = true; \
+  THREAD.pausedOn = resource; \
+  return; \
+} while(0)
+#define NEXT_THREAD(pc) \
+do { \
+  if (sys.hasTimeSliceExpired(TIME)) { \
+    SAVE_CACHED(); \
+    sys.schedule(THREAD); \
+    return; \
+  } \
+} while(0)
+#define TAKE_EVENT(pc) \
+do { \
+  SAVE_CACHED(); \
+  sys.takeEvent(THREAD); \
+  sys.schedule(THREAD); \
+  return; \
+} while(0)
+#define SETSR(bits, pc) \
+do { \
+  SAVE_CACHED(); \
+  if (THREAD.setSR(bits)) { \
+    sys.takeEvent(THREAD); \
+  } \
+  sys.schedule(THREAD); \
+  return; \
+} while(0)
+#define STATS(...) \
+do { \
+    Stats::get().updateStats(THREAD, __VA_ARGS__); \
+} while(0)
+#define PROFILE() \
+do { \
+  if (PCProfile *pcProfile = core->pcProfile) { \
+    pcProfile[PC].count++; \
+    pcProfile[PC].cycles += TIME - THREAD.profileTime; \
+    THREAD.profileTime = TIME; \
+  } \
+  if (Profiler::get().getSampling() && \
+      Profiler::get().getSampleClock(THREAD) >= THREAD.nextProfileSample) { \
+    SAVE_CACHED(); \
+    Profiler::get().sample(THREAD); \
+  } \
+} while(0)
+#define SKIP_SPIN_LOOP(pc) \
+do { \
+  if (SpinLoop *spinLoop = core->getSpinLoop(pc)) \
+    spinLoop->skip(THREAD, sys); \
+} while(0)
+#define PROFILE_CALL(target) \
+do { \
+  if (THREAD.callStack) \
+    Profiler::get().call(THREAD, PC, target); \
+} while(0)
+#define PROFILE_RETURN(target) \
+do { \
+  if (THREAD.callStack) \
+    Profiler::get().ret(THREAD, PC, target); \
+} while(0)
+
+#endif // _InstructionMacros_h_
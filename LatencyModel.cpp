@@ -11,6 +11,7 @@ LatencyModel LatencyModel::instance;
 
 void LatencyModel::init() {
   numCores = Config::get().numChips*Config::get().tilesPerChip;
+  enabled = Config::get().latencyModelType != Config::NONE;
 #ifdef DEBUG
   std::cout << "Latency model parameters" << std::endl;
   std::cout << "Num cores: " << numCores << std::endl;
@@ -8,13 +8,17 @@ class LatencyModel {
 public:
   static LatencyModel instance;
   void init();
+  /// Returns false if no latency model is selected, in which case calc()
+  /// always returns 0.
+  bool isEnabled() const { return enabled; }
   ticks_t calc(uint32_t sCore, uint32_t sNode, 
       uint32_t tCore, uint32_t tNode, int numTokens, bool inPacket);
   static LatencyModel &get() { return instance; }
 
 private:
-  LatencyModel() {};
+  LatencyModel() : enabled(false) {};
   int numCores;
+  bool enabled;
   std::map<std::pair<std::pair<uint32_t, uint32_t>, bool>, ticks_t> cache;
   
   int threadLatency();
@@ -12,7 +12,7 @@ out(Thread &thread, uint32_t value, ticks_t time)
   // Unpause a thread.
   if (!threads.empty()) {
     Thread *next = threads.front();
-    threads.pop();
+    threads.pop_front();
     if (time > next->time)
       next->time = time;
     next->pc++;
@@ -31,6 +31,6 @@ in(Thread &thread, ticks_t time, uint32_t &value)
     value = getID();
     return CONTINUE;
   }
-  threads.push(&thread);
+  threads.push_back(&thread);
   return DESCHEDULE;
 }
@@ -6,14 +6,14 @@
 #ifndef _Lock_h_
 #define _Lock_h_
 
-#include <queue>
+#include "small_vector.h"
 
 class Lock : public Resource {
 private:
   /// Is the lock currently held by a thread?
   bool held;
   /// Paused threads.
-  std::queue<Thread *> threads;
+  small_vector<Thread *, 1> threads;
 public:
   Lock() : Resource(RES_TYPE_LOCK) {}
 
@@ -22,9 +22,7 @@ public:
     assert(!isInUse() && "Trying to allocate in use lock");
     setInUse(true);
     held = false;
-    while (!threads.empty()) {
-      threads.pop();
-    }
+    threads.clear();
     return true;
   }
   
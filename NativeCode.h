@@ -0,0 +1,65 @@
+// Copyright (c) 2012, Richard Osborne, All rights reserved
+// This software is freely distributable under a derivative of the
+// University of Illinois/NCSA Open Source License posted in
+// LICENSE.txt and at <http://github.xcore.com/>
+
+#ifndef _NativeCode_h_
+#define _NativeCode_h_
+
+#include "Instruction.h"
+#include <stdint.h>
+
+// Interface between axe and the shared objects produced by axe-aot. Each
+// shared object contains native handlers for the basic blocks of the ELF
+// images in an XE file. The handlers are compiled for the dispatcher with no
+// tracing, statistics or memory latency.
+
+/// Incremented whenever the layout of the structures below or of the state
+/// accessed by the handlers changes.
+#define NATIVE_CODE_VERSION 3
+
+/// Upper bound on the size of a translated block in bytes.
+#define MAX_NATIVE_BLOCK_SIZE 256
+
+struct NativeBlock {
+  /// Address of the first instruction in the block.
+  uint32_t address;
+  /// Size of the block in bytes.
+  uint32_t size;
+#ifdef TAIL_CALL_DISPATCH
+  OPCODE_TYPE handler;
+#endif
+};
+
+struct NativeImage {
+  unsigned jtagIndex;
+  unsigned core;
+  /// The ram base and size the image was translated for.
+  uint32_t ramBase;
+  uint32_t ramSize;
+  /// Range of memory containing translated instructions.
+  uint32_t codeAddress;
+  uint32_t codeSize;
+  /// Checksum of the memory in the above range after the image is loaded.
+  uint32_t checksum;
+  const NativeBlock *blocks;
+  unsigned numBlocks;
+};
+
+/// Returns the checksum used to check the image matches the translated code.
+inline uint32_t nativeCodeChecksum(const uint8_t *p, uint32_t size)
+{
+  // FNV-1a.
+  uint32_t hash = 2166136261u;
+  for (uint32_t i = 0; i < size; i++) {
+    hash ^= p[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+#define NATIVE_CODE_VERSION_SYMBOL "axeNativeCodeVersion"
+#define NATIVE_IMAGES_SYMBOL "axeNativeImages"
+#define NUM_NATIVE_IMAGES_SYMBOL "axeNumNativeImages"
+
+#endif // _NativeCode_h_
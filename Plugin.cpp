@@ -0,0 +1,206 @@
+// Copyright (c) 2012, Richard Osborne, All rights reserved
+// This software is freely distributable under a derivative of the
+// University of Illinois/NCSA Open Source License posted in
+// LICENSE.txt and at <http://github.xcore.com/>
+
+#include "Plugin.h"
+#include "SystemState.h"
+#include "Core.h"
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+#ifndef _WIN32
+#include <dlfcn.h>
+#endif
+
+const AXEPluginHost AXEPlugin::host = {
+  AXE_PLUGIN_API_VERSION,
+  &AXEPlugin::setCallbacks,
+  &AXEPlugin::attachPort,
+  &AXEPlugin::drivePins,
+  &AXEPlugin::wakeAt
+};
+
+void PluginPort::drive(Signal value, ticks_t time)
+{
+  AXEPinChange change;
+  change.time = time;
+  change.value = value.value;
+  change.halfPeriod = value.halfPeriod;
+  pending.push_back(change);
+  plugin.seeChange(time);
+}
+
+AXEPlugin::AXEPlugin(SystemState &sys, void *h) :
+  system(sys),
+  handle(h),
+  data(0),
+  firstChange(0),
+  changesPending(false)
+{
+  callbacks.pinsChanged = 0;
+  callbacks.wake = 0;
+  callbacks.finish = 0;
+}
+
+AXEPlugin::~AXEPlugin()
+{
+  if (callbacks.finish)
+    callbacks.finish(data);
+#ifndef _WIN32
+  dlclose(handle);
+#endif
+}
+
+AXEPlugin *AXEPlugin::
+load(SystemState &sys, const std::string &filename, const std::string &args)
+{
+#ifdef _WIN32
+  std::cerr << "Error: plugins are not supported on this platform"
+            << std::endl;
+  return 0;
+#else
+  void *handle = dlopen(filename.c_str(), RTLD_NOW | RTLD_LOCAL);
+  if (!handle) {
+    std::cerr << "Error loading \"" << filename << "\": " << dlerror()
+              << std::endl;
+    return 0;
+  }
+  AXEPluginInitFn init =
+    reinterpret_cast<AXEPluginInitFn>(dlsym(handle, AXE_PLUGIN_INIT_SYMBOL));
+  if (!init) {
+    std::cerr << "Error: \"" << filename << "\" doesn't define "
+              << AXE_PLUGIN_INIT_SYMBOL << std::endl;
+    dlclose(handle);
+    return 0;
+  }
+  std::vector<std::string> arguments(1, filename);
+  std::istringstream stream(args);
+  std::string arg;
+  while (stream >> arg)
+    arguments.push_back(arg);
+  std::vector<char*> argv;
+  for (unsigned i = 0; i < arguments.size(); i++)
+    argv.push_back(&arguments[i][0]);
+  argv.push_back(0);
+  AXEPlugin *plugin = new AXEPlugin(sys, handle);
+  if (init(plugin, &host, arguments.size(), &argv[0]) != 0) {
+    std::cerr << "Error: failed to initialise \"" << filename << "\""
+              << std::endl;
+    delete plugin;
+    return 0;
+  }
+  plugin->reschedule(0);
+  return plugin;
+#endif
+}
+
+void AXEPlugin::
+setCallbacks(AXEPlugin *plugin, const AXEPluginCallbacks *callbacks,
+             void *data)
+{
+  plugin->callbacks = *callbacks;
+  plugin->data = data;
+}
+
+int AXEPlugin::attachPort(AXEPlugin *plugin, const char *core, uint32_t portID)
+{
+  Core *c = plugin->system.findCore(core);
+  if (!c)
+    return -1;
+  Port *port = c->getPhysicalPort(ResourceID(portID));
+  if (!port || port->isConnected())
+    return -1;
+  PluginPort *connection = new PluginPort(*plugin, *port);
+  port->connect(connection);
+  plugin->ports.push_back(connection);
+  return plugin->ports.size() - 1;
+}
+
+void AXEPlugin::
+drivePins(AXEPlugin *plugin, int port, uint32_t value, axe_ticks_t time)
+{
+  if (port < 0 || unsigned(port) >= plugin->ports.size())
+    return;
+  plugin->drives.insert(std::make_pair(time, std::make_pair(port, value)));
+  plugin->reschedule(time);
+}
+
+void AXEPlugin::wakeAt(AXEPlugin *plugin, axe_ticks_t time)
+{
+  plugin->wakeTimes.push(time);
+  plugin->reschedule(time);
+}
+
+void AXEPlugin::seeChange(ticks_t time)
+{
+  if (changesPending && firstChange <= time)
+    return;
+  firstChange = time;
+  changesPending = true;
+  reschedule(time);
+}
+
+void AXEPlugin::reschedule(ticks_t time)
+{
+  // Keep the plugin scheduled for the earliest thing it has to do.
+  ticks_t next = time;
+  bool found = false;
+  if (changesPending) {
+    next = firstChange;
+    found = true;
+  }
+  if (!drives.empty() && (!found || drives.begin()->first < next)) {
+    next = drives.begin()->first;
+    found = true;
+  }
+  if (!wakeTimes.empty() && (!found || wakeTimes.top() < next)) {
+    next = wakeTimes.top();
+    found = true;
+  }
+  if (found)
+    system.scheduleOther(*this, next);
+}
+
+void AXEPlugin::applyDrives(ticks_t time)
+{
+  while (!drives.empty() && drives.begin()->first <= time) {
+    std::pair<int,uint32_t> drive = drives.begin()->second;
+    ticks_t driveTime = drives.begin()->first;
+    drives.erase(drives.begin());
+    Port &port = ports[drive.first]->getPort();
+    port.seePinsChange(Signal(drive.second & port.portWidthMask()),
+                       driveTime);
+  }
+}
+
+void AXEPlugin::deliverChanges()
+{
+  if (!changesPending)
+    return;
+  changesPending = false;
+  for (unsigned i = 0; i < ports.size(); i++) {
+    PluginPort &port = *ports[i];
+    const std::vector<AXEPinChange> &changes = port.getChanges();
+    if (changes.empty())
+      continue;
+    if (callbacks.pinsChanged)
+      callbacks.pinsChanged(data, i, &changes[0], changes.size());
+    port.clearChanges();
+  }
+}
+
+void AXEPlugin::run(ticks_t time)
+{
+  applyDrives(time);
+  deliverChanges();
+  while (!wakeTimes.empty() && wakeTimes.top() <= time) {
+    ticks_t wakeTime = wakeTimes.top();
+    wakeTimes.pop();
+    if (callbacks.wake)
+      callbacks.wake(data, wakeTime);
+  }
+  // Apply values driven from the callbacks at the current time.
+  applyDrives(time);
+  reschedule(time);
+}
@@ -0,0 +1,79 @@
+// Copyright (c) 2012, Richard Osborne, All rights reserved
+// This software is freely distributable under a derivative of the
+// University of Illinois/NCSA Open Source License posted in
+// LICENSE.txt and at <http://github.xcore.com/>
+
+#ifndef _Plugin_h_
+#define _Plugin_h_
+
+#include "AXEPlugin.h"
+#include "Port.h"
+#include "Runnable.h"
+#include <functional>
+#include <map>
+#include <queue>
+#include <string>
+#include <utility>
+#include <vector>
+
+class SystemState;
+class PluginPort;
+
+/// A peripheral plugin loaded from a shared object. Pin changes on the ports
+/// the plugin is attached to are collected and passed to the plugin in a
+/// batch when the plugin next runs from the scheduler, which is also where
+/// requested wake ups are delivered.
+struct AXEPlugin : public Runnable {
+private:
+  SystemState &system;
+  void *handle;
+  AXEPluginCallbacks callbacks;
+  void *data;
+  std::vector<PluginPort*> ports;
+  std::priority_queue<ticks_t,std::vector<ticks_t>,
+                      std::greater<ticks_t> > wakeTimes;
+  /// Values driven by the plugin which haven't yet reached the pins, by time.
+  std::multimap<ticks_t,std::pair<int,uint32_t> > drives;
+  /// Time of the earliest pin change not yet passed to the plugin, valid if
+  /// changesPending is set.
+  ticks_t firstChange;
+  bool changesPending;
+
+  AXEPlugin(SystemState &sys, void *h);
+  void applyDrives(ticks_t time);
+  void deliverChanges();
+  void reschedule(ticks_t time);
+
+  static void setCallbacks(AXEPlugin *plugin,
+                           const AXEPluginCallbacks *callbacks, void *data);
+  static int attachPort(AXEPlugin *plugin, const char *core, uint32_t portID);
+  static void drivePins(AXEPlugin *plugin, int port, uint32_t value,
+                        axe_ticks_t time);
+  static void wakeAt(AXEPlugin *plugin, axe_ticks_t time);
+  static const AXEPluginHost host;
+public:
+  virtual ~AXEPlugin();
+  /// Load a plugin and initialise it with the specified arguments, separated
+  /// by whitespace. Returns 0 on failure.
+  static AXEPlugin *load(SystemState &sys, const std::string &filename,
+                         const std::string &args);
+  /// Called when a port the plugin is attached to drives a new value.
+  void seeChange(ticks_t time);
+  void run(ticks_t time);
+};
+
+/// Connection between a port and a plugin.
+class PluginPort : public PortConnection {
+  AXEPlugin &plugin;
+  Port &port;
+  std::vector<AXEPinChange> pending;
+public:
+  PluginPort(AXEPlugin &pl, Port &p) : plugin(pl), port(p) {}
+  Port &getPort() { return port; }
+  void drive(Signal value, ticks_t time);
+  /// Returns the changes since the last call to clearChanges().
+  const std::vector<AXEPinChange> &getChanges() const { return pending; }
+  void clearChanges() { pending.clear(); }
+};
+
+#endif // _Plugin_h_
@@ -5,6 +5,9 @@
 
 #include "Resource.h"
 #include "Core.h"
+#include "Node.h"
+#include "SystemState.h"
+#include "Waveform.h"
 #include <algorithm>
 #include <stdio.h>
 
@@ -18,8 +21,16 @@ Port::Port() :
   readyOut(false),
   time(0),
   pinsInputValue(),
+  connection(0),
+  waveform(0),
+  waveformSignal(0),
   fileOpen(false) {}
 
+Port::~Port()
+{
+  delete connection;
+}
+
 std::string Port::getName() const
 {
   return "(Unknown port)";
@@ -39,7 +50,7 @@ uint32_t Port::getDataPortPinsValue(ticks_t time) const
 }
 
 Signal Port::getPinsValue() const {
-  if (!outputPort) {
+  if (!drivesPins()) {
     return pinsInputValue;
   }
   return getPinsOutputValue();
@@ -122,20 +133,23 @@ Signal Port::getPinsOutputValue() const
 void Port::
 outputValue(Signal value, ticks_t time)
 {
-  if (outputPort)
-    handlePinsChange(value, time);
+  if (!drivesPins())
+    return;
+  if (waveform)
+    waveform->change(waveformSignal, value, time);
+  handlePinsChange(value, time);
+  if (connection)
+    connection->drive(value, time);
 }
 
 void Port::
 handlePinsChange(Signal value, ticks_t time)
 {
-  for (std::set<ClockBlock*>::iterator it = sourceOf.begin(),
-       e = sourceOf.end(); it != e; ++it) {
-    (*it)->setValue(value, time);
+  for (unsigned i = 0; i < sourceOf.size(); i++) {
+    sourceOf[i]->setValue(value, time);
   }
-  for (std::set<ClockBlock*>::iterator it = readyInOf.begin(),
-       e = readyInOf.end(); it != e; ++it) {
-    (*it)->setReadyInValue(value, time);
+  for (unsigned i = 0; i < readyInOf.size(); i++) {
+    readyInOf[i]->setReadyInValue(value, time);
   }
 }
 
@@ -148,19 +162,22 @@ handlePinsChange(uint32_t val, ticks_t time)
 void Port::
 handleReadyOutChange(bool value, ticks_t time)
 {
-  for (std::set<Port*>::iterator it = readyOutPorts.begin(),
-       e = readyOutPorts.end(); it != e; ++it) {
-    (*it)->outputValue(value, time);
+  for (unsigned i = 0; i < readyOutPorts.size(); i++) {
+    readyOutPorts[i]->outputValue(value, time);
   }
 }
 
 void Port::
 seePinsChange(const Signal &value, ticks_t time)
 {
+  // A change can't be seen before the time the port has been updated to.
+  time = std::max(time, this->time);
   update(time);
   pinsInputValue = value;
-  if (!isInUse() || outputPort)
+  if (!isInUse() || drivesPins())
     return;
+  if (waveform)
+    waveform->change(waveformSignal, value, time);
   handlePinsChange(value, time);
   scheduleUpdateIfNeeded();
 }
@@ -184,11 +201,14 @@ void Port::update(ticks_t newTime)
     return;
   }
   const bool slowMode = false;
-  // TODO handle these cases.
-  if (slowMode || timeRegValid || useReadyOut()) {
+  if (slowMode) {
     updateAux(newTime);
     return;
   }
+  if (timeRegValid || useReadyOut()) {
+    updateTimedOrReady(newTime);
+    return;
+  }
   // Align to rising edge.
   if (nextEdge->type == Edge::RISING) {
     seeEdge(nextEdge->type, nextEdge->time);
@@ -246,6 +266,71 @@ void Port::updateAux(ticks_t newTime)
   time = newTime;
 }
 
+unsigned Port::skippableFallingEdges(bool &samplesPins)
+{
+  const unsigned unlimited = ~0U;
+  samplesPins = false;
+  if (readyOut != nextReadyOut())
+    return 0;
+  unsigned untilTimeMet = timeRegValid ? fallingEdgesUntilTimeMet() - 1 :
+                                         unlimited;
+  if (outputPort) {
+    // Nothing happens on the edges once the shift register is empty unless
+    // there is data to load, a thread to wake or the port time is reached.
+    if (pausedIn || pausedSync || validShiftRegEntries != 0)
+      return 0;
+    if (transferRegValid && !timeRegValid)
+      return 0;
+    return untilTimeMet;
+  }
+  if (!timeRegValid)
+    return 0;
+  // An input port with ready out doesn't sample until the port time is
+  // reached.
+  if (useReadyOut())
+    return untilTimeMet;
+  // Data sampled more than two transfers before the port time is never seen.
+  if (pausedOut || useReadyIn())
+    return 0;
+  unsigned significant = 2 * shiftRegEntries;
+  if (untilTimeMet <= significant)
+    return 0;
+  samplesPins = true;
+  return untilTimeMet - significant;
+}
+
+void Port::updateTimedOrReady(ticks_t newTime)
+{
+  while (nextEdge->time <= newTime) {
+    if (!timeRegValid && !useReadyOut()) {
+      update(newTime);
+      return;
+    }
+    bool samplesPins;
+    unsigned skippable = nextEdge->type == Edge::FALLING ?
+                         skippableFallingEdges(samplesPins) : 0;
+    if (skippable == 0) {
+      seeEdge(nextEdge->type, nextEdge->time);
+      ++nextEdge;
+      continue;
+    }
+    // Skip pairs of falling and rising edges.
+    ticks_t available = (clock->getEdgeIterator(newTime) - nextEdge) / 2;
+    if (available == 0) {
+      seeEdge(nextEdge->type, nextEdge->time);
+      ++nextEdge;
+      continue;
+    }
+    unsigned numSkipped = std::min(ticks_t(skippable), available);
+    if (samplesPins)
+      skipEdges(numSkipped, numSkipped);
+    else
+      portCounter += numSkipped;
+    nextEdge += 2 * numSkipped;
+  }
+  time = newTime;
+}
+
 bool Port::
 shouldRealignShiftRegister()
 {
@@ -451,6 +536,44 @@ bool Port::isValidPortShiftCount(uint32_t count) const
          (count % getPortWidth()) == 0;
 }
 
+/// Ports that aren't connected to anything are mapped to host character I/O.
+/// Port 0 reads stdin and writes stdout, other ports use a file named "axe N".
+Resource::ResOpResult Port::hostIn(uint32_t &value)
+{
+  int num = getID().num();
+  if (num == 0) {
+    value = getchar();
+  }
+  else {
+    if (!fileOpen) {
+      char fname[] = {'a', 'x', 'e', ' ', 0};
+      fname[3] = num + '0';
+      file = fopen(fname, "wb");
+      fileOpen = true;
+    }
+    value = fgetc(file);
+  }
+  return CONTINUE;
+}
+
+Resource::ResOpResult Port::hostOut(uint32_t value)
+{
+  int num = getID().num();
+  if (num == 0) {
+    putchar(value); 
+  }
+  else {
+    if (!fileOpen) {
+      char fname[] = {'a', 'x', 'e', ' ', 0};
+      fname[3] = num + '0';
+      file = fopen(fname, "wb");
+      fileOpen = true;
+    }
+    fputc(value, file);
+  } 
+  return CONTINUE;
+}
+
 Resource::ResOpResult Port::
 in(Thread &thread, ticks_t threadTime, uint32_t &value)
 {
@@ -461,7 +584,9 @@ in(Thread &thread, ticks_t threadTime, uint32_t &value)
     value = 0;
     return CONTINUE;
   }
-  /*if (outputPort) {
+  if (!isConnected())
+    return hostIn(value);
+  if (outputPort) {
     pausedIn = &thread;
     scheduleUpdateIfNeeded();
     return DESCHEDULE;
@@ -482,21 +607,7 @@ in(Thread &thread, ticks_t threadTime, uint32_t &value)
   }
   pausedIn = &thread;
   scheduleUpdateIfNeeded();
-  return DESCHEDULE;*/
-  int num = getID().num();
-  if (num == 0) {
-    value = getchar();
-  }
-  else {
-    if (!fileOpen) {
-      char fname[] = {'a', 'x', 'e', ' ', 0};
-      fname[3] = num + '0';
-      file = fopen(fname, "wb");
-      fileOpen = true;
-    }
-    value = fgetc(file);
-  }
-  return CONTINUE;
+  return DESCHEDULE;
 }
 
 Resource::ResOpResult Port::
@@ -547,7 +658,9 @@ out(Thread &thread, uint32_t value, ticks_t threadTime)
   if (portType != DATAPORT) {
     return CONTINUE;
   }
-  /*if (outputPort) {
+  if (!isConnected())
+    return hostOut(value);
+  if (outputPort) {
     if (transferRegValid) {
       pausedOut = &thread;
       scheduleUpdateIfNeeded();
@@ -560,21 +673,7 @@ out(Thread &thread, uint32_t value, ticks_t threadTime)
   transferRegValid = true;
   transferReg = value;
   outputPort = true;
-  scheduleUpdateIfNeeded();*/
-  int num = getID().num();
-  //std::cout<<"port"<<std::hex<<(getID()>>8)<<std::endl;
-  if (num == 0) {
-    putchar(value); 
-  }
-  else {
-    if (!fileOpen) {
-      char fname[] = {'a', 'x', 'e', ' ', 0};
-      fname[3] = num + '0';
-      file = fopen(fname, "wb");
-      fileOpen = true;
-    }
-    fputc(value, file);
-  } 
+  scheduleUpdateIfNeeded();
   return CONTINUE;
 }
 
@@ -828,6 +927,12 @@ unsigned Port::fallingEdgesUntilTimeMet() const
   return (uint16_t)(timeReg - (portCounter + 1)) + 1;
 }
 
+void Port::scheduleUpdate(ticks_t time)
+{
+  SystemState &system = *getOwner().getParent().getParent()->getParent();
+  clock->schedulePortUpdate(*this, time, system);
+}
+
 void Port::scheduleUpdateIfNeededOutputPort()
 {
   // If the next edge is a falling edge unconditionally schedule an update.
@@ -857,6 +962,9 @@ void Port::scheduleUpdateIfNeededOutputPort()
       (pausedIn || pausedSync || transferRegValid)) {
     return scheduleUpdate((nextEdge + 1)->time);
   }
+  // Nothing can happen until the port is next accessed so drop any update
+  // scheduled before.
+  cancelUpdate();
 }
 
 void Port::scheduleUpdateIfNeededInputPort()
@@ -889,6 +997,7 @@ void Port::scheduleUpdateIfNeededInputPort()
       }
     }
   }
+  cancelUpdate();
 }
 
 void Port::scheduleUpdateIfNeeded()
@@ -954,3 +1063,28 @@ bool Port::seeEventEnable(ticks_t time)
   scheduleUpdateIfNeeded();
   return false;
 }
+
+void LoopbackWire::drive(Signal value, ticks_t time)
+{
+  if (!value.isClock())
+    value = Signal(value.value & dest.portWidthMask());
+  pending.push_back(std::make_pair(time, value));
+  if (!scheduled) {
+    scheduled = true;
+    system.scheduleOther(*this, time);
+  }
+}
+
+void LoopbackWire::run(ticks_t time)
+{
+  while (!pending.empty() && pending.front().first <= time) {
+    std::pair<ticks_t,Signal> change = pending.front();
+    pending.pop_front();
+    dest.seePinsChange(change.second, change.first);
+  }
+  if (pending.empty()) {
+    scheduled = false;
+    return;
+  }
+  system.scheduleOther(*this, pending.front().first);
+}
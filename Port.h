@@ -10,10 +10,16 @@
 #include "ClockBlock.h"
 #include "BitManip.h"
 #include <stdint.h>
-#include <set>
+#include "small_vector.h"
+#include "Runnable.h"
+#include <deque>
+#include <utility>
 
 class Thread;
 class ClockBlock;
+class SystemState;
+class PortConnection;
+class Waveform;
 struct Signal;
 
 class Port : public EventableResource {
@@ -36,14 +42,14 @@ private:
   uint32_t data;
   Condition condition;
   ClockBlock *clock;
-  std::set<ClockBlock*> sourceOf;
-  std::set<ClockBlock*> readyInOf;
+  small_vector<ClockBlock*, 1> sourceOf;
+  small_vector<ClockBlock*, 1> readyInOf;
   Port *readyOutOf;
   uint16_t portCounter;
   // Current value on the pins.
   uint32_t shiftRegister;
   /// Ready out ports.
-  std::set<Port*> readyOutPorts;
+  small_vector<Port*, 1> readyOutPorts;
   /// Thread paused on an output instruction.
   Thread *pausedOut;
   /// Thread paused on an input instruction.
@@ -91,10 +97,23 @@ private:
   MasterSlave masterSlave;
   PortType portType;
   Signal pinsInputValue;
+  /// What the pins are connected to, or 0 if the port isn't connected.
+  PortConnection *connection;
+  /// Waveform the value on the pins is recorded in, or 0 if not recorded.
+  Waveform *waveform;
+  unsigned waveformSignal;
   /// For port output
   FILE *file;
   bool fileOpen;
 
+  /// Returns whether the port is driving its pins.
+  bool drivesPins() const {
+    return outputPort || portType != DATAPORT;
+  }
+  /// Input and output on ports which are not connected to anything.
+  ResOpResult hostIn(uint32_t &value);
+  ResOpResult hostOut(uint32_t value);
+
   /// Return the value currently being output to the ports pins.
   Signal getPinsOutputValue() const;
   uint32_t getPinsOutputValue(ticks_t time) const {
@@ -113,11 +132,18 @@ private:
   void handlePinsChange(uint32_t value, ticks_t time);
   /// Called whenever the readyOut value changes.
   void handleReadyOutChange(bool value, ticks_t time);
-  /// Update the pin buffer with the change.
-  void seePinsChange(const Signal &value, ticks_t time);
   /// Update the port to the specified time. The port must be clocked off a
   /// fixed frequency clock.
   void updateAux(ticks_t time);
+  /// Returns the number of falling edges starting at the next edge, which
+  /// must be a falling edge, that can be skipped along with the rising edge
+  /// that follows each of them. samplesPins is set if the skipped rising
+  /// edges sample the pins, otherwise the skipped edges only advance the port
+  /// counter.
+  unsigned skippableFallingEdges(bool &samplesPins);
+  /// Update a timed port or a port with a ready out signal to the specified
+  /// time, skipping runs of edges which have no effect.
+  void updateTimedOrReady(ticks_t time);
 
   /// Return whether the condition is met for the specified value.
   bool valueMeetsCondition(uint32_t value) const;
@@ -144,6 +170,13 @@ private:
   void scheduleUpdateIfNeededOutputPort();
   void scheduleUpdateIfNeededInputPort();
   void scheduleUpdateIfNeeded();
+  /// Schedule an update through the clock block so ports clocked together are
+  /// updated from a single scheduler event.
+  void scheduleUpdate(ticks_t time);
+  /// Cancel any update scheduled through the clock block.
+  void cancelUpdate() {
+    clock->cancelPortUpdate(this);
+  }
   bool isBuffered() const {
     return buffered;
   }
@@ -152,6 +185,7 @@ private:
   bool checkTransferWidth(uint32_t value);
 public:
   Port();
+  ~Port();
   std::string getName() const;
   Signal getPinsValue() const;
   bool setCInUse(Thread &thread, bool val, ticks_t time);
@@ -214,30 +248,44 @@ public:
 
   void clearBuf(Thread &thread, ticks_t time);
 
+  /// Update the pin buffer with the change.
+  void seePinsChange(const Signal &value, ticks_t time);
+
+  /// Connect the pins of the port. The port takes ownership of the
+  /// connection.
+  void connect(PortConnection *c) { connection = c; }
+  bool isConnected() const { return connection != 0; }
+
+  /// Record changes to the value on the pins as the specified signal.
+  void setWaveform(Waveform *w, unsigned signal) {
+    waveform = w;
+    waveformSignal = signal;
+  }
+
   void registerAsSourceOf(ClockBlock *c) {
-    sourceOf.insert(c);
+    sourceOf.insert_unique(c);
     scheduleUpdateIfNeeded();
   }
 
   void deregisterAsSourceOf(ClockBlock *c) {
-    sourceOf.erase(c);
+    sourceOf.erase_value(c);
   }
   
   void registerAsReadyInOf(ClockBlock *c) {
-    readyInOf.insert(c);
+    readyInOf.insert_unique(c);
     scheduleUpdateIfNeeded();
   }
   
   void deregisterAsReadyInOf(ClockBlock *c) {
-    readyInOf.erase(c);
+    readyInOf.erase_value(c);
   }
 
   void attachReadyOut(Port &p) {
-    readyOutPorts.insert(&p);
+    readyOutPorts.insert_unique(&p);
   }
 
   void detachReadyOut(Port &p) {
-    readyOutPorts.erase(&p);
+    readyOutPorts.erase_value(&p);
   }
 
   /// Returns the number of rising edges before the first port width bits of the
@@ -283,4 +331,27 @@ protected:
   bool seeEventEnable(ticks_t time);
 };
 
+/// Something outside the chip that the pins of a port are connected to.
+class PortConnection {
+public:
+  virtual ~PortConnection() {}
+  /// Called when the value the port drives on its pins changes.
+  virtual void drive(Signal value, ticks_t time) = 0;
+};
+
+/// Connects the pins of one port to the pins of another. Changes are queued
+/// and delivered from the scheduler so a port is never updated while it is
+/// itself being updated.
+class LoopbackWire : public Runnable, public PortConnection {
+  SystemState &system;
+  Port &dest;
+  std::deque<std::pair<ticks_t,Signal> > pending;
+  bool scheduled;
+public:
+  LoopbackWire(SystemState &sys, Port &d) :
+    system(sys), dest(d), scheduled(false) {}
+  void drive(Signal value, ticks_t time);
+  void run(ticks_t time);
+};
+
 #endif // _Port_h_
@@ -0,0 +1,542 @@
+// Copyright (c) 2012, Richard Osborne, All rights reserved
+// This software is freely distributable under a derivative of the
+// University of Illinois/NCSA Open Source License posted in
+// LICENSE.txt and at <http://github.xcore.com/>
+
+#include "Profiler.h"
+#include "Core.h"
+#include "Node.h"
+#include "SystemState.h"
+#include "SymbolInfo.h"
+#include "Instruction.h"
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+Profiler Profiler::instance;
+
+CallNode::~CallNode()
+{
+  for (std::map<uint32_t,CallNode*>::iterator it = children.begin(),
+       e = children.end(); it != e; ++it) {
+    delete it->second;
+  }
+}
+
+CallNode *CallNode::getChild(uint32_t childPc)
+{
+  CallNode *&child = children[childPc];
+  if (!child)
+    child = new CallNode(childPc, this);
+  return child;
+}
+
+Profiler::~Profiler()
+{
+  for (std::vector<CallStack*>::iterator it = callStacks.begin(),
+       e = callStacks.end(); it != e; ++it) {
+    delete *it;
+  }
+}
+
+void Profiler::setSampling(Mode m, uint64_t p)
+{
+  sampling = true;
+  mode = m;
+  period = p;
+}
+
+void Profiler::initExact(SystemState &system)
+{
+  for (SystemState::node_iterator outerIt = system.node_begin(),
+       outerE = system.node_end(); outerIt != outerE; ++outerIt) {
+    Node &node = **outerIt;
+    for (Node::core_iterator innerIt = node.core_begin(),
+         innerE = node.core_end(); innerIt != innerE; ++innerIt) {
+      Core &core = **innerIt;
+      if (!core.pcProfile)
+        core.pcProfile = new PCProfile[core.ram_size >> 1]();
+    }
+  }
+}
+
+void Profiler::initCallGraph(SystemState &system, const SymbolInfo &symbols)
+{
+  callGraphSymInfo = &symbols;
+  for (SystemState::node_iterator outerIt = system.node_begin(),
+       outerE = system.node_end(); outerIt != outerE; ++outerIt) {
+    Node &node = **outerIt;
+    for (Node::core_iterator innerIt = node.core_begin(),
+         innerE = node.core_end(); innerIt != innerE; ++innerIt) {
+      Core &core = **innerIt;
+      for (unsigned i = 0, e = core.getNumThreads(); i != e; ++i) {
+        Thread &t = core.getThread(i);
+        if (t.callStack)
+          continue;
+        t.callStack = new CallStack(t);
+        t.callStack->lastTime = t.time;
+        callStacks.push_back(t.callStack);
+      }
+    }
+  }
+}
+
+void Profiler::sample(Thread &t)
+{
+  uint64_t now = getSampleClock(t);
+  uint64_t next = t.nextProfileSample;
+  if (next == 0)
+    next = now;
+  // If the thread was paused the samples it missed are attributed to the
+  // instruction it was paused on.
+  uint64_t weight = 1 + (now - next) / period;
+  samples[std::make_pair(&t.getParent(), t.getNum())][t.pc] += weight;
+  t.nextProfileSample = next + weight * period;
+}
+
+static std::string
+getFunctionName(const SymbolInfo &symInfo, const Core *core, uint32_t address)
+{
+  if (const ElfSymbol *sym = symInfo.getFunctionSymbol(core, address))
+    return sym->name;
+  std::ostringstream buf;
+  buf << "0x" << std::hex << address;
+  return buf.str();
+}
+
+CallNode *Profiler::
+getOutermostFunction(CallStack &stack, const Thread &t, uint32_t pc)
+{
+  // The call into the function wasn't seen. Look up the start of the
+  // function containing the pc so all its instructions share a node.
+  const Core &core = t.getParent();
+  if (const ElfSymbol *sym =
+      callGraphSymInfo->getFunctionSymbol(&core, core.targetPc(pc))) {
+    pc = core.physicalAddress(sym->value) >> 1;
+  }
+  return stack.root.getChild(pc);
+}
+
+void Profiler::
+attributeCycles(CallStack &stack, const Thread &t, uint32_t pc)
+{
+  if (!stack.current)
+    stack.current = getOutermostFunction(stack, t, pc);
+  stack.current->cycles += t.time - stack.lastTime;
+  stack.lastTime = t.time;
+}
+
+void Profiler::call(const Thread &t, uint32_t pc, uint32_t target)
+{
+  CallStack &stack = *t.callStack;
+  attributeCycles(stack, t, pc);
+  stack.current = stack.current->getChild(target);
+}
+
+void Profiler::ret(const Thread &t, uint32_t pc, uint32_t target)
+{
+  CallStack &stack = *t.callStack;
+  attributeCycles(stack, t, pc);
+  if (stack.current->parent != &stack.root)
+    stack.current = stack.current->parent;
+  else
+    stack.current = getOutermostFunction(stack, t, target);
+}
+
+void Profiler::resetCallStack(const Thread &t)
+{
+  CallStack &stack = *t.callStack;
+  stack.current = 0;
+  stack.lastTime = t.time;
+}
+
+void Profiler::flushCallStacks()
+{
+  for (std::vector<CallStack*>::iterator it = callStacks.begin(),
+       e = callStacks.end(); it != e; ++it) {
+    CallStack &stack = **it;
+    const Thread &t = *stack.thread;
+    if (t.time > stack.lastTime)
+      attributeCycles(stack, t, t.pc);
+  }
+}
+
+namespace {
+  struct FunctionSamples {
+    uint64_t count;
+    std::string name;
+    FunctionSamples(uint64_t c, const std::string &n) : count(c), name(n) {}
+    bool operator<(const FunctionSamples &other) const {
+      if (count != other.count)
+        return count > other.count;
+      return name < other.name;
+    }
+  };
+}
+
+void Profiler::report(std::ostream &out, const SymbolInfo &symInfo) const
+{
+  std::map<std::pair<const Core*,std::string>,uint64_t> functions;
+  std::map<const Core*,bool> cores;
+  uint64_t total = 0;
+  for (std::map<std::pair<const Core*,unsigned>,PCSamples>::const_iterator
+       outerIt = samples.begin(), outerE = samples.end(); outerIt != outerE;
+       ++outerIt) {
+    const Core *core = outerIt->first.first;
+    cores[core] = true;
+    for (PCSamples::const_iterator innerIt = outerIt->second.begin(),
+         innerE = outerIt->second.end(); innerIt != innerE; ++innerIt) {
+      std::string name =
+        getFunctionName(symInfo, core, core->targetPc(innerIt->first));
+      functions[std::make_pair(core, name)] += innerIt->second;
+      total += innerIt->second;
+    }
+  }
+  std::vector<FunctionSamples> sorted;
+  for (std::map<std::pair<const Core*,std::string>,uint64_t>::const_iterator
+       it = functions.begin(), e = functions.end(); it != e; ++it) {
+    std::string name = it->first.second;
+    if (cores.size() > 1)
+      name += " (" + it->first.first->getCoreName() + ")";
+    sorted.push_back(FunctionSamples(it->second, name));
+  }
+  std::sort(sorted.begin(), sorted.end());
+
+  out << "Profile: " << total << " samples, one every " << period
+      << (mode == SAMPLE_INSTRUCTIONS ? " instructions" : " cycles")
+      << " per thread\n";
+  out << "       %    Samples  Function\n";
+  for (std::vector<FunctionSamples>::const_iterator it = sorted.begin(),
+       e = sorted.end(); it != e; ++it) {
+    std::ostringstream percent;
+    percent << std::fixed << std::setprecision(2)
+            << (total ? 100.0 * it->count / total : 0) << '%';
+    out << std::setw(8) << percent.str() << std::setw(11) << it->count
+        << "  " << it->name << '\n';
+  }
+}
+
+bool Profiler::
+writeCallgrind(const std::string &filename, const SymbolInfo &symInfo) const
+{
+  std::ofstream out(filename.c_str());
+  if (!out)
+    return false;
+  // Combine the samples of the threads on each core.
+  std::map<const Core*,PCSamples> coreSamples;
+  for (std::map<std::pair<const Core*,unsigned>,PCSamples>::const_iterator
+       outerIt = samples.begin(), outerE = samples.end(); outerIt != outerE;
+       ++outerIt) {
+    PCSamples &dest = coreSamples[outerIt->first.first];
+    for (PCSamples::const_iterator innerIt = outerIt->second.begin(),
+         innerE = outerIt->second.end(); innerIt != innerE; ++innerIt) {
+      dest[innerIt->first] += innerIt->second;
+    }
+  }
+  out << "# callgrind format\n";
+  out << "version: 1\n";
+  out << "creator: axe\n";
+  out << "positions: instr\n";
+  // Each sample is scaled by the period to estimate the cost.
+  out << "events: "
+      << (mode == SAMPLE_INSTRUCTIONS ? "Instructions" : "Cycles") << "\n";
+  for (std::map<const Core*,PCSamples>::const_iterator
+       outerIt = coreSamples.begin(), outerE = coreSamples.end();
+       outerIt != outerE; ++outerIt) {
+    const Core *core = outerIt->first;
+    out << "\nob=" << core->getCoreName() << "\n";
+    out << "fl=???\n";
+    std::string lastFunction;
+    for (PCSamples::const_iterator innerIt = outerIt->second.begin(),
+         innerE = outerIt->second.end(); innerIt != innerE; ++innerIt) {
+      uint32_t address = core->targetPc(innerIt->first);
+      std::string function = getFunctionName(symInfo, core, address);
+      if (function != lastFunction) {
+        out << "fn=" << function << "\n";
+        lastFunction = function;
+      }
+      out << "0x" << std::hex << address << std::dec << ' '
+          << innerIt->second * period << '\n';
+    }
+  }
+  return out.good();
+}
+
+namespace {
+  /// A run of consecutive instructions in a function executed the same
+  /// number of times.
+  struct Block {
+    uint32_t start;
+    uint32_t end;
+    uint64_t count;
+    uint64_t cycles;
+    Block(uint32_t s, uint32_t e, uint64_t n, uint64_t c) :
+      start(s), end(e), count(n), cycles(c) {}
+    bool operator<(const Block &other) const {
+      if (cycles != other.cycles)
+        return cycles > other.cycles;
+      return start < other.start;
+    }
+  };
+
+  struct FunctionProfile {
+    const Core *core;
+    std::string name;
+    uint64_t instructions;
+    uint64_t cycles;
+    std::vector<Block> blocks;
+    FunctionProfile() : core(0), instructions(0), cycles(0) {}
+    bool operator<(const FunctionProfile &other) const {
+      if (cycles != other.cycles)
+        return cycles > other.cycles;
+      return name < other.name;
+    }
+  };
+}
+
+/// Decode the instruction at the specified pc. Returns the number of shorts
+/// it occupies.
+static unsigned
+decodeInstruction(const Core &core, uint32_t pc, InstructionOpcode &opcode,
+                  uint16_t &low, uint16_t &high)
+{
+  uint32_t address = pc << 1;
+  bool highValid = address + 3 < core.ram_size;
+  low = core.loadShort(address);
+  high = highValid ? core.loadShort(address + 2) : 0;
+  Operands operands;
+  instructionDecode(low, high, highValid, opcode, operands);
+  return isLongInstruction(opcode) ? 2 : 1;
+}
+
+static void
+addFunctionProfiles(const Core &core, const SymbolInfo &symInfo,
+                    std::vector<FunctionProfile> &profiles)
+{
+  std::map<std::string,FunctionProfile> functions;
+  const uint32_t numPcs = core.ram_size >> 1;
+  for (uint32_t pc = 0; pc < numPcs;) {
+    const PCProfile &entry = core.pcProfile[pc];
+    if (entry.count == 0) {
+      pc++;
+      continue;
+    }
+    InstructionOpcode opcode;
+    uint16_t low, high;
+    unsigned size = decodeInstruction(core, pc, opcode, low, high);
+    std::string name = getFunctionName(symInfo, &core, core.targetPc(pc));
+    FunctionProfile &function = functions[name];
+    function.core = &core;
+    function.name = name;
+    function.instructions += entry.count;
+    function.cycles += entry.cycles;
+    if (!function.blocks.empty() && function.blocks.back().end == pc &&
+        function.blocks.back().count == entry.count) {
+      function.blocks.back().end = pc + size;
+      function.blocks.back().cycles += entry.cycles;
+    } else {
+      function.blocks.push_back(Block(pc, pc + size, entry.count,
+                                      entry.cycles));
+    }
+    pc += size;
+  }
+  for (std::map<std::string,FunctionProfile>::iterator it = functions.begin(),
+       e = functions.end(); it != e; ++it) {
+    profiles.push_back(it->second);
+  }
+}
+
+bool Profiler::
+writeExact(const std::string &filename, SystemState &system,
+           const SymbolInfo &symInfo) const
+{
+  std::ofstream out(filename.c_str());
+  if (!out)
+    return false;
+  std::vector<FunctionProfile> profiles;
+  unsigned numCores = 0;
+  for (SystemState::const_node_iterator outerIt = system.node_begin(),
+       outerE = system.node_end(); outerIt != outerE; ++outerIt) {
+    const Node &node = **outerIt;
+    for (Node::const_core_iterator innerIt = node.core_begin(),
+         innerE = node.core_end(); innerIt != innerE; ++innerIt) {
+      const Core &core = **innerIt;
+      if (!core.pcProfile)
+        continue;
+      addFunctionProfiles(core, symInfo, profiles);
+      numCores++;
+    }
+  }
+  std::sort(profiles.begin(), profiles.end());
+  uint64_t totalCycles = 0;
+  for (std::vector<FunctionProfile>::const_iterator it = profiles.begin(),
+       e = profiles.end(); it != e; ++it) {
+    totalCycles += it->cycles;
+  }
+
+  for (std::vector<FunctionProfile>::iterator it = profiles.begin(),
+       e = profiles.end(); it != e; ++it) {
+    FunctionProfile &function = *it;
+    const Core &core = *function.core;
+    std::ostringstream percent;
+    percent << std::fixed << std::setprecision(2)
+            << (totalCycles ? 100.0 * function.cycles / totalCycles : 0);
+    out << "Function " << function.name;
+    if (numCores > 1)
+      out << " (" << core.getCoreName() << ")";
+    out << ": " << function.instructions << " instructions, "
+        << function.cycles << " cycles (" << percent.str() << "%)\n";
+    std::sort(function.blocks.begin(), function.blocks.end());
+    for (std::vector<Block>::const_iterator blockIt = function.blocks.begin(),
+         blockE = function.blocks.end(); blockIt != blockE; ++blockIt) {
+      out << "\n  Block 0x" << std::hex << std::setfill('0')
+          << std::setw(8) << core.targetPc(blockIt->start) << std::dec
+          << std::setfill(' ') << ": " << blockIt->count << " executions, "
+          << blockIt->cycles << " cycles\n";
+      out << "           Count       Cycles  Address     Encoding   "
+             "Instruction\n";
+      for (uint32_t pc = blockIt->start; pc < blockIt->end;) {
+        InstructionOpcode opcode;
+        uint16_t low, high;
+        unsigned size = decodeInstruction(core, pc, opcode, low, high);
+        const PCProfile &entry = core.pcProfile[pc];
+        out << "    " << std::setw(12) << entry.count << ' '
+            << std::setw(12) << entry.cycles << "  0x" << std::hex
+            << std::setfill('0') << std::setw(8) << core.targetPc(pc) << "  "
+            << std::setw(4) << low;
+        if (size == 2)
+          out << ' ' << std::setw(4) << high;
+        else
+          out << "     ";
+        out << std::dec << std::setfill(' ') << "  "
+            << getInstructionName(opcode) << '\n';
+        pc += size;
+      }
+    }
+    out << "\n";
+  }
+  return out.good();
+}
+
+namespace {
+  struct FunctionTimes {
+    uint64_t inclusive;
+    uint64_t exclusive;
+    std::string name;
+    FunctionTimes() : inclusive(0), exclusive(0) {}
+    bool operator<(const FunctionTimes &other) const {
+      if (inclusive != other.inclusive)
+        return inclusive > other.inclusive;
+      return name < other.name;
+    }
+  };
+  typedef std::map<std::pair<const Core*,std::string>,FunctionTimes>
+    FunctionTimesMap;
+}
+
+/// Add the cycles spent in the node and its callees to the times of the
+/// functions. Returns the cycles spent in the node including its callees.
+static uint64_t
+addFunctionTimes(const Core &core, const CallNode &node,
+                 const SymbolInfo &symInfo,
+                 std::map<std::string,unsigned> &onStack,
+                 FunctionTimesMap &functions)
+{
+  std::string name = getFunctionName(symInfo, &core, core.targetPc(node.pc));
+  unsigned &depth = onStack[name];
+  depth++;
+  uint64_t total = node.cycles;
+  for (std::map<uint32_t,CallNode*>::const_iterator
+       it = node.children.begin(), e = node.children.end(); it != e; ++it) {
+    total += addFunctionTimes(core, *it->second, symInfo, onStack, functions);
+  }
+  depth--;
+  FunctionTimes &times = functions[std::make_pair(&core, name)];
+  times.exclusive += node.cycles;
+  // Count recursive calls once in the inclusive time.
+  if (depth == 0)
+    times.inclusive += total;
+  return total;
+}
+
+void Profiler::reportCallGraph(std::ostream &out, const SymbolInfo &symInfo)
+{
+  flushCallStacks();
+  FunctionTimesMap functions;
+  std::map<const Core*,bool> cores;
+  uint64_t total = 0;
+  for (std::vector<CallStack*>::const_iterator it = callStacks.begin(),
+       e = callStacks.end(); it != e; ++it) {
+    const CallStack &stack = **it;
+    const Core &core = stack.thread->getParent();
+    std::map<std::string,unsigned> onStack;
+    for (std::map<uint32_t,CallNode*>::const_iterator
+         childIt = stack.root.children.begin(),
+         childE = stack.root.children.end(); childIt != childE; ++childIt) {
+      cores[&core] = true;
+      total += addFunctionTimes(core, *childIt->second, symInfo, onStack,
+                                functions);
+    }
+  }
+  std::vector<FunctionTimes> sorted;
+  for (FunctionTimesMap::const_iterator it = functions.begin(),
+       e = functions.end(); it != e; ++it) {
+    sorted.push_back(it->second);
+    sorted.back().name = it->first.second;
+    if (cores.size() > 1)
+      sorted.back().name += " (" + it->first.first->getCoreName() + ")";
+  }
+  std::sort(sorted.begin(), sorted.end());
+
+  out << "Call graph: " << total << " cycles\n";
+  out << "       %   Inclusive   Exclusive  Function\n";
+  for (std::vector<FunctionTimes>::const_iterator it = sorted.begin(),
+       e = sorted.end(); it != e; ++it) {
+    std::ostringstream percent;
+    percent << std::fixed << std::setprecision(2)
+            << (total ? 100.0 * it->inclusive / total : 0) << '%';
+    out << std::setw(8) << percent.str() << std::setw(12) << it->inclusive
+        << std::setw(12) << it->exclusive << "  " << it->name << '\n';
+  }
+}
+
+static void
+writeCollapsedStacks(std::ostream &out, const Core &core, const CallNode &node,
+                     const std::string &prefix, const SymbolInfo &symInfo)
+{
+  std::string stack =
+    prefix + ';' + getFunctionName(symInfo, &core, core.targetPc(node.pc));
+  if (node.cycles)
+    out << stack << ' ' << node.cycles << '\n';
+  for (std::map<uint32_t,CallNode*>::const_iterator
+       it = node.children.begin(), e = node.children.end(); it != e; ++it) {
+    writeCollapsedStacks(out, core, *it->second, stack, symInfo);
+  }
+}
+
+bool Profiler::
+writeCallGraph(const std::string &filename, const SymbolInfo &symInfo)
+{
+  std::ofstream out(filename.c_str());
+  if (!out)
+    return false;
+  flushCallStacks();
+  for (std::vector<CallStack*>::const_iterator it = callStacks.begin(),
+       e = callStacks.end(); it != e; ++it) {
+    const CallStack &stack = **it;
+    const Thread &t = *stack.thread;
+    const Core &core = t.getParent();
+    std::ostringstream prefix;
+    prefix << core.getCoreName() << ":t" << t.getNum();
+    for (std::map<uint32_t,CallNode*>::const_iterator
+         childIt = stack.root.children.begin(),
+         childE = stack.root.children.end(); childIt != childE; ++childIt) {
+      writeCollapsedStacks(out, core, *childIt->second, prefix.str(),
+                           symInfo);
+    }
+  }
+  return out.good();
+}
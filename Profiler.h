@@ -0,0 +1,150 @@
+// Copyright (c) 2012, Richard Osborne, All rights reserved
+// This software is freely distributable under a derivative of the
+// University of Illinois/NCSA Open Source License posted in
+// LICENSE.txt and at <http://github.xcore.com/>
+
+#ifndef _Profiler_h_
+#define _Profiler_h_
+
+#include "Thread.h"
+#include <iosfwd>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+class Core;
+class SymbolInfo;
+class SystemState;
+
+/// Execution counts for an instruction, collected by the exact profiler.
+struct PCProfile {
+  uint64_t count;
+  uint64_t cycles;
+};
+
+/// A node in the calling context tree built by the call graph profiler.
+struct CallNode {
+  /// The pc of the start of the function.
+  uint32_t pc;
+  CallNode *parent;
+  /// Cycles spent in the function excluding its callees.
+  uint64_t cycles;
+  std::map<uint32_t,CallNode*> children;
+
+  CallNode(uint32_t p, CallNode *par) : pc(p), parent(par), cycles(0) {}
+  ~CallNode();
+  CallNode *getChild(uint32_t childPc);
+};
+
+/// Shadow call stack of a thread, maintained by the call and return
+/// instructions when the call graph is profiled.
+struct CallStack {
+  const Thread *thread;
+  /// The root of the tree. The children of the root are the outermost
+  /// functions the thread was seen in.
+  CallNode root;
+  /// The function the thread is executing, or null if it isn't yet known.
+  CallNode *current;
+  /// The time up to which cycles have been attributed.
+  ticks_t lastTime;
+
+  CallStack(const Thread &t) : thread(&t), root(0, 0), current(0),
+    lastTime(0) {}
+};
+
+/// Profiler for the simulated program. In sampling mode the pc of each thread
+/// is recorded every period cycles or every period instructions executed by
+/// the thread. In exact mode every instruction executed is counted in an
+/// array parallel to the opcode cache of the core. When the call graph is
+/// profiled a shadow call stack is kept for each thread and the cycles
+/// between calls and returns are attributed to the function being executed.
+class Profiler {
+public:
+  enum Mode {
+    SAMPLE_CYCLES,
+    SAMPLE_INSTRUCTIONS
+  };
+private:
+  Profiler() :
+    sampling(false),
+    exact(false),
+    callGraph(false),
+    mode(SAMPLE_CYCLES),
+    period(0),
+    callGraphSymInfo(0) {}
+  ~Profiler();
+  bool sampling;
+  bool exact;
+  bool callGraph;
+  Mode mode;
+  uint64_t period;
+  /// Number of samples for each pc, indexed by core and thread number.
+  typedef std::map<uint32_t,uint64_t> PCSamples;
+  std::map<std::pair<const Core*,unsigned>,PCSamples> samples;
+  /// Symbols used to find the function a thread is in when it returns from
+  /// the outermost function on its call stack.
+  const SymbolInfo *callGraphSymInfo;
+  std::vector<CallStack*> callStacks;
+
+  CallNode *getOutermostFunction(CallStack &stack, const Thread &t,
+                                 uint32_t pc);
+  void attributeCycles(CallStack &stack, const Thread &t, uint32_t pc);
+  /// Attribute the cycles since the last call or return of each thread.
+  void flushCallStacks();
+
+  static Profiler instance;
+public:
+  /// Enable sampling every period cycles or instructions.
+  void setSampling(Mode m, uint64_t p);
+  bool getSampling() const { return sampling; }
+  /// Enable counting of every instruction executed.
+  void setExact() { exact = true; }
+  bool getExact() const { return exact; }
+  /// Enable profiling of the call graph.
+  void setCallGraph() { callGraph = true; }
+  bool getCallGraph() const { return callGraph; }
+  bool getEnabled() const { return sampling || exact || callGraph; }
+  /// Allocate the exact profile counters of each core.
+  void initExact(SystemState &system);
+  /// Allocate a call stack for every thread.
+  void initCallGraph(SystemState &system, const SymbolInfo &symbols);
+
+  /// Returns the value compared with Thread::nextProfileSample.
+  uint64_t getSampleClock(const Thread &t) const
+  {
+    return mode == SAMPLE_INSTRUCTIONS ? uint64_t(t.count) : t.time;
+  }
+  /// Record a sample for the thread and schedule its next sample.
+  void sample(Thread &t);
+
+  /// Called after the thread executes a call from pc to target.
+  void call(const Thread &t, uint32_t pc, uint32_t target);
+  /// Called after the thread executes a return from pc to target.
+  void ret(const Thread &t, uint32_t pc, uint32_t target);
+  /// Forget the call stack of a thread when it is allocated.
+  void resetCallStack(const Thread &t);
+
+  /// Print the samples aggregated by function.
+  void report(std::ostream &out, const SymbolInfo &symInfo) const;
+  /// Write the samples in the callgrind format. Returns false if the file
+  /// cannot be written.
+  bool writeCallgrind(const std::string &filename,
+                      const SymbolInfo &symInfo) const;
+  /// Write the exact profile as an annotated listing of each function. The
+  /// functions and the blocks in each function are ordered by the cycles
+  /// spent in them. Returns false if the file cannot be written.
+  bool writeExact(const std::string &filename, SystemState &system,
+                  const SymbolInfo &symInfo) const;
+
+  /// Print the inclusive and exclusive cycles of each function.
+  void reportCallGraph(std::ostream &out, const SymbolInfo &symInfo);
+  /// Write the call graph as collapsed stacks, one line per calling context
+  /// with the cycles spent in it, for use with flame graph tools. Returns
+  /// false if the file cannot be written.
+  bool writeCallGraph(const std::string &filename, const SymbolInfo &symInfo);
+
+  static Profiler &get() { return instance; }
+};
+
+#endif // _Profiler_h_
@@ -185,3 +185,8 @@ void EventableResource::scheduleUpdate(ticks_t time)
   getOwner().getParent().getParent()->getParent()->scheduleOther(*this, time);
 }
 
+void EventableResource::cancelUpdate()
+{
+  getOwner().getParent().getParent()->getParent()->unschedule(*this);
+}
+
@@ -150,6 +150,7 @@ private:
   ResourceID ID;
 public:
   static const char *getResourceName(ResourceType type);
+  virtual ~Resource() {}
   bool isInUse() const
   {
     return inUse;
@@ -302,6 +303,8 @@ protected:
   virtual bool seeEventEnable(ticks_t time) = 0;
 
   void scheduleUpdate(ticks_t time);
+  /// Remove any update scheduled with scheduleUpdate().
+  void cancelUpdate();
 public:
   bool hasOwner() { return owner != 0; }
   Thread &getOwner() { return *owner; }
@@ -19,12 +19,13 @@ private:
     }
   };
   Sentinel head;
-  bool contains(Runnable &thread) const
+public:
+  RunnableQueue() {}
+
+  bool contains(const Runnable &thread) const
   {
     return thread.prev != 0;
   }
-public:
-  RunnableQueue() {}
   
   Runnable &front() const
   {
@@ -35,6 +36,16 @@ public:
   {
     return !head.next;
   }
+
+  /// Returns the number of runnables in the queue. This walks the queue so
+  /// it should only be used for reporting.
+  unsigned size() const
+  {
+    unsigned count = 0;
+    for (const Runnable *p = head.next; p; p = p->next)
+      count++;
+    return count;
+  }
   
   void remove(Runnable &thread)
   {
@@ -0,0 +1,484 @@
+// Copyright (c) 2012, Richard Osborne, All rights reserved
+// This software is freely distributable under a derivative of the
+// University of Illinois/NCSA Open Source License posted in
+// LICENSE.txt and at <http://github.xcore.com/>
+
+#include "SpinLoop.h"
+#include "Core.h"
+#include "SystemState.h"
+#include "Thread.h"
+#include "Timer.h"
+#include <algorithm>
+#include <bitset>
+#include <memory>
+
+namespace {
+  /// Maximum length of a spin loop in 16 bit instruction words.
+  const unsigned maxLoopSize = 32;
+  const uint64_t timerValues = uint64_t(1) << 32;
+
+  /// A register's value as a function of the timer value t read in the
+  /// current iteration.
+  struct Value {
+    enum Kind {
+      UNKNOWN,
+      /// The value is offset.
+      CONSTANT,
+      /// The value is sign * t + offset.
+      LINEAR,
+      /// The value is 1 if t lies in the range of length values starting at
+      /// offset, wrapping modulo 2^32, otherwise 0.
+      RANGE
+    } kind;
+    uint32_t offset;
+    int sign;
+    uint64_t length;
+  };
+
+  Value unknown()
+  {
+    Value v;
+    v.kind = Value::UNKNOWN;
+    v.offset = 0;
+    v.sign = 0;
+    v.length = 0;
+    return v;
+  }
+
+  Value constant(uint32_t value)
+  {
+    Value v = unknown();
+    v.kind = Value::CONSTANT;
+    v.offset = value;
+    return v;
+  }
+
+  Value linear(int sign, uint32_t offset)
+  {
+    Value v = unknown();
+    v.kind = Value::LINEAR;
+    v.sign = sign;
+    v.offset = offset;
+    return v;
+  }
+
+  Value range(uint32_t start, uint64_t length)
+  {
+    if (length == 0)
+      return constant(0);
+    if (length >= timerValues)
+      return constant(1);
+    Value v = unknown();
+    v.kind = Value::RANGE;
+    v.offset = start;
+    v.length = length;
+    return v;
+  }
+
+  bool inRange(uint32_t value, uint32_t start, uint64_t length)
+  {
+    return uint32_t(value - start) < length;
+  }
+
+  /// Returns a value which is 1 if v lies in the range of length values
+  /// starting at start, otherwise 0.
+  Value valueInRange(const Value &v, uint32_t start, uint64_t length)
+  {
+    switch (v.kind) {
+    default:
+      return unknown();
+    case Value::CONSTANT:
+      return constant(inRange(v.offset, start, length));
+    case Value::LINEAR:
+      if (v.sign > 0)
+        return range(start - v.offset, length);
+      return range(v.offset - start - uint32_t(length) + 1, length);
+    case Value::RANGE:
+      {
+        bool zero = inRange(0, start, length);
+        bool one = inRange(1, start, length);
+        if (zero == one)
+          return constant(zero);
+        if (one)
+          return v;
+        return range(v.offset + uint32_t(v.length), timerValues - v.length);
+      }
+    }
+  }
+
+  Value add(const Value &a, const Value &b)
+  {
+    if (a.kind == Value::CONSTANT && b.kind == Value::CONSTANT)
+      return constant(a.offset + b.offset);
+    if (a.kind == Value::LINEAR && b.kind == Value::CONSTANT)
+      return linear(a.sign, a.offset + b.offset);
+    if (a.kind == Value::CONSTANT && b.kind == Value::LINEAR)
+      return linear(b.sign, a.offset + b.offset);
+    if (a.kind == Value::LINEAR && b.kind == Value::LINEAR &&
+        a.sign != b.sign)
+      return constant(a.offset + b.offset);
+    return unknown();
+  }
+
+  Value neg(const Value &a)
+  {
+    if (a.kind == Value::CONSTANT)
+      return constant(-a.offset);
+    if (a.kind == Value::LINEAR)
+      return linear(-a.sign, -a.offset);
+    return unknown();
+  }
+
+  Value sub(const Value &a, const Value &b)
+  {
+    return add(a, neg(b));
+  }
+
+  Value eq(const Value &a, const Value &b)
+  {
+    if (b.kind == Value::CONSTANT)
+      return valueInRange(a, b.offset, 1);
+    if (a.kind == Value::CONSTANT)
+      return valueInRange(b, a.offset, 1);
+    if (a.kind == Value::LINEAR && b.kind == Value::LINEAR &&
+        a.sign == b.sign)
+      return constant(a.offset == b.offset);
+    return unknown();
+  }
+
+  /// Returns a value which is 1 if a < b, otherwise 0. Signed comparisons are
+  /// performed by biasing the values so the most negative value is zero.
+  Value lessThan(const Value &a, const Value &b, uint32_t bias)
+  {
+    if (b.kind == Value::CONSTANT)
+      return valueInRange(a, -bias, uint32_t(b.offset + bias));
+    if (a.kind == Value::CONSTANT) {
+      return valueInRange(b, a.offset + 1,
+                          timerValues - 1 - uint32_t(a.offset + bias));
+    }
+    return unknown();
+  }
+
+  bool isSpinLoopBranch(InstructionOpcode opcode)
+  {
+    switch (opcode) {
+    default:
+      return false;
+    case BRBT_ru6:
+    case BRBT_lru6:
+    case BRBF_ru6:
+    case BRBF_lru6:
+    case BRBU_u6:
+    case BRBU_lu6:
+      return true;
+    }
+  }
+
+  InstructionOpcode getSpinLoopOpcode(InstructionOpcode opcode)
+  {
+    switch (opcode) {
+    default:
+      assert(0 && "Unexpected opcode");
+      return opcode;
+    case BRBT_ru6: return BRBT_spin_ru6;
+    case BRBT_lru6: return BRBT_spin_lru6;
+    case BRBF_ru6: return BRBF_spin_ru6;
+    case BRBF_lru6: return BRBF_spin_lru6;
+    case BRBU_u6: return BRBU_spin_u6;
+    case BRBU_lu6: return BRBU_spin_lu6;
+    }
+  }
+
+  /// Find the registers read and written by an instruction permitted in the
+  /// body of a spin loop. Returns false if the instruction isn't permitted.
+  bool getRegisterUses(InstructionOpcode opcode, const Operands &ops,
+                       unsigned &numReads, unsigned reads[2], int &write)
+  {
+    numReads = 0;
+    write = -1;
+    switch (opcode) {
+    default:
+      return false;
+    case ADD_3r:
+    case SUB_3r:
+    case EQ_3r:
+    case LSS_3r:
+    case LSU_3r:
+      reads[numReads++] = ops.ops[1];
+      reads[numReads++] = ops.ops[2];
+      write = ops.ops[0];
+      return true;
+    case ADD_2rus:
+    case SUB_2rus:
+    case EQ_2rus:
+    case ADD_mov_2rus:
+    case NOT_2r:
+    case NEG_2r:
+    case IN_2r:
+      reads[numReads++] = ops.ops[1];
+      write = ops.ops[0];
+      return true;
+    case LDC_ru6:
+    case LDC_lru6:
+      write = ops.ops[0];
+      return true;
+    case BRFT_ru6:
+    case BRFT_lru6:
+    case BRFF_ru6:
+    case BRFF_lru6:
+      reads[numReads++] = ops.ops[0];
+      return true;
+    }
+  }
+}
+
+bool SpinLoop::matchesMemory(const Core &core) const
+{
+  for (unsigned i = 0, e = code.size(); i != e; ++i) {
+    if (uint16_t(core.loadShort((startPc + i) << 1)) != code[i])
+      return false;
+  }
+  return true;
+}
+
+void SpinLoop::
+transformBranch(Core &core, InstructionOpcode &opcode,
+                const Operands &operands, uint32_t pc)
+{
+  if (!isSpinLoopBranch(opcode))
+    return;
+  core.setSpinLoop(pc, 0);
+  bool conditional = opcode != BRBU_u6 && opcode != BRBU_lu6;
+  uint32_t start = conditional ? operands.ops[1] : operands.ops[0];
+  if (start >= pc || pc - start > maxLoopSize)
+    return;
+  std::auto_ptr<SpinLoop> loop(new SpinLoop);
+  loop->startPc = start;
+  loop->conditionAtEnd = conditional;
+  if (conditional) {
+    loop->conditionReg = operands.ops[0];
+    loop->continueIfTrue = opcode == BRBT_ru6 || opcode == BRBT_lru6;
+  }
+  // Decode the body.
+  bool foundInput = false;
+  bool foundExit = false;
+  std::bitset<NUM_REGISTERS> written;
+  for (uint32_t bodyPc = start; bodyPc != pc;) {
+    if (bodyPc > pc)
+      return;
+    uint16_t low = core.loadShort(bodyPc << 1);
+    uint16_t high = 0;
+    bool highValid = core.isValidAddress((bodyPc + 1) << 1);
+    if (highValid)
+      high = core.loadShort((bodyPc + 1) << 1);
+    Op op;
+    instructionDecode(low, high, highValid, op.opcode, op.operands);
+    instructionTransform(op.opcode, op.operands, bodyPc, core.ram_size, false);
+    unsigned numReads;
+    unsigned reads[2];
+    int write;
+    if (!getRegisterUses(op.opcode, op.operands, numReads, reads, write))
+      return;
+    switch (op.opcode) {
+    default:
+      break;
+    case IN_2r:
+      if (foundInput)
+        return;
+      foundInput = true;
+      loop->inputIndex = loop->body.size();
+      break;
+    case BRFT_ru6:
+    case BRFT_lru6:
+    case BRFF_ru6:
+    case BRFF_lru6:
+      // The only way out of a loop closed by an unconditional branch.
+      if (conditional || foundExit ||
+          (op.operands.ops[1] >= start && op.operands.ops[1] <= pc))
+        return;
+      foundExit = true;
+      loop->conditionReg = op.operands.ops[0];
+      loop->continueIfTrue = op.opcode == BRFF_ru6 || op.opcode == BRFF_lru6;
+      break;
+    }
+    if (write >= 0)
+      written.set(write);
+    loop->code.push_back(low);
+    if (isLongInstruction(op.opcode)) {
+      loop->code.push_back(high);
+      bodyPc += 2;
+    } else {
+      bodyPc++;
+    }
+    loop->body.push_back(op);
+  }
+  if (!foundInput || (!conditional && !foundExit))
+    return;
+  loop->code.push_back(core.loadShort(pc << 1));
+  if (isLongInstruction(opcode))
+    loop->code.push_back(core.loadShort((pc + 1) << 1));
+  // Check no value is carried from one iteration to the next.
+  std::bitset<NUM_REGISTERS> defined;
+  for (std::vector<Op>::const_iterator it = loop->body.begin(),
+       e = loop->body.end(); it != e; ++it) {
+    unsigned numReads;
+    unsigned reads[2];
+    int write;
+    getRegisterUses(it->opcode, it->operands, numReads, reads, write);
+    for (unsigned i = 0; i < numReads; i++) {
+      if (written[reads[i]] && !defined[reads[i]])
+        return;
+    }
+    if (write >= 0)
+      defined.set(write);
+  }
+  if (conditional && written[loop->conditionReg] &&
+      !defined[loop->conditionReg])
+    return;
+  core.setSpinLoop(pc, loop.release());
+  opcode = getSpinLoopOpcode(opcode);
+}
+
+void SpinLoop::evaluate(uint32_t *regs, uint32_t timerValue) const
+{
+  for (std::vector<Op>::const_iterator it = body.begin(), e = body.end();
+       it != e; ++it) {
+    const uint32_t *ops = it->operands.ops;
+    switch (it->opcode) {
+    default:
+      break;
+    case ADD_3r: regs[ops[0]] = regs[ops[1]] + regs[ops[2]]; break;
+    case SUB_3r: regs[ops[0]] = regs[ops[1]] - regs[ops[2]]; break;
+    case EQ_3r: regs[ops[0]] = regs[ops[1]] == regs[ops[2]]; break;
+    case LSS_3r:
+      regs[ops[0]] = int32_t(regs[ops[1]]) < int32_t(regs[ops[2]]);
+      break;
+    case LSU_3r: regs[ops[0]] = regs[ops[1]] < regs[ops[2]]; break;
+    case ADD_2rus: regs[ops[0]] = regs[ops[1]] + ops[2]; break;
+    case SUB_2rus: regs[ops[0]] = regs[ops[1]] - ops[2]; break;
+    case EQ_2rus: regs[ops[0]] = regs[ops[1]] == ops[2]; break;
+    case ADD_mov_2rus: regs[ops[0]] = regs[ops[1]]; break;
+    case NOT_2r: regs[ops[0]] = ~regs[ops[1]]; break;
+    case NEG_2r: regs[ops[0]] = -regs[ops[1]]; break;
+    case IN_2r: regs[ops[0]] = timerValue; break;
+    case LDC_ru6:
+    case LDC_lru6:
+      regs[ops[0]] = ops[1];
+      break;
+    }
+  }
+}
+
+void SpinLoop::skip(Thread &thread, SystemState &sys) const
+{
+  Core &core = thread.getParent();
+  if (!matchesMemory(core))
+    return;
+  // The time at the start of the next iteration.
+  const ticks_t startTime = thread.time + INSTRUCTION_CYCLES;
+  if (sys.hasTimeSliceExpired(startTime))
+    return;
+  // Work out the range of timer values for which the loop continues.
+  Value values[NUM_REGISTERS];
+  for (unsigned i = 0; i < NUM_REGISTERS; i++)
+    values[i] = constant(thread.regs[i]);
+  uint32_t timerID = 0;
+  Value condition = unknown();
+  for (std::vector<Op>::const_iterator it = body.begin(), e = body.end();
+       it != e; ++it) {
+    const uint32_t *ops = it->operands.ops;
+    switch (it->opcode) {
+    default:
+      break;
+    case BRFT_ru6:
+    case BRFT_lru6:
+    case BRFF_ru6:
+    case BRFF_lru6:
+      condition = values[conditionReg];
+      break;
+    case ADD_3r: values[ops[0]] = add(values[ops[1]], values[ops[2]]); break;
+    case SUB_3r: values[ops[0]] = sub(values[ops[1]], values[ops[2]]); break;
+    case EQ_3r: values[ops[0]] = eq(values[ops[1]], values[ops[2]]); break;
+    case LSS_3r:
+      values[ops[0]] = lessThan(values[ops[1]], values[ops[2]], 0x80000000);
+      break;
+    case LSU_3r:
+      values[ops[0]] = lessThan(values[ops[1]], values[ops[2]], 0);
+      break;
+    case ADD_2rus:
+      values[ops[0]] = add(values[ops[1]], constant(ops[2]));
+      break;
+    case SUB_2rus:
+      values[ops[0]] = sub(values[ops[1]], constant(ops[2]));
+      break;
+    case EQ_2rus:
+      values[ops[0]] = eq(values[ops[1]], constant(ops[2]));
+      break;
+    case ADD_mov_2rus: values[ops[0]] = values[ops[1]]; break;
+    case NOT_2r:
+      // ~x == -x - 1
+      values[ops[0]] = sub(neg(values[ops[1]]), constant(1));
+      break;
+    case NEG_2r: values[ops[0]] = neg(values[ops[1]]); break;
+    case IN_2r:
+      if (values[ops[1]].kind != Value::CONSTANT)
+        return;
+      timerID = values[ops[1]].offset;
+      values[ops[0]] = linear(1, 0);
+      break;
+    case LDC_ru6:
+    case LDC_lru6:
+      values[ops[0]] = constant(ops[1]);
+      break;
+    }
+  }
+  if (conditionAtEnd)
+    condition = values[conditionReg];
+  Value continues = continueIfTrue ?
+    valueInRange(condition, 1, timerValues - 1) :
+    valueInRange(condition, 0, 1);
+  if (continues.kind == Value::UNKNOWN ||
+      (continues.kind == Value::CONSTANT && continues.offset == 0))
+    return;
+  Resource *res = core.getResourceByID(ResourceID(timerID));
+  if (!res || !res->isInUse() || res->getType() != RES_TYPE_TIMER)
+    return;
+  Timer *timer = static_cast<Timer*>(res);
+  if (!timer->hasOwner() || &timer->getOwner() != &thread)
+    return;
+
+  const unsigned numInstructions = body.size() + 1;
+  const ticks_t period = numInstructions * INSTRUCTION_CYCLES;
+  if (period % CYCLES_PER_TICK != 0)
+    return;
+  const ticks_t inputDelay = inputIndex * INSTRUCTION_CYCLES;
+  // Number of iterations that continue the loop.
+  uint64_t iterations = ~uint64_t(0);
+  if (continues.kind == Value::RANGE) {
+    uint32_t timerValue = (startTime + inputDelay) / CYCLES_PER_TICK;
+    uint64_t position = uint32_t(timerValue - continues.offset);
+    if (position >= continues.length)
+      return;
+    uint64_t step = period / CYCLES_PER_TICK;
+    iterations = (continues.length - position + step - 1) / step;
+  }
+  // Don't run past the point where the thread would yield to another
+  // runnable, since it could interrupt the thread.
+  RunnableQueue &scheduler = sys.getScheduler();
+  if (!scheduler.empty()) {
+    iterations = std::min(iterations,
+                          (scheduler.front().wakeUpTime - startTime) / period);
+  } else if (iterations == ~uint64_t(0)) {
+    return;
+  }
+  if (iterations == 0)
+    return;
+  const ticks_t lastInputTime = startTime + (iterations - 1) * period +
+                                inputDelay;
+  if (!timer->inputsReadyBetween(startTime + inputDelay, lastInputTime))
+    return;
+  // Leave the registers as they were after the last skipped iteration.
+  evaluate(thread.regs, lastInputTime / CYCLES_PER_TICK);
+  thread.time += iterations * period;
+  thread.count += iterations * numInstructions;
+}
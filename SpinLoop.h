@@ -0,0 +1,71 @@
+// Copyright (c) 2012, Richard Osborne, All rights reserved
+// This software is freely distributable under a derivative of the
+// University of Illinois/NCSA Open Source License posted in
+// LICENSE.txt and at <http://github.xcore.com/>
+
+#ifndef _SpinLoop_h_
+#define _SpinLoop_h_
+
+#include "Config.h"
+#include "Instruction.h"
+#include <vector>
+
+class Core;
+class SystemState;
+class Thread;
+
+/// A short loop which polls a timer until the value read passes a limit, for
+/// example:
+///
+///   loop: in r0, res[r1]
+///         lss r0, r0, r2
+///         bt r0, loop
+///
+/// The body may only contain arithmetic and comparisons on registers, a single
+/// input from a timer and, if the loop is closed by an unconditional branch,
+/// a single forward branch leaving the loop. A register may only be read
+/// before it is written in an iteration if the loop never writes it. Each
+/// iteration then depends only on the value read from the timer, which
+/// increases by a fixed amount every iteration. This means the number of
+/// iterations before the loop exits can be computed directly and iterations
+/// skipped rather than interpreted.
+class SpinLoop {
+  struct Op {
+    InstructionOpcode opcode;
+    Operands operands;
+  };
+  /// The instructions the loop was decoded from, starting at startPc.
+  std::vector<uint16_t> code;
+  uint32_t startPc;
+  /// The body of the loop, excluding the backward branch.
+  std::vector<Op> body;
+  /// Index of the timer input in the body.
+  unsigned inputIndex;
+  /// Register holding the condition tested to leave or continue the loop.
+  unsigned conditionReg;
+  /// Is the condition tested by the backward branch rather than by a forward
+  /// branch in the body?
+  bool conditionAtEnd;
+  /// If true the loop continues while the condition is non zero, otherwise
+  /// it continues while the condition is zero.
+  bool continueIfTrue;
+
+  SpinLoop() {}
+  bool matchesMemory(const Core &core) const;
+  /// Evaluate the body with the specified timer value, updating the registers.
+  void evaluate(uint32_t *regs, uint32_t timerValue) const;
+public:
+  /// If the backward branch at the specified pc closes a spin loop, record the
+  /// loop in the core and replace the opcode with one that calls skip() when
+  /// the branch is taken.
+  static void transformBranch(Core &core, InstructionOpcode &opcode,
+                              const Operands &operands, uint32_t pc);
+
+  /// Called when the backward branch is taken, before the cycles of the
+  /// branch are added to the thread's time. Skips the iterations that would
+  /// continue the loop without leaving it, stopping early if the thread would
+  /// otherwise have to yield to another runnable.
+  void skip(Thread &thread, SystemState &sys) const;
+};
+
+#endif // _SpinLoop_h_
@@ -0,0 +1,506 @@
+// Copyright (c) 2012, Richard Osborne, All rights reserved
+// This software is freely distributable under a derivative of the
+// University of Illinois/NCSA Open Source License posted in
+// LICENSE.txt and at <http://github.xcore.com/>
+
+// axe-aot translates the basic blocks of the ELF images in an XE file into
+// C++ using the instruction implementations emitted by instgen and compiles
+// the result into a shared object. The shared object can be passed to axe
+// using --native to pre-populate the decode cache with native block handlers.
+
+#include <gelf.h>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <map>
+#include <set>
+#include <string>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "XE.h"
+#include "Config.h"
+#include "Instruction.h"
+#include "NativeCode.h"
+#include "ScopedArray.h"
+#include "AOTConfig.h"
+
+#define XCORE_ELF_MACHINE_OLD 0xB49E
+#define XCORE_ELF_MACHINE 0xCB
+
+static void printUsage(const char *ProgName) {
+  std::cout << "Usage: " << ProgName << " [options] input.xe output\n";
+  std::cout <<
+"General Options:\n"
+"  -h                 Display this information\n"
+"  -S                 Write the generated C++ instead of a shared object\n"
+"  --ram-base <addr>  Ram base the image will be run with\n"
+"  --ram-size <size>  Ram size the image will be run with\n"
+"\n";
+}
+
+/// The memory of a core after its ELF image has been loaded.
+struct CoreImage {
+  unsigned jtagIndex;
+  unsigned core;
+  uint32_t ramBase;
+  uint32_t ramSize;
+  std::vector<uint8_t> memory;
+  /// Marks which shorts of memory belong to executable segments.
+  std::vector<bool> executable;
+  /// Pcs at which translation starts.
+  std::set<uint32_t> entryPcs;
+  /// Pcs which are replaced by pseudo instructions at runtime.
+  std::set<uint32_t> pseudoPcs;
+};
+
+struct TranslatedInstruction {
+  uint32_t pc;
+  InstructionOpcode opcode;
+  Operands operands;
+  uint32_t nextPc;
+};
+
+struct TranslatedBlock {
+  uint32_t pc;
+  std::vector<TranslatedInstruction> instructions;
+};
+
+static uint32_t loadShort(const CoreImage &image, uint32_t address)
+{
+  return image.memory[address] | (image.memory[address + 1] << 8);
+}
+
+static void readSymbols(Elf *e, CoreImage &image)
+{
+  Elf_Scn *scn = NULL;
+  GElf_Shdr shdr;
+  while ((scn = elf_nextscn(e, scn)) != NULL) {
+    if (gelf_getshdr(scn, &shdr) == NULL || shdr.sh_type != SHT_SYMTAB)
+      continue;
+    Elf_Data *data = elf_getdata(scn, NULL);
+    unsigned count = shdr.sh_size / shdr.sh_entsize;
+    for (unsigned i = 0; i < count; i++) {
+      GElf_Sym sym;
+      if (gelf_getsym(data, i, &sym) == NULL)
+        continue;
+      uint32_t offset = sym.st_value - image.ramBase;
+      if (offset >= image.ramSize || (offset & 1))
+        continue;
+      const char *name = elf_strptr(e, shdr.sh_link, sym.st_name);
+      if (name && (std::strcmp(name, "_DoSyscall") == 0 ||
+                   std::strcmp(name, "_DoException") == 0)) {
+        image.pseudoPcs.insert(offset >> 1);
+        continue;
+      }
+      if (GELF_ST_TYPE(sym.st_info) == STT_FUNC)
+        image.entryPcs.insert(offset >> 1);
+    }
+  }
+}
+
+static void readElf(const char *filename, const XEElfSector *elfSector,
+                    CoreImage &image)
+{
+  uint64_t ElfSize = elfSector->getElfSize();
+  const scoped_array<char> buf(new char[ElfSize]);
+  if (!elfSector->getElfData(buf.get())) {
+    std::cerr << "Error reading elf data from \"" << filename << "\"" << std::endl;
+    std::exit(1);
+  }
+  if (elf_version(EV_CURRENT) == EV_NONE) {
+    std::cerr << "ELF library intialisation failed: "
+              << elf_errmsg(-1) << std::endl;
+    std::exit(1);
+  }
+  Elf *e;
+  if ((e = elf_memory(buf.get(), ElfSize)) == NULL) {
+    std::cerr << "Error reading ELF: " << elf_errmsg(-1) << std::endl;
+    std::exit(1);
+  }
+  GElf_Ehdr ehdr;
+  if (elf_kind(e) != ELF_K_ELF || gelf_getehdr(e, &ehdr) == NULL ||
+      (ehdr.e_machine != XCORE_ELF_MACHINE &&
+       ehdr.e_machine != XCORE_ELF_MACHINE_OLD)) {
+    std::cerr << filename << " does not contain an XCore ELF" << std::endl;
+    std::exit(1);
+  }
+  image.memory.assign(image.ramSize, 0);
+  image.executable.assign(image.ramSize >> 1, false);
+  for (unsigned i = 0; i < ehdr.e_phnum; i++) {
+    GElf_Phdr phdr;
+    if (gelf_getphdr(e, i, &phdr) == NULL) {
+      std::cerr << "Reading ELF program header " << i << " failed: " << elf_errmsg(-1) << std::endl;
+      std::exit(1);
+    }
+    if (phdr.p_filesz == 0)
+      continue;
+    uint32_t offset = phdr.p_paddr - image.ramBase;
+    if (phdr.p_offset > ElfSize || offset > image.ramSize ||
+        offset + phdr.p_memsz > image.ramSize) {
+      std::cerr << "Error data from ELF program header " << i << " does not fit in memory" << std::endl;
+      std::exit(1);
+    }
+    std::memcpy(&image.memory[offset], &buf[phdr.p_offset], phdr.p_filesz);
+    if (phdr.p_flags & PF_X) {
+      for (uint32_t pc = offset >> 1; pc < (offset + phdr.p_filesz) >> 1; pc++)
+        image.executable[pc] = true;
+    }
+  }
+  uint32_t entry = ehdr.e_entry - image.ramBase;
+  if (ehdr.e_entry != 0 && entry < image.ramSize)
+    image.entryPcs.insert(entry >> 1);
+  readSymbols(e, image);
+  elf_end(e);
+}
+
+/// Returns the base name of an instruction (the name without the format).
+static std::string getBaseName(InstructionOpcode opc)
+{
+  std::string name = getInstructionName(opc);
+  return name.substr(0, name.find('_'));
+}
+
+static bool isCall(const std::string &base)
+{
+  return base == "BLA" || base == "BLRF" || base == "BLRB" ||
+         base == "BLACP" || base == "BLAT";
+}
+
+/// Returns whether execution never continues at the next instruction.
+static bool endsBlock(InstructionOpcode opc)
+{
+  std::string base = getBaseName(opc);
+  if (std::strstr(getInstructionName(opc), "illegal"))
+    return true;
+  return isCall(base) || base == "BRFU" || base == "BRBU" || base == "BAU" ||
+         base == "BRU" || base == "RETSP" || base == "KRET" ||
+         base == "DRET" || base == "WAITEU";
+}
+
+/// Returns whether the instruction is a direct branch. If so the target pc is
+/// returned in target.
+static bool getBranchTarget(const TranslatedInstruction &inst,
+                            uint32_t &target)
+{
+  if (std::strstr(getInstructionName(inst.opcode), "illegal"))
+    return false;
+  std::string base = getBaseName(inst.opcode);
+  if (base == "BRFT" || base == "BRBT" || base == "BRFF" || base == "BRBF") {
+    target = inst.operands.ops[1];
+    return true;
+  }
+  if (base == "BRFU" || base == "BRBU" || base == "BLRF" || base == "BLRB") {
+    target = inst.operands.ops[0];
+    return true;
+  }
+  return false;
+}
+
+/// Splits the instruction dispatch code emitted by instgen into the
+/// implementation of each instruction.
+static void readInstructionBodies(std::map<std::string, std::string> &bodies)
+{
+  std::ifstream in(AOT_INSTRUCTION_GEN_OUTPUT);
+  if (!in) {
+    std::cerr << "Error opening \"" AOT_INSTRUCTION_GEN_OUTPUT "\""
+              << std::endl;
+    std::exit(1);
+  }
+  std::string line;
+  std::string name;
+  std::string body;
+  while (std::getline(in, line)) {
+    if (line == "#endif //EMIT_INSTRUCTION_DISPATCH")
+      break;
+    if (line.compare(0, 5, "INST(") == 0) {
+      std::string::size_type close = line.find(')');
+      name = line.substr(5, close - 5);
+      body = line.substr(line.find(':', close) + 1) + "\n";
+    } else if (line == "ENDINST;") {
+      bodies[name] = body;
+      name.clear();
+    } else if (!name.empty()) {
+      body += line + "\n";
+    }
+  }
+}
+
+static bool canTranslate(const CoreImage &image, uint32_t pc)
+{
+  return pc < (image.ramSize >> 1) && image.executable[pc] &&
+         !image.pseudoPcs.count(pc);
+}
+
+static void
+translateBlocks(const CoreImage &image,
+                const std::map<std::string, std::string> &bodies,
+                std::vector<TranslatedBlock> &blocks)
+{
+  std::set<uint32_t> visited;
+  std::vector<uint32_t> worklist(image.entryPcs.begin(), image.entryPcs.end());
+  while (!worklist.empty()) {
+    uint32_t startPc = worklist.back();
+    worklist.pop_back();
+    if (!visited.insert(startPc).second ||
+        !canTranslate(image, startPc))
+      continue;
+    TranslatedBlock block;
+    block.pc = startPc;
+    uint32_t pc = startPc;
+    while (canTranslate(image, pc)) {
+      TranslatedInstruction inst;
+      inst.pc = pc;
+      std::memset(&inst.operands, 0, sizeof(inst.operands));
+      uint32_t address = pc << 1;
+      bool highValid = address + 3 < image.ramSize;
+      uint16_t high = highValid ? loadShort(image, address + 2) : 0;
+      instructionDecode(loadShort(image, address), high, highValid,
+                        inst.opcode, inst.operands);
+      instructionTransform(inst.opcode, inst.operands, pc, image.ramSize,
+                           false);
+      inst.nextPc = pc + (isLongInstruction(inst.opcode) ? 2 : 1);
+      if (!bodies.count(getInstructionName(inst.opcode)) ||
+          (inst.nextPc - startPc) * 2 > MAX_NATIVE_BLOCK_SIZE) {
+        // Leave the instruction to the interpreter.
+        worklist.push_back(inst.nextPc);
+        break;
+      }
+      block.instructions.push_back(inst);
+      uint32_t target;
+      if (getBranchTarget(inst, target))
+        worklist.push_back(target);
+      if (endsBlock(inst.opcode)) {
+        if (isCall(getBaseName(inst.opcode)))
+          worklist.push_back(inst.nextPc);
+        break;
+      }
+      pc = inst.nextPc;
+    }
+    if (!block.instructions.empty())
+      blocks.push_back(block);
+  }
+}
+
+/// Returns the implementation of the instruction with labels renamed so they
+/// are unique within the block.
+static std::string
+getBody(const std::map<std::string, std::string> &bodies, const char *name,
+        unsigned index)
+{
+  std::string body = bodies.find(name)->second;
+  std::string label = std::string(name) + "_end";
+  std::ostringstream renamed;
+  renamed << label << "_" << index;
+  std::string::size_type pos = 0;
+  while ((pos = body.find(label, pos)) != std::string::npos) {
+    body.replace(pos, label.size(), renamed.str());
+    pos += renamed.str().size();
+  }
+  return body;
+}
+
+static void
+emitBlock(std::ostream &out, const TranslatedBlock &block, unsigned blockNum,
+          const std::map<std::string, std::string> &bodies)
+{
+  out << "template <> void Thread::nativeBlock<" << blockNum
+      << ">(Thread &thread, uint32_t pc)\n{\n";
+  out << "DISPATCH_LOCALS\n";
+  out << "Operands ops;\n";
+  for (unsigned i = 0; i < block.instructions.size(); i++) {
+    const TranslatedInstruction &inst = block.instructions[i];
+    const char *name = getInstructionName(inst.opcode);
+    out << "// " << name << "\n";
+    out << "pc = " << inst.pc << ";\n";
+    for (unsigned j = 0; j < 3; j++)
+      out << "ops.ops[" << j << "] = " << inst.operands.ops[j] << "u;\n";
+    std::string body = getBody(bodies, name, i);
+    out << body;
+    out << "if (pc != " << inst.nextPc << ")\n";
+    out << "  MUSTTAIL return opcode[pc](thread, pc);\n";
+    if (body.find("STORE_") != std::string::npos) {
+      // Stop if the store invalidated this block.
+      out << "if (opcode[" << block.pc << "] != &Thread::nativeBlock<"
+          << blockNum << ">)\n";
+      out << "  MUSTTAIL return opcode[pc](thread, pc);\n";
+    }
+  }
+  out << "MUSTTAIL return opcode[pc](thread, pc);\n";
+  out << "}\n\n";
+}
+
+static void
+emitImage(std::ostream &out, const CoreImage &image,
+          const std::map<std::string, std::string> &bodies,
+          unsigned &blockNum, std::ostringstream &images)
+{
+  std::vector<TranslatedBlock> blocks;
+  translateBlocks(image, bodies, blocks);
+  unsigned firstBlock = blockNum;
+  uint32_t low = image.ramSize;
+  uint32_t high = 0;
+  for (std::vector<TranslatedBlock>::const_iterator it = blocks.begin(),
+       e = blocks.end(); it != e; ++it) {
+    emitBlock(out, *it, blockNum++, bodies);
+    low = std::min(low, it->pc << 1);
+    high = std::max(high, it->instructions.back().nextPc << 1);
+  }
+  if (blocks.empty())
+    low = high = 0;
+  std::ostringstream tableName;
+  tableName << "blocks" << firstBlock;
+  out << "static const NativeBlock " << tableName.str() << "[] = {\n";
+  for (unsigned i = 0; i < blocks.size(); i++) {
+    uint32_t size = (blocks[i].instructions.back().nextPc - blocks[i].pc) << 1;
+    out << "  { " << (image.ramBase + (blocks[i].pc << 1)) << "u, " << size
+        << "u, &Thread::nativeBlock<" << (firstBlock + i) << "> },\n";
+  }
+  if (blocks.empty())
+    out << "  { 0, 0, 0 }\n";
+  out << "};\n\n";
+  uint32_t checksum = nativeCodeChecksum(&image.memory[0] + low, high - low);
+  images << "  { " << image.jtagIndex << ", " << image.core << ", "
+         << image.ramBase << "u, " << image.ramSize << "u, "
+         << (image.ramBase + low) << "u, " << (high - low) << "u, "
+         << checksum << "u, " << tableName.str() << ", " << blocks.size()
+         << " },\n";
+}
+
+static void
+emitSource(std::ostream &out, const char *filename,
+           const std::vector<CoreImage> &images)
+{
+  std::map<std::string, std::string> bodies;
+  readInstructionBodies(bodies);
+  out << "// Generated by axe-aot from \"" << filename << "\".\n";
+  out <<
+"#include \"Thread.h\"\n"
+"#include \"Core.h\"\n"
+"#include \"Node.h\"\n"
+"#include \"SystemState.h\"\n"
+"#include \"Trace.h\"\n"
+"#include \"Stats.h\"\n"
+"#include \"Profiler.h\"\n"
+"#include \"Exceptions.h\"\n"
+"#include \"BitManip.h\"\n"
+"#include \"SyscallHandler.h\"\n"
+"#include \"Config.h\"\n"
+"#include \"NativeCode.h\"\n"
+"#include \"InstructionMacros.h\"\n"
+"\n"
+"#undef OP\n"
+"#undef LOP\n"
+"#define OP(n) (ops.ops[(n)])\n"
+"#define LOP(n) (ops.lops[(n)])\n"
+"#define OPCODE(s) (&Thread::s ## _handler<features>)\n"
+"\n"
+"static const unsigned features = 0;\n"
+"\n";
+  unsigned blockNum = 0;
+  std::ostringstream imageTable;
+  for (std::vector<CoreImage>::const_iterator it = images.begin(),
+       e = images.end(); it != e; ++it) {
+    emitImage(out, *it, bodies, blockNum, imageTable);
+  }
+  out << "extern \"C\" const unsigned axeNativeCodeVersion = "
+      << "NATIVE_CODE_VERSION;\n";
+  out << "extern \"C\" const NativeImage axeNativeImages[] = {\n"
+      << imageTable.str() << "};\n";
+  out << "extern \"C\" const unsigned axeNumNativeImages = " << images.size()
+      << ";\n";
+}
+
+static void readXE(const char *filename, uint32_t ramBase, uint32_t ramSize,
+                   std::vector<CoreImage> &images)
+{
+  XE xe(filename);
+  if (!xe) {
+    std::cerr << "Error opening \"" << filename << "\"" << std::endl;
+    std::exit(1);
+  }
+  xe.read();
+  // Later ELF sectors for the same core take precedence, see readXE() in
+  // main.cpp.
+  std::set<std::pair<unsigned, unsigned> > seen;
+  for (std::vector<const XESector *>::const_reverse_iterator
+       it = xe.getSectors().rbegin(), end = xe.getSectors().rend(); it != end;
+       ++it) {
+    if ((*it)->getType() != XESector::XE_SECTOR_ELF)
+      continue;
+    const XEElfSector *elfSector = static_cast<const XEElfSector*>(*it);
+    std::pair<unsigned, unsigned> key(elfSector->getNode(),
+                                      elfSector->getCore());
+    if (!seen.insert(key).second)
+      continue;
+    images.push_back(CoreImage());
+    CoreImage &image = images.back();
+    image.jtagIndex = key.first;
+    image.core = key.second;
+    image.ramBase = ramBase;
+    image.ramSize = ramSize;
+    readElf(filename, elfSector, image);
+  }
+  xe.close();
+}
+
+int main(int argc, char **argv) {
+  const char *input = 0;
+  const char *output = 0;
+  bool emitSourceOnly = false;
+  // Default to the memory layout axe uses for XE files without a config.
+  uint32_t ramSize = CoreParams().getRamSize();
+  uint32_t ramBase = ramSize;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "-h") {
+      printUsage(argv[0]);
+      return 0;
+    } else if (arg == "-S") {
+      emitSourceOnly = true;
+    } else if ((arg == "--ram-base" || arg == "--ram-size") && i + 1 < argc) {
+      uint32_t value = std::strtoul(argv[++i], 0, 0);
+      if (arg == "--ram-base")
+        ramBase = value;
+      else
+        ramSize = value;
+    } else if (!input) {
+      input = argv[i];
+    } else if (!output) {
+      output = argv[i];
+    } else {
+      printUsage(argv[0]);
+      return 1;
+    }
+  }
+  if (!input || !output) {
+    printUsage(argv[0]);
+    return 1;
+  }
+  std::vector<CoreImage> images;
+  readXE(input, ramBase, ramSize, images);
+
+  std::string sourceFile = emitSourceOnly ? output :
+                           std::string(output) + ".cpp";
+  std::ofstream out(sourceFile.c_str());
+  if (!out) {
+    std::cerr << "Error opening \"" << sourceFile << "\"" << std::endl;
+    return 1;
+  }
+  emitSource(out, input, images);
+  out.close();
+  if (emitSourceOnly)
+    return 0;
+
+  std::string command = std::string(AOT_CXX_COMPILER) + " " AOT_CXX_FLAGS
+                        " -o \"" + output + "\" \"" + sourceFile + "\"";
+  if (std::system(command.c_str()) != 0) {
+    std::cerr << "Error compiling \"" << sourceFile << "\"" << std::endl;
+    return 1;
+  }
+  std::remove(sourceFile.c_str());
+  return 0;
+}
@@ -23,19 +23,19 @@ void Stats::updateStats(const Thread &t, const char *name) {
   std::map<std::string, long long*>::iterator iter = istats.find(s);
   if (iter == istats.end())
   {
-    long long *x = new long long[cores * NUM_THREADS]();
+    long long *x = new long long[cores * threadsPerCore]();
     istats.insert(std::pair<std::string, long long*>(name,x));
     iter = istats.find(s);
   }
   long long *ts = iter->second;
-  ts[(NUM_THREADS * cid) + tid] += 1;
+  ts[(threadsPerCore * cid) + tid] += 1;
   return;
 }
 
 void Stats::dump() {
   //TODO: Get the chip rev. Hard coded for xsim compatibility for now...
   long long *counts;
-  int threads = cores * NUM_THREADS;
+  int threads = cores * threadsPerCore;
   for (std::map<std::string, long long*>::iterator iter = istats.begin();
     iter != istats.end(); iter++)
   {
@@ -50,7 +50,8 @@ void Stats::dump() {
   return;
 }
 
-void Stats::initStats(const int cores) {
+void Stats::initStats(const int cores, const int threadsPerCore) {
   Stats::cores = cores;
+  Stats::threadsPerCore = threadsPerCore;
 }
 
@@ -22,11 +22,12 @@ private:
   bool statsEnabled;
   static Stats instance;
   int cores;
+  int threadsPerCore;
   std::map<std::string, long long*> istats;
 public:
   void setEnabled(bool enable) { statsEnabled = enable; }
   bool getEnabled() const { return statsEnabled; }
-  void initStats(const int cores);
+  void initStats(const int cores, const int threadsPerCore);
   void updateStats(const Thread &t, const char *name);
   void dump();
   static Stats &get() { return instance; }
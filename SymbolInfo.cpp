@@ -42,6 +42,16 @@ const ElfSymbol *CoreSymbolInfo::getFunctionSymbol(uint32_t address) const
   return getSymbol(functionSymbols, address);
 }
 
+const ElfSymbol *CoreSymbolInfo::getNextFunctionSymbol(uint32_t address) const
+{
+  // Symbols are sorted by decreasing address.
+  SymbolAddressMap::const_iterator it = functionSymbols.lower_bound(address);
+  if (it == functionSymbols.begin())
+    return 0;
+  --it;
+  return it->second;
+}
+
 const ElfSymbol *CoreSymbolInfo::getDataSymbol(uint32_t address) const
 {
   return getSymbol(dataSymbols, address);
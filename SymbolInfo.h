@@ -36,7 +36,11 @@ private:
 public:
   const ElfSymbol *getGlobalSymbol(const std::string &name) const;
   const ElfSymbol *getFunctionSymbol(uint32_t address) const;
+  /// Returns the function symbol with the lowest address greater than the
+  /// specified address.
+  const ElfSymbol *getNextFunctionSymbol(uint32_t address) const;
   const ElfSymbol *getDataSymbol(uint32_t address) const;
+  const std::vector<ElfSymbol> &getSymbols() const { return symbols; }
 };
 
 class CoreSymbolInfoBuilder {
@@ -52,13 +56,13 @@ class Core;
 class SymbolInfo {
 private:
   std::map<const Core*,CoreSymbolInfo*> coreMap;
-  CoreSymbolInfo *getCoreSymbolInfo(const Core *core) const;
   SymbolInfo(const SymbolInfo &); // Not implemented.
   void operator=(const SymbolInfo &); // Not implemented.
 public:
   SymbolInfo() {}
   ~SymbolInfo();
   void add(const Core *core, std::auto_ptr<CoreSymbolInfo> info);
+  CoreSymbolInfo *getCoreSymbolInfo(const Core *core) const;
   const ElfSymbol *getGlobalSymbol(const Core *core,
                                    const std::string &name) const;
   const ElfSymbol *getFunctionSymbol(const Core *core,
@@ -20,8 +20,10 @@ public:
 private:
   /// Number of threads.
   unsigned NumThreads;
+  /// Maximum number of threads.
+  unsigned MaxThreads;
   /// List of threads. The master thread is always at the first index.
-  Thread *threads[NUM_THREADS];
+  Thread **threads;
   /// Number of paused threads
   unsigned NumPaused;
   bool join;
@@ -29,7 +31,14 @@ private:
   ticks_t MaxThreadTime() const;
   SyncResult sync(Thread &thread, bool isMaster);
 public:
-  Synchroniser() : Resource(RES_TYPE_SYNC) {}
+  Synchroniser(unsigned maxThreads) :
+    Resource(RES_TYPE_SYNC),
+    MaxThreads(maxThreads),
+    threads(new Thread*[maxThreads]) {}
+
+  ~Synchroniser() {
+    delete[] threads;
+  }
   
   bool alloc(Thread &master)
   {
@@ -44,7 +53,7 @@ public:
   
   void addChild(Thread &thread)
   {
-    assert(NumThreads + 1 <= NUM_THREADS && "Too many threads");
+    assert(NumThreads + 1 <= MaxThreads && "Too many threads");
     threads[NumThreads++] = &thread;
     NumPaused++;
   }
@@ -8,8 +8,10 @@
 #include "SyscallHandler.h"
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <ctime>
 #include <iostream>
+#include <vector>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
@@ -30,6 +32,7 @@
 #define read _read
 #define write _write
 #define lseek _lseek
+#define isatty _isatty
 #endif
 
 class SyscallHandlerImpl {
@@ -38,6 +41,16 @@ private:
   bool tracing;
   unsigned coreCount;
   unsigned doneCount;
+  bool bufferOutput;
+  /// Output written to stdout or stderr which hasn't been written to the
+  /// host. Only one of them is buffered at a time so output to the two is
+  /// written in the order the program wrote it.
+  std::vector<char> outputBuffer;
+  /// The file descriptor outputBuffer belongs to, or -1 if it is empty.
+  int outputBufferFd;
+  /// Whether the buffer is flushed at the end of each line for each of the
+  /// standard file descriptors. This is the case if it refers to a terminal.
+  bool lineBuffered[3];
   char *getString(Thread &thread, uint32_t address);
   void *getBuffer(Thread &thread, uint32_t address, uint32_t size);
   int getNewFd();
@@ -46,11 +59,16 @@ private:
   int convertOpenMode(int mode);
   bool convertLseekType(int whence, int &converted);
   void doException(const Thread &state, uint32_t et, uint32_t ed);
+  bool isBufferedFd(int fd) const;
+  int bufferedWrite(int fd, const char *buf, uint32_t size);
   
 public:
   SyscallHandlerImpl();
+  ~SyscallHandlerImpl();
 
   void setCoreCount(unsigned count) { coreCount = count; }
+  void setOutputBuffering(bool value);
+  void flushOutput();
   SyscallHandler::SycallOutcome doSyscall(Thread &thread, int &retval);
   void doException(const Thread &thread);
   
@@ -72,6 +90,9 @@ enum SyscallType {
   OSCALL_REMOVE = 11,
   OSCALL_SYSTEM = 12,
   OSCALL_EXCEPTION = 13,
+  // Trace markers, not part of the standard system call interface.
+  OSCALL_TRACE_START = 256,
+  OSCALL_TRACE_STOP = 257,
 };
 
 enum LseekType {
@@ -97,20 +118,76 @@ enum OpenFlags {
 };
 
 const unsigned MAX_FDS = 512;
+const unsigned OUTPUT_BUFFER_SIZE = 4096;
 
 SyscallHandlerImpl::SyscallHandlerImpl() :
-  fds(new int[MAX_FDS]), tracing(false), coreCount(1), doneCount(0)
+  fds(new int[MAX_FDS]), tracing(false), coreCount(1), doneCount(0),
+  bufferOutput(true), outputBufferFd(-1)
 {
   // Duplicate the standard file descriptors.
   fds[0] = dup(STDIN_FILENO);
   fds[1] = dup(STDOUT_FILENO);
   fds[2] = dup(STDERR_FILENO);
+  for (unsigned i = 0; i < 3; i++) {
+    lineBuffered[i] = fds[i] != -1 && isatty(fds[i]);
+  }
   // The rest are initialised to -1.
   for (unsigned i = 3; i < MAX_FDS; i++) {
     fds[i] = - 1;
   }
 }
 
+SyscallHandlerImpl::~SyscallHandlerImpl()
+{
+  flushOutput();
+}
+
+void SyscallHandlerImpl::setOutputBuffering(bool value)
+{
+  if (!value)
+    flushOutput();
+  bufferOutput = value;
+}
+
+bool SyscallHandlerImpl::isBufferedFd(int fd) const
+{
+  return bufferOutput && (fd == 1 || fd == 2) &&
+         !Tracer::get().getTracingEnabled();
+}
+
+/// Append to the output buffer, flushing it if it is full or, if the file
+/// descriptor is line buffered, if a line is complete.
+int SyscallHandlerImpl::
+bufferedWrite(int fd, const char *buf, uint32_t size)
+{
+  if (fd != outputBufferFd)
+    flushOutput();
+  outputBufferFd = fd;
+  outputBuffer.insert(outputBuffer.end(), buf, buf + size);
+  if (outputBuffer.size() >= OUTPUT_BUFFER_SIZE ||
+      (lineBuffered[fd] && std::memchr(buf, '\n', size))) {
+    flushOutput();
+  }
+  return size;
+}
+
+void SyscallHandlerImpl::flushOutput()
+{
+  if (outputBufferFd == -1)
+    return;
+  const char *p = outputBuffer.empty() ? 0 : &outputBuffer[0];
+  size_t remaining = outputBuffer.size();
+  while (remaining != 0) {
+    int written = write(fds[outputBufferFd], p, remaining);
+    if (written <= 0)
+      break;
+    p += written;
+    remaining -= written;
+  }
+  outputBuffer.clear();
+  outputBufferFd = -1;
+}
+
 /// Returns a pointer to a string in memory at the given address.
 /// Returns 0 if the address is invalid or the string is not null terminated.
 char *SyscallHandlerImpl::getString(Thread &thread, uint32_t address)
@@ -215,6 +292,9 @@ bool SyscallHandlerImpl::convertLseekType(int whence, int &converted)
 
 void SyscallHandlerImpl::doException(const Thread &thread, uint32_t et, uint32_t ed)
 {
+  flushOutput();
+  if (Tracer::get().getTracingEnabled())
+    Tracer::get().flush();
   std::cout << "Unhandled exception: "
             << Exceptions::getExceptionName(et)
             << ", data: 0x" << std::hex << ed << std::dec << "\n";
@@ -259,10 +339,12 @@ doSyscall(Thread &thread, int &retval)
   switch (thread.regs[R0]) {
   case OSCALL_EXIT:
     TRACE("exit", thread.regs[R1]);
+    flushOutput();
     retval = thread.regs[R1];
     return SyscallHandler::EXIT;
   case OSCALL_DONE:
     TRACE("done");
+    flushOutput();
     doneCount++;
     if (doneCount == coreCount) {
       retval = 0;
@@ -273,6 +355,15 @@ doSyscall(Thread &thread, int &retval)
     doException(thread, thread.regs[R1], thread.regs[R2]);
     retval = 1;
     return SyscallHandler::EXIT;
+  case OSCALL_TRACE_START:
+    Tracer::get().getFilter().setEnabled(true);
+    TRACE("trace_start");
+    // Return to the scheduler so the thread switches to the tracing loop.
+    return SyscallHandler::YIELD;
+  case OSCALL_TRACE_STOP:
+    TRACE("trace_stop");
+    Tracer::get().getFilter().setEnabled(false);
+    return SyscallHandler::YIELD;
   case OSCALL_OPEN:
     {
       uint32_t PathAddr = thread.regs[R1];
@@ -307,6 +398,8 @@ doSyscall(Thread &thread, int &retval)
         thread.regs[R0] = (uint32_t)-1;
         return SyscallHandler::CONTINUE;
       }
+      if ((int)thread.regs[R1] == outputBufferFd)
+        flushOutput();
       int retval = close(fds[thread.regs[R1]]);
       if (retval == 0) {
         fds[thread.regs[R1]] = (uint32_t)-1;
@@ -327,6 +420,8 @@ doSyscall(Thread &thread, int &retval)
         thread.regs[R0] = (uint32_t)-1;
         return SyscallHandler::CONTINUE;
       }
+      // Make sure any prompt is visible before waiting for input.
+      flushOutput();
       thread.regs[R0] = read(fds[thread.regs[R1]], buf, thread.regs[R3]);
       return SyscallHandler::CONTINUE;
     }
@@ -343,7 +438,17 @@ doSyscall(Thread &thread, int &retval)
         thread.regs[R0] = (uint32_t)-1;
         return SyscallHandler::CONTINUE;
       }
-      thread.regs[R0] = write(fds[thread.regs[R1]], buf, thread.regs[R3]);
+      int fd = thread.regs[R1];
+      if (isBufferedFd(fd)) {
+        thread.regs[R0] = bufferedWrite(fd, (const char *)buf,
+                                        thread.regs[R3]);
+        return SyscallHandler::CONTINUE;
+      }
+      flushOutput();
+      // Keep the trace in order with the output of the program.
+      if (Tracer::get().getTracingEnabled())
+        Tracer::get().flush();
+      thread.regs[R0] = write(fds[fd], buf, thread.regs[R3]);
       return SyscallHandler::CONTINUE;
     }
   case OSCALL_LSEEK:
@@ -359,6 +464,8 @@ doSyscall(Thread &thread, int &retval)
         thread.regs[R0] = (uint32_t)-1;
         return SyscallHandler::CONTINUE;
       }
+      if ((int)thread.regs[R1] == outputBufferFd)
+        flushOutput();
       thread.regs[R0] = lseek(fds[thread.regs[R1]], thread.regs[R2], whence);
       return SyscallHandler::CONTINUE;
     }
@@ -417,10 +524,12 @@ doSyscall(Thread &thread, int &retval)
           return SyscallHandler::CONTINUE;
         }
       }
+      flushOutput();
       thread.regs[R0] = std::system(command);
       return SyscallHandler::CONTINUE;
     }
   default:
+    flushOutput();
     std::cout << "Error: unknown system call number: " << thread.regs[R0] << "\n";
     retval = 1;
     return SyscallHandler::EXIT;
@@ -434,6 +543,16 @@ void SyscallHandler::setCoreCount(unsigned number)
   SyscallHandlerImpl::instance.setCoreCount(number);
 }
 
+void SyscallHandler::setOutputBuffering(bool value)
+{
+  SyscallHandlerImpl::instance.setOutputBuffering(value);
+}
+
+void SyscallHandler::flushOutput()
+{
+  SyscallHandlerImpl::instance.flushOutput();
+}
+
 SyscallHandler::SycallOutcome SyscallHandler::
 doSyscall(Thread &thread, int &retval)
 {
@@ -10,10 +10,19 @@ class SyscallHandler {
 public:
   enum SycallOutcome {
     CONTINUE,
+    /// Continue after returning to the scheduler.
+    YIELD,
     DESCHEDULE,
     EXIT
   };
   static void setCoreCount(unsigned number);
+  /// Set whether output to stdout and stderr is buffered. If buffered it is
+  /// written to the host when the buffer is full, at the end of each line if
+  /// it refers to a terminal, when the program exits and before the program
+  /// reads input. Output to the two is always written in program order.
+  static void setOutputBuffering(bool value);
+  /// Write any buffered output to the host.
+  static void flushOutput();
   static SycallOutcome doSyscall(Thread &thread, int &retval);
   static void doException(const Thread &thread);
 };
@@ -4,12 +4,17 @@
 // LICENSE.txt and at <http://github.xcore.com/>
 
 #include <iomanip>
+#include <fstream>
+#include <algorithm>
+#include <cstdlib>
 #include "SystemState.h"
 #include "Node.h"
 #include "Core.h"
 #include "Trace.h"
 #include "Stats.h"
 #include "TokenDelay.h"
+#include "Heartbeat.h"
+#include "SyscallHandler.h"
 
 SystemState::~SystemState()
 {
@@ -26,6 +31,25 @@ void SystemState::addNode(std::auto_ptr<Node> n)
   n.release();
 }
 
+Core *SystemState::findCore(const char *spec)
+{
+  for (node_iterator outerIt = node_begin(), outerE = node_end();
+       outerIt != outerE; ++outerIt) {
+    Node &node = **outerIt;
+    for (Node::core_iterator innerIt = node.core_begin(),
+         innerE = node.core_end(); innerIt != innerE; ++innerIt) {
+      Core &core = **innerIt;
+      if (!spec || core.getCoreName() == spec)
+        return &core;
+      char *end;
+      unsigned long id = std::strtoul(spec, &end, 0);
+      if (*spec != '\0' && *end == '\0' && id == core.getCoreID())
+        return &core;
+    }
+  }
+  return 0;
+}
+
 void SystemState::
 completeEvent(Thread &t, EventableResource &res, bool interrupt)
 {
@@ -78,16 +102,25 @@ ChanEndpoint *SystemState::getChanendDest(ResourceID ID)
 
 int SystemState::run()
 {
+  HostTime start = HostTime::now();
   try {
     while (!scheduler.empty()) {
       Runnable &runnable = scheduler.front();
       currentRunnable = &runnable;
       scheduler.pop();
+      schedulerEvents++;
+      if (heartbeatDue) {
+        heartbeatDue = false;
+        heartbeat->write(runnable.wakeUpTime);
+      }
       runnable.run(runnable.wakeUpTime);
     }
   } catch (ExitException &ee) {
+    runTime += HostTime::now() - start;
     return ee.getStatus();
   }
+  runTime += HostTime::now() - start;
+  SyscallHandler::flushOutput();
   Tracer::get().noRunnableThreads(*this);
   return 1;
 }
@@ -110,9 +143,18 @@ void SystemState::threadStats() {
         << std::setw(8) << "Thread" << " "
         << std::setw(12) << "Time" << " "
         << std::setw(12) << "Insts" << " "
-        << std::setw(12) << "Insts/cycle" << std::endl;
-      for (int i=0; i<NUM_THREADS; i++) {
-        Thread &thread = core.getThread(i);
+        << std::setw(12) << "Insts/cycle";
+      // Cycles spent descheduled, by what the thread was waiting for.
+      for (unsigned r=0; r<Thread::NUM_STALL_REASONS; r++) {
+        std::cout << " " << std::setw(10)
+          << Thread::getStallReasonName((Thread::StallReason)r);
+      }
+      std::cout << std::endl;
+      for (unsigned i=0; i<core.getNumThreads(); i++) {
+        const Thread *t = core.findThread(i);
+        if (!t)
+          continue;
+        const Thread &thread = *t;
         totalCount += thread.count;
         maxTime = maxTime > thread.time ? maxTime : thread.time;
         double ratio = (double) thread.count / (double) thread.time;
@@ -120,36 +162,72 @@ void SystemState::threadStats() {
           << std::setw(8) << i << " " 
           << std::setw(12) << thread.time << " "
           << std::setw(12) << thread.count << " " 
-          << std::setw(12) << std::setprecision(2) << ratio << std::endl;
+          << std::setw(12) << std::setprecision(2) << ratio;
+        for (unsigned r=0; r<Thread::NUM_STALL_REASONS; r++) {
+          std::cout << " " << std::setw(10) << thread.stallCycles[r];
+        }
+        std::cout << std::endl;
       }
     }
   }
 }
 
-void SystemState::systemStats() {
-  long totalCount = 0;
-  ticks_t maxTime = 0;
-  ticks_t maxCore0Time = 0;
-  int numCores = 0;
-  for (node_iterator nIt=node_begin(), nEnd=node_end(); nIt!=nEnd; ++nIt) {
+namespace {
+  struct CoreTotals {
+    std::string name;
+    long count;
+    uint64_t decodeCount;
+  };
+  struct SystemTotals {
+    long count;
+    ticks_t maxTime;
+    ticks_t maxCore0Time;
+    double totalRam;
+    uint64_t decodeCount;
+    std::vector<CoreTotals> cores;
+    SystemTotals() : count(0), maxTime(0), maxCore0Time(0), totalRam(0),
+                     decodeCount(0) {}
+  };
+}
+
+static void getSystemTotals(SystemState &sys, SystemTotals &totals)
+{
+  for (SystemState::node_iterator nIt=sys.node_begin(), nEnd=sys.node_end();
+       nIt!=nEnd; ++nIt) {
     Node &node = **nIt;
     for (Node::core_iterator cIt=node.core_begin(), cEnd=node.core_end(); 
         cIt!=cEnd; ++cIt) {
       Core &core = **cIt;
-      numCores++;
-      for (int i=0; i<NUM_THREADS; i++) {
-        Thread &t = core.getThread(i);
-        totalCount += t.count;
-        maxTime = maxTime > t.time ? maxTime : t.time;
-      }
-      if (core.getCoreNumber() == 0) {
-        for (int i=0; i<NUM_THREADS; i++) {
-          Thread &t = core.getThread(i);
-          maxCore0Time = maxCore0Time > t.time ? maxCore0Time : t.time;
-        }
+      CoreTotals coreTotals;
+      coreTotals.name = core.getCoreName();
+      coreTotals.count = 0;
+      coreTotals.decodeCount = core.decodeCount;
+      totals.totalRam += core.ram_size;
+      totals.decodeCount += core.decodeCount;
+      for (unsigned i=0; i<core.getNumThreads(); i++) {
+        const Thread *thread = core.findThread(i);
+        if (!thread)
+          continue;
+        const Thread &t = *thread;
+        coreTotals.count += t.count;
+        totals.maxTime = std::max(totals.maxTime, t.time);
+        if (core.getCoreNumber() == 0)
+          totals.maxCore0Time = std::max(totals.maxCore0Time, t.time);
       }
+      totals.count += coreTotals.count;
+      totals.cores.push_back(coreTotals);
     }
   }
+}
+
+void SystemState::systemStats() {
+  SystemTotals totals;
+  getSystemTotals(*this, totals);
+  long totalCount = totals.count;
+  ticks_t maxTime = totals.maxTime;
+  ticks_t maxCore0Time = totals.maxCore0Time;
+  int numCores = totals.cores.size();
+  double totalRam = totals.totalRam;
   
   // Simulated performance
   double seconds = (double) maxTime / 100000000.0;
@@ -158,8 +236,7 @@ void SystemState::systemStats() {
   long peakOpsPerSec = CYCLES_PER_SEC;
   long peakGOpsPerSec = peakOpsPerSec / 1000000000.0;
   double perCentPeak = (100.0/(double) peakOpsPerSec) * opsPerSec;
-  double ramSizeKB = (double) RAM_SIZE / 1000.0;
-  double aggregateRam = ((double) numCores * ramSizeKB) / 1000.0;
+  double aggregateRam = totalRam / 1000000.0;
   std::cout << "Simulated performance =========================="
     << std::endl;
   std::cout << "Num cores:                    "
@@ -182,18 +259,84 @@ void SystemState::systemStats() {
     << peakGOpsPerSec << " GIPS)" << std::endl;
   
   // Simulation performance
-  /*double opsPerRealSec = (double) totalCount / elapsedTime;
-  double gOpsPerRealSec = opsPerRealSec / 1000000000.0;
-  double slowdown = opsPerSec / opsPerRealSec;
+  double elapsedTime = runTime.wall;
+  double opsPerRealSec = elapsedTime > 0 ? totalCount / elapsedTime : 0;
+  double mOpsPerRealSec = opsPerRealSec / 1000000.0;
+  double slowdown = opsPerRealSec > 0 ? opsPerSec / opsPerRealSec : 0;
   std::cout << std::endl;
   std::cout << "Simulation performance =========================" 
     << std::endl;
+  std::cout << "Load time:                    "
+    << std::setprecision(3) << loadTime.wall << "s (" << loadTime.cpu
+    << "s CPU)" << std::endl;
   std::cout << "Elapsed time:                 "
-    << std::setprecision(3) << elapsedTime << "s" << std::endl;
+    << std::setprecision(3) << elapsedTime << "s (" << runTime.cpu
+    << "s CPU)" << std::endl;
   std::cout << "Instructions per second:      "
     << std::setprecision(3) << opsPerRealSec
-    << " (" << std::setprecision(2) << gOpsPerRealSec << " GIPS)" << std::endl;
+    << " (" << std::setprecision(3) << mOpsPerRealSec << " MIPS)" << std::endl;
   std::cout << "Slowdown:                     "
-    << std::setprecision(2) << slowdown << "x" << std::endl;*/
+    << std::setprecision(3) << slowdown << "x" << std::endl;
+  std::cout << "Instructions decoded:         "
+    << totals.decodeCount << std::endl;
+  std::cout << "Scheduler events:             "
+    << schedulerEvents << std::endl;
+  if (numCores > 1) {
+    for (std::vector<CoreTotals>::const_iterator it = totals.cores.begin(),
+         e = totals.cores.end(); it != e; ++it) {
+      double coreMips =
+        elapsedTime > 0 ? it->count / elapsedTime / 1000000.0 : 0;
+      std::cout << std::setw(30) << std::left << (it->name + ":")
+        << std::right << std::setprecision(3) << coreMips << " MIPS, "
+        << it->decodeCount << " decoded" << std::endl;
+    }
+  }
 }
 
+static void writeHostTime(std::ostream &out, const char *name,
+                          const HostTime &time)
+{
+  out << "    \"" << name << "\": { \"wall\": " << time.wall
+      << ", \"cpu\": " << time.cpu << " }";
+}
+
+bool SystemState::writeStatsJSON(const std::string &filename)
+{
+  std::ofstream out(filename.c_str());
+  if (!out)
+    return false;
+  SystemTotals totals;
+  getSystemTotals(*this, totals);
+  double seconds = (double) totals.maxTime / 100000000.0;
+  double elapsedTime = runTime.wall;
+  double mips = elapsedTime > 0 ? totals.count / elapsedTime / 1000000.0 : 0;
+  double slowdown = seconds > 0 ? elapsedTime / seconds : 0;
+  out << std::setprecision(6);
+  out << "{\n";
+  out << "  \"cores\": " << totals.cores.size() << ",\n";
+  out << "  \"instructions\": " << totals.count << ",\n";
+  out << "  \"max_thread_cycles\": " << totals.maxTime << ",\n";
+  out << "  \"simulated_seconds\": " << seconds << ",\n";
+  out << "  \"host_time\": {\n";
+  writeHostTime(out, "load", loadTime);
+  out << ",\n";
+  writeHostTime(out, "run", runTime);
+  out << "\n  },\n";
+  out << "  \"mips\": " << mips << ",\n";
+  out << "  \"slowdown\": " << slowdown << ",\n";
+  out << "  \"instructions_decoded\": " << totals.decodeCount << ",\n";
+  out << "  \"scheduler_events\": " << schedulerEvents << ",\n";
+  out << "  \"per_core\": [";
+  for (std::vector<CoreTotals>::const_iterator it = totals.cores.begin(),
+       e = totals.cores.end(); it != e; ++it) {
+    double coreMips =
+      elapsedTime > 0 ? it->count / elapsedTime / 1000000.0 : 0;
+    out << (it == totals.cores.begin() ? "\n" : ",\n");
+    out << "    { \"name\": \"" << it->name << "\", \"instructions\": "
+        << it->count << ", \"mips\": " << coreMips
+        << ", \"instructions_decoded\": " << it->decodeCount << " }";
+  }
+  out << "\n  ]\n";
+  out << "}\n";
+  return out.good();
+}
@@ -8,11 +8,15 @@
 
 #include <vector>
 #include <memory>
+#include <string>
 #include "Thread.h"
 #include "RunnableQueue.h"
+#include "HostTime.h"
 
+class Core;
 class Node;
 class ChanEndpoint;
+class Heartbeat;
 
 class SystemState {
   std::vector<Node*> nodes;
@@ -20,24 +24,49 @@ class SystemState {
   /// The currently executing runnable.
   Runnable *currentRunnable;
   PendingEvent pendingEvent;
+  /// Host time spent loading the program and running the simulation.
+  HostTime loadTime;
+  HostTime runTime;
+  /// Number of runnables taken from the scheduler.
+  uint64_t schedulerEvents;
+  /// Progress reporter, or null if progress isn't being reported.
+  Heartbeat *heartbeat;
+  /// Set by the heartbeat's thread when a report is due.
+  volatile bool heartbeatDue;
 
   void completeEvent(Thread &t, EventableResource &res, bool interrupt);
 
 public:
   typedef std::vector<Node*>::iterator node_iterator;
   typedef std::vector<Node*>::const_iterator const_node_iterator;
-  SystemState() : currentRunnable(0) {
+  SystemState() :
+    currentRunnable(0),
+    schedulerEvents(0),
+    heartbeat(0),
+    heartbeatDue(false) {
     pendingEvent.set = false;
   }
   ~SystemState();
   RunnableQueue &getScheduler() { return scheduler; }
   void addNode(std::auto_ptr<Node> n);
+  /// Returns the core with the specified name or numeric ID, or the first
+  /// core if spec is null. Returns null if there is no such core.
+  Core *findCore(const char *spec);
   void threadStats();
   void systemStats();
+  /// Write the system statistics and the simulation performance as JSON.
+  /// Returns false if the file cannot be written.
+  bool writeStatsJSON(const std::string &filename);
+  void setLoadTime(const HostTime &time) { loadTime = time; }
+  void setHeartbeat(Heartbeat *h) { heartbeat = h; }
+  /// Ask for a progress report the next time a runnable is scheduled. May be
+  /// called from any host thread.
+  void requestHeartbeat() { heartbeatDue = true; }
   
   bool hasTimeSliceExpired(ticks_t time) const {
+    // A thread running on its own is only interrupted for progress reports.
     if (scheduler.empty())
-      return false;
+      return heartbeatDue;
     return time > scheduler.front().wakeUpTime;
   }
 
@@ -49,6 +78,8 @@ public:
   
   /// Schedule a thread.
   void schedule(Thread &thread) {
+    if (thread.waiting())
+      thread.endStall();
     thread.waiting() = false;
     thread.pausedOn = 0;
     scheduler.push(thread, thread.time);
@@ -57,6 +88,12 @@ public:
   void scheduleOther(Runnable &runnable, ticks_t time) {
     scheduler.push(runnable, time);
   }
+
+  /// Remove a runnable from the scheduler if it is scheduled.
+  void unschedule(Runnable &runnable) {
+    if (scheduler.contains(runnable))
+      scheduler.remove(runnable);
+  }
   
   /// Take an event on a thread. The thread must not be the current thread.
   void takeEvent(Thread &thread, EventableResource &res, bool interrupt)
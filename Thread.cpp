@@ -9,39 +9,15 @@
 #include "SystemState.h"
 #include "Trace.h"
 #include "Stats.h"
+#include "Profiler.h"
 #include "Exceptions.h"
 #include "BitManip.h"
 #include "SyscallHandler.h"
 #include "Config.h"
+#include "SpinLoop.h"
 #include <iostream>
 #include <climits>
 
-const char *registerNames[] = {
-  "r0",
-  "r1",
-  "r2",
-  "r3",
-  "r4",
-  "r5",
-  "r6",
-  "r7",
-  "r8",
-  "r9",
-  "r10",
-  "r11",
-  "cp",
-  "dp",
-  "sp",
-  "lr",
-  "et",
-  "ed",
-  "kep",
-  "ksp",
-  "spc",
-  "sed",
-  "ssr"
-};
-
 void Thread::dump() const
 {
   std::cout << std::hex;
@@ -57,6 +33,56 @@ void Thread::schedule()
   getParent().getParent()->getParent()->schedule(*this);
 }
 
+void Thread::beginStall(const Resource *res)
+{
+  stallStart = time;
+  if (!res) {
+    stallReason = STALL_EVENT;
+    return;
+  }
+  switch (res->getType()) {
+  default:
+    stallReason = STALL_OTHER;
+    break;
+  case RES_TYPE_CHANEND:
+    stallReason = static_cast<const Chanend*>(res)->isPausedOut(*this) ?
+                    STALL_CHANEND_OUT : STALL_CHANEND_IN;
+    break;
+  case RES_TYPE_PORT:
+    stallReason = STALL_PORT;
+    break;
+  case RES_TYPE_TIMER:
+    stallReason = STALL_TIMER;
+    break;
+  case RES_TYPE_LOCK:
+    stallReason = STALL_LOCK;
+    break;
+  case RES_TYPE_SYNC:
+    stallReason = STALL_SYNC;
+    break;
+  }
+}
+
+const char *Thread::getStallReasonName(StallReason reason)
+{
+  switch (reason) {
+  default: break;
+  case STALL_CHANEND_IN: return "Chan in";
+  case STALL_CHANEND_OUT: return "Chan out";
+  case STALL_PORT: return "Port";
+  case STALL_TIMER: return "Timer";
+  case STALL_LOCK: return "Lock";
+  case STALL_SYNC: return "Sync";
+  case STALL_EVENT: return "Event";
+  }
+  return "Other";
+}
+
+void Thread::resetCallStack()
+{
+  Profiler::get().resetCallStack(*this);
+}
+
 bool Thread::setSRSlowPath(sr_t enabled)
 {
   if (enabled[EEBLE]) {
@@ -145,6 +171,8 @@ exception(Core &state, uint32_t pc, int et, uint32_t ed)
 }
 
 static void internalError(const Thread &thread, const char *file, int line) {
+  if (Tracer::get().getTracingEnabled())
+    Tracer::get().flush();
   std::cout << "Internal error in " << file << ":" << line << "\n"
   << "Register state:\n";
   thread.dump();
@@ -510,7 +538,20 @@ threadSetReady(ResourceID resID, uint32_t val, ticks_t time)
   return res->setReady(*this, ready, time);
 }
 
-#ifdef DIRECT_THREADED
+#if defined(TAIL_CALL_DISPATCH)
+// Each INST() starts a new handler. The switch lets the label syntax used by
+// the other dispatchers be reused unchanged.
+#define INST(s) \
+template <unsigned features> \
+void Thread::s ## _handler(Thread &thread, uint32_t pc) \
+{ \
+  DISPATCH_LOCALS \
+  switch (0) case 0
+#define ENDINST \
+  MUSTTAIL return opcode[PC](thread, PC); \
+}
+#define OPCODE(s) (&Thread::s ## _handler<features>)
+#elif defined(DIRECT_THREADED)
 #define INST(s) s ## _label
 #define ENDINST goto *(opcode[PC] + (char*)&&INST(INITIALIZE))
 #define OPCODE(s) ((char*)&&INST(s) - (char*)&&INST(INITIALIZE))
@@ -524,155 +565,98 @@ threadSetReady(ResourceID resID, uint32_t val, ticks_t time)
 #define END_DISPATCH_LOOP } }
 #endif
 
-#define THREAD (*this)
-#define CORE THREAD.getParent()
-#define LOAD_WORD(addr) core->loadWord(addr)
-#define LOAD_SHORT(addr) core->loadShort(addr)
-#define LOAD_BYTE(addr) core->loadByte(addr)
-#define INVALIDATE_WORD(addr) \
-do { \
-  opcode[(addr) >> 1] = OPCODE(DECODE); \
-  opcode[1 + ((addr) >> 1)] = OPCODE(DECODE); \
-} while(0)
-#define INVALIDATE_SHORT(addr) \
-do { \
-  opcode[(addr) >> 1] = OPCODE(DECODE); \
-} while(0)
-#define INVALIDATE_BYTE(addr) INVALIDATE_SHORT(addr)
-
-#define STORE_WORD(value, addr) \
-do { \
-  INVALIDATE_WORD(addr); \
-  core->storeWord(value, addr); \
-} while(0)
-#define STORE_SHORT(value, addr) \
-do { \
-  INVALIDATE_SHORT(addr); \
-  core->storeShort(value, addr); \
-} while(0)
-#define STORE_BYTE(value, addr) \
-do { \
-  INVALIDATE_BYTE(addr); \
-  core->storeByte(value, addr); \
-} while(0)
-
-#define SAVE_CACHED() \
-do { \
-  this->pc = PC;\
-} while(0)
-#define REG(Num) this->regs[Num]
-#define IMM(Num) (Num)
-#define PC pc
-#define TIME this->time
-#define COUNT this->count
-#define LOCAL_MEMORY_ACCESS_CYCLES Config::get().latencyLocalMemory
-#define GLOBAL_MEMORY_ACCESS_CYCLES Config::get().latencyGlobalMemory
-#define TO_PC(addr) (core->physicalAddress(addr) >> 1)
-#define FROM_PC(addr) core->virtualAddress((addr) << 1)
-#define CHECK_PC(addr) ((addr) < (core->ram_size << 1))
-#define OP(n) (operands[PC].ops[(n)])
-#define LOP(n) (operands[PC].lops[(n)])
-#define ADDR(addr) core->physicalAddress(addr)
-#define PHYSICAL_ADDR(addr) core->physicalAddress(addr)
-#define VIRTUAL_ADDR(addr) core->virtualAddress(addr)
-#define CHECK_ADDR(addr) core->isValidAddress(addr)
-#define CHECK_ADDR_SHORT(addr) (!((addr) & 1) && CHECK_ADDR(addr))
-#define CHECK_ADDR_WORD(addr) (!((addr) & 3) && CHECK_ADDR(addr))
-#define EXCEPTION(et, ed) \
-do { \
-  PC = exception(*core, PC, et, ed); \
-  NEXT_THREAD(PC); \
-} while(0);
-#define ERROR() \
-do { \
-  SAVE_CACHED(); \
-  internalError(*this, __FILE__, __LINE__); \
-} while(0)
-#define TRACE(...) \
-do { \
-  if (tracing) { \
-    SAVE_CACHED(); \
-    Tracer::get().trace(*this, __VA_ARGS__); \
-  } \
-} while(0)
-#define TRACE_REG_WRITE(register, value) \
-do { \
-  if (tracing) { \
-    Tracer::get().regWrite(register, value); \
-  } \
-} while(0)
-#define TRACE_END() \
-do { \
-  if (tracing) { \
-    Tracer::get().traceEnd(); \
-  } \
-} while(0)
-#define DESCHEDULE(pc) \
-do { \
-  SAVE_CACHED(); \
-  this->waiting() = true; \
-  return; \
-} while(0)
-#define PAUSE_ON(pc, resource) \
-do { \
-  SAVE_CACHED(); \
-  this->waiting() = true; \
-  this->pausedOn = resource; \
-  return; \
-} while(0)
-#define NEXT_THREAD(pc) \
-do { \
-  if (sys.hasTimeSliceExpired(TIME)) { \
-    SAVE_CACHED(); \
-    sys.schedule(*this); \
-    return; \
-  } \
-} while(0)
-#define TAKE_EVENT(pc) \
-do { \
-  SAVE_CACHED(); \
-  sys.takeEvent(*this); \
-  sys.schedule(*this); \
-  return; \
-} while(0)
-#define SETSR(bits, pc) \
-do { \
-  SAVE_CACHED(); \
-  if (this->setSR(bits)) { \
-    sys.takeEvent(*this); \
-  } \
-  sys.schedule(*this); \
-  return; \
-} while(0)
-#define STATS(...) \
-do { \
-    Stats::get().updateStats(THREAD, __VA_ARGS__); \
-} while(0)
+#include "InstructionMacros.h"
+
+Thread::DispatchLoop Thread::dispatchLoop = &Thread::runAux<0>;
+Thread::DispatchLoop Thread::tracingDispatchLoop = 0;
+
+void Thread::selectDispatchLoop()
+{
+  static const DispatchLoop loops[DISPATCH_ALL_FEATURES + 1] = {
+    &Thread::runAux<0>,
+    &Thread::runAux<1>,
+    &Thread::runAux<2>,
+    &Thread::runAux<3>,
+    &Thread::runAux<4>,
+    &Thread::runAux<5>,
+    &Thread::runAux<6>,
+    &Thread::runAux<7>,
+    &Thread::runAux<8>,
+    &Thread::runAux<9>,
+    &Thread::runAux<10>,
+    &Thread::runAux<11>,
+    &Thread::runAux<12>,
+    &Thread::runAux<13>,
+    &Thread::runAux<14>,
+    &Thread::runAux<15>,
+  };
+  unsigned features = 0;
+  if (Tracer::get().getTracingEnabled())
+    features |= DISPATCH_TRACING;
+  if (Stats::get().getEnabled())
+    features |= DISPATCH_STATS;
+  if (Config::get().latencyLocalMemory || Config::get().latencyGlobalMemory)
+    features |= DISPATCH_MEMORY_LATENCY;
+  if (Profiler::get().getEnabled())
+    features |= DISPATCH_PROFILING;
+  dispatchLoop = loops[features];
+  tracingDispatchLoop = 0;
+  if ((features & DISPATCH_TRACING) && Tracer::get().getFilter().isActive()) {
+    // Only run threads the trace filter selects with the tracing loop.
+    dispatchLoop = loops[features & ~DISPATCH_TRACING];
+    tracingDispatchLoop = loops[features];
+  }
+}
 
 void Thread::run(ticks_t time)
 {
-  if (Tracer::get().getTracingEnabled())
-    runAux<true>(time);
+  if (tracingDispatchLoop && Tracer::get().getFilter().mayTrace(*this))
+    (this->*tracingDispatchLoop)(time);
   else
-    runAux<false>(time);
+    (this->*dispatchLoop)(time);
 }
 
-template <bool tracing>
+#ifdef TAIL_CALL_DISPATCH
+template <unsigned features>
 void Thread::runAux(ticks_t time) {
-  SystemState &sys = *getParent().getParent()->getParent();
+  // Handlers call each other until a handler returns. On backward branches
+  // and indirect jumps we call NEXT_THREAD() to ensure one thread which never
+  // pauses cannot starve the other threads.
+  uint32_t pc = this->pc;
+  const bool tracing = (features & DISPATCH_TRACING) != 0;
+  if (tracing)
+    getParent().allocTracingCache();
+  OPCODE_TYPE handler = getParent().getOpcodeCache(tracing)[pc];
+  if (!handler)
+    handler = OPCODE(INITIALIZE);
+  handler(*this, pc);
+}
+#else
+template <unsigned features>
+void Thread::runAux(ticks_t time) {
+  if (features & DISPATCH_TRACING)
+    getParent().allocTracingCache();
+  DISPATCH_LOCALS
   uint32_t pc = this->pc;
-  Core *core = &this->getParent();
-  OPCODE_TYPE *opcode = core->opcode;
-  Operands *operands = core->operands;
 
     // The main dispatch loop. On backward branches and indirect jumps we call
   // NEXT_THREAD() to ensure one thread which never pauses cannot starve the
   // other threads.
   START_DISPATCH_LOOP
+#endif
   INST(INITIALIZE):
-    getParent().initCache(OPCODE(DECODE), OPCODE(ILLEGAL_PC),
-                          OPCODE(ILLEGAL_PC_THREAD), OPCODE(SYSCALL),
-                          OPCODE(EXCEPTION));
+    {
+      THREAD.getParent().initCache(tracing, OPCODE(DECODE),
+                                   OPCODE(ILLEGAL_PC),
+                                   OPCODE(ILLEGAL_PC_THREAD), OPCODE(SYSCALL),
+                                   OPCODE(EXCEPTION));
+#ifdef TAIL_CALL_DISPATCH
+      // Translated code is only used when no tracing, statistics or latency
+      // modelling is required.
+      if (features == 0)
+        THREAD.getParent().installNativeCode();
+#endif
+    }
     ENDINST;
 #define EMIT_INSTRUCTION_DISPATCH
 #include "InstructionGenOutput.inc"
@@ -682,7 +666,7 @@ void Thread::runAux(ticks_t time) {
     {
       TRACE("tsetmr ", Register(OP(0)), ", ", SrcRegister(OP(1)));
       TIME += INSTRUCTION_CYCLES;
-      Synchroniser *sync = this->getSync();
+      Synchroniser *sync = THREAD.getSync();
       if (sync) {
         sync->master().reg(IMM(OP(0))) = REG(OP(1));
       } else {
@@ -700,13 +684,13 @@ void Thread::runAux(ticks_t time) {
     {
       TRACE("ssync");
       TIME += INSTRUCTION_CYCLES;
-      Synchroniser *sync = this->getSync();
+      Synchroniser *sync = THREAD.getSync();
       // May schedule / deschedule threads
       if (!sync) {
         // TODO is this right?
         DESCHEDULE(PC);
       } else {
-        switch (sync->ssync(*this)) {
+        switch (sync->ssync(THREAD)) {
         case Synchroniser::SYNC_CONTINUE:
           PC++;
           break;
@@ -716,7 +700,7 @@ void Thread::runAux(ticks_t time) {
           break;
         case Synchroniser::SYNC_KILL:
           {
-            free();
+            THREAD.free();
             TRACE_END();
             DESCHEDULE(PC);
           }
@@ -728,11 +712,11 @@ void Thread::runAux(ticks_t time) {
   INST(FREET_0r):
     {
       TRACE("freet");
-      if (this->getSync()) {
+      if (THREAD.getSync()) {
         // TODO check expected behaviour
         ERROR();
       }
-      free();
+      THREAD.free();
       TRACE_END();
       DESCHEDULE(PC);
     }
@@ -740,41 +724,54 @@ void Thread::runAux(ticks_t time) {
   
   // Pseudo instructions.
   INST(SYSCALL):
-    int retval;
-    this->pc = PC;
-    switch (SyscallHandler::doSyscall(*this, retval)) {
-    case SyscallHandler::EXIT:
-      throw (ExitException(retval));
-    case SyscallHandler::DESCHEDULE:
-      DESCHEDULE(PC);
-      break;
-    case SyscallHandler::CONTINUE:
-      uint32_t target = TO_PC(REG(LR));
-      if (CHECK_PC(target)) {
+    {
+      int retval;
+      THREAD.pc = PC;
+      SyscallHandler::SycallOutcome outcome =
+        SyscallHandler::doSyscall(THREAD, retval);
+      switch (outcome) {
+      case SyscallHandler::EXIT:
+        throw (ExitException(retval));
+      case SyscallHandler::DESCHEDULE:
+        DESCHEDULE(PC);
+        break;
+      case SyscallHandler::CONTINUE:
+      case SyscallHandler::YIELD:
+        uint32_t target = TO_PC(REG(LR));
+        if (!CHECK_PC(target)) {
+          EXCEPTION(ET_ILLEGAL_PC, REG(LR));
+          break;
+        }
         PC = target;
+        if (outcome == SyscallHandler::YIELD) {
+          SAVE_CACHED();
+          sys.schedule(THREAD);
+          return;
+        }
         NEXT_THREAD(PC);
-      } else {
-        EXCEPTION(ET_ILLEGAL_PC, REG(LR));
+        break;
       }
-      break;
     }
     ENDINST;
   INST(EXCEPTION):
-    this->pc = PC;
-    SyscallHandler::doException(*this);
-    throw (ExitException(1));
+    {
+      THREAD.pc = PC;
+      SyscallHandler::doException(THREAD);
+      throw (ExitException(1));
+    }
     ENDINST;
   INST(ILLEGAL_PC):
     EXCEPTION(ET_ILLEGAL_PC, FROM_PC(PC));
     ENDINST;
   INST(ILLEGAL_PC_THREAD):
-    EXCEPTION(ET_ILLEGAL_PC, this->illegal_pc);
+    EXCEPTION(ET_ILLEGAL_PC, THREAD.illegal_pc);
     ENDINST;
   INST(ILLEGAL_INSTRUCTION):
     EXCEPTION(ET_ILLEGAL_INSTRUCTION, 0);
     ENDINST;
   INST(DECODE):
     {
+      core->decodeCount++;
       uint16_t low = core->loadShort(PC << 1);
       uint16_t high = 0;
       bool highValid;
@@ -786,180 +783,13 @@ void Thread::runAux(ticks_t time) {
       }
       InstructionOpcode opc;
       instructionDecode(low, high, highValid, opc, operands[PC]);
-      switch (opc) {
-      default:
-        break;
-      case ADD_2rus:
-        if (OP(2) == 0) {
-          opc = ADD_mov_2rus;
-        }
-        break;
-      case STW_2rus:
-      case LDW_2rus:
-      case LDAWF_l2rus:
-      case LDAWB_l2rus:
-        OP(2) = OP(2) << 2;
-        break;
-      case STWDP_ru6:
-      case STWSP_ru6:
-      case LDWDP_ru6:
-      case LDWSP_ru6:
-      case LDAWDP_ru6:
-      case LDAWSP_ru6:
-      case LDWCP_ru6:
-      case STWDP_lru6:
-      case STWSP_lru6:
-      case LDWDP_lru6:
-      case LDWSP_lru6:
-      case LDAWDP_lru6:
-      case LDAWSP_lru6:
-      case LDWCP_lru6:
-        OP(1) = OP(1) << 2;
-        break;
-      case EXTDP_u6:
-      case ENTSP_u6:
-      case EXTSP_u6:
-      case RETSP_u6:
-      case KENTSP_u6:
-      case KRESTSP_u6:
-      case LDAWCP_u6:
-      case LDWCPL_u10:
-      case EXTDP_lu6:
-      case ENTSP_lu6:
-      case EXTSP_lu6:
-      case RETSP_lu6:
-      case KENTSP_lu6:
-      case KRESTSP_lu6:
-      case LDAWCP_lu6:
-      case LDWCPL_lu10:
-        OP(0) = OP(0) << 2;
-        break;
-      case LDAPB_u10:
-      case LDAPF_u10:
-      case LDAPB_lu10:
-      case LDAPF_lu10:
-        OP(0) = OP(0) << 1;
-        break;
-      case SHL_2rus:
-        if (OP(2) == 32) {
-          opc = SHL_32_2rus;
-        }
-        break;
-      case SHR_2rus:
-        if (OP(2) == 32) {
-          opc = SHR_32_2rus;
-        }
-        break;
-      case ASHR_l2rus:
-        if (OP(2) == 32) {
-          opc = ASHR_32_l2rus;
-        }
-        break;
-      case BRFT_ru6:
-        OP(1) = PC + 1 + OP(1);
-        if (!CHECK_PC(OP(1))) {
-          opc = BRFT_illegal_ru6;
-        }
-        break;
-      case BRBT_ru6:
-        OP(1) = PC + 1 - OP(1);
-        if (!CHECK_PC(OP(1))) {
-          opc = BRBT_illegal_ru6;
-        }
-        break;
-      case BRFU_u6:
-        OP(0) = PC + 1 + OP(0);
-        if (!CHECK_PC(OP(0))) {
-          opc = BRFU_illegal_u6;
-        }
-        break;
-      case BRBU_u6:
-        OP(0) = PC + 1 - OP(0);
-        if (!CHECK_PC(OP(0))) {
-          opc = BRBU_illegal_u6;
-        }
-        break;
-      case BRFF_ru6:
-        OP(1) = PC + 1 + OP(1);
-        if (!CHECK_PC(OP(1))) {
-          opc = BRFF_illegal_ru6;
-        }
-        break;
-      case BRBF_ru6:
-        OP(1) = PC + 1 - OP(1);
-        if (!CHECK_PC(OP(1))) {
-          opc = BRBF_illegal_ru6;
-        }
-        break;
-      case BLRB_u10:
-        OP(0) = PC + 1 - OP(0);
-        if (!CHECK_PC(OP(0))) {
-          opc = BLRB_illegal_u10;
-        }
-        break;
-      case BLRF_u10:
-        OP(0) = PC + 1 + OP(0);
-        if (!CHECK_PC(OP(0))) {
-          opc = BLRF_illegal_u10;
-        }
-        break;
-      case BRFT_lru6:
-        OP(1) = PC + 2 + OP(1);
-        if (!CHECK_PC(OP(1))) {
-          opc = BRFT_illegal_lru6;
-        }
-        break;
-      case BRBT_lru6:
-        OP(1) = PC + 2 - OP(1);
-        if (!CHECK_PC(OP(1))) {
-          opc = BRBT_illegal_lru6;
-        }
-        break;
-      case BRFU_lu6:
-        OP(0) = PC + 2 + OP(0);
-        if (!CHECK_PC(OP(0))) {
-          opc = BRFU_illegal_lu6;
-        }
-        break;
-      case BRBU_lu6:
-        OP(0) = PC + 2 - OP(0);
-        if (!CHECK_PC(OP(0))) {
-          opc = BRBU_illegal_lu6;
-        }
-        break;
-      case BRFF_lru6:
-        OP(1) = PC + 2 + OP(1);
-        if (!CHECK_PC(OP(1))) {
-          opc = BRFF_illegal_lru6;
-        }
-        break;
-      case BRBF_lru6:
-        OP(1) = PC + 2 - OP(1);
-        if (!CHECK_PC(OP(1))) {
-          opc = BRBF_illegal_lru6;
-        }
-        break;
-      case BLRB_lu10:
-        OP(0) = PC + 2 - OP(0);
-        if (!CHECK_PC(OP(0))) {
-          opc = BLRB_illegal_lu10;
-        }
-        break;
-      case BLRF_lu10:
-        OP(0) = PC + 2 + OP(0);
-        if (!CHECK_PC(OP(0))) {
-          opc = BLRF_illegal_lu10;
-        }
-        break;
-      case MKMSK_rus:
-        OP(1) = makeMask(OP(1));
-        if (!tracing) {
-          opc = LDC_ru6;
-        }
-        break;
-      }
-#ifdef DIRECT_THREADED
-      static OPCODE_TYPE opcodeMap[] = {
+      instructionTransform(opc, operands[PC], PC, core->ram_size, tracing);
+      // Loops polling a timer are only skipped when nothing is recorded per
+      // instruction.
+      if (!tracing && !stats && !profiling)
+        SpinLoop::transformBranch(*core, opc, operands[PC], PC);
+#if defined(DIRECT_THREADED) || defined(TAIL_CALL_DISPATCH)
+      static const OPCODE_TYPE opcodeMap[] = {
 #define EMIT_INSTRUCTION_LIST
 #define DO_INSTRUCTION(inst) OPCODE(inst),
 #include "InstructionGenOutput.inc"
@@ -970,9 +800,11 @@ void Thread::runAux(ticks_t time) {
 #else
       opcode[PC] = opc;
 #endif
-      // Reexecute current instruction.
-      ENDINST;
     }
+    // Reexecute current instruction.
+    ENDINST;
+#ifndef TAIL_CALL_DISPATCH
   END_DISPATCH_LOOP
 }
+#endif
 
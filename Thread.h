@@ -11,8 +11,10 @@
 #include <bitset>
 #include "Runnable.h"
 #include "Resource.h"
+#include "Register.h"
 
 class Synchroniser;
+struct CallStack;
 
 class ExitException {
   unsigned status;
@@ -21,47 +23,6 @@ public:
   unsigned getStatus() const { return status; }
 };
 
-enum Register {
-  R0,
-  R1,
-  R2,
-  R3,
-  R4,
-  R5,
-  R6,
-  R7,
-  R8,
-  R9,
-  R10,
-  R11,
-  CP,
-  DP,
-  SP,
-  LR,
-  ET,
-  ED,
-  KEP,
-  KSP,
-  SPC,
-  SED,
-  SSR,
-  NUM_REGISTERS
-};
-
-extern const char *registerNames[];
-
-inline const char *getRegisterName(unsigned RegNum) {
-  if (RegNum < NUM_REGISTERS) {
-    return registerNames[RegNum];
-  }
-  return "?";
-}
-
-inline std::ostream &operator<<(std::ostream &out, const Register &r)
-{
-  return out << getRegisterName(r);
-}
-
 class EventableResourceIterator :
   public std::iterator<std::forward_iterator_tag, int> {
 public:
@@ -133,6 +94,18 @@ public:
     WAITING = 6,
     FAST = 7
   };
+  /// What a descheduled thread is waiting for.
+  enum StallReason {
+    STALL_CHANEND_IN,
+    STALL_CHANEND_OUT,
+    STALL_PORT,
+    STALL_TIMER,
+    STALL_LOCK,
+    STALL_SYNC,
+    STALL_EVENT,
+    STALL_OTHER,
+    NUM_STALL_REASONS
+  };
   typedef std::bitset<8> sr_t;
   uint32_t regs[NUM_REGISTERS];
   /// The program counter. Note that the pc will not be valid if the thread is
@@ -143,6 +116,21 @@ public:
   ticks_t time;
   // Instructions executed count
   long count;
+  /// The time or instruction count at which the profiler next samples the
+  /// thread, or 0 if the thread hasn't been sampled since it was allocated.
+  uint64_t nextProfileSample;
+  /// The time at the end of the last instruction counted by the exact
+  /// profiler.
+  ticks_t profileTime;
+  /// The shadow call stack maintained by the call graph profiler, or null if
+  /// the call graph isn't being profiled.
+  CallStack *callStack;
+  /// Cycles spent descheduled for each reason.
+  ticks_t stallCycles[NUM_STALL_REASONS];
+  /// The time the thread was descheduled and the reason why. Only valid while
+  /// the thread is waiting.
+  ticks_t stallStart;
+  StallReason stallReason;
   sr_t sr;
   uint32_t illegal_pc;
   /// The resource on which the thread is paused on.
@@ -151,6 +139,13 @@ public:
   Thread() : Resource(RES_TYPE_THREAD), parent(0) {
     time = 0;
     pc = 0;
+    nextProfileSample = 0;
+    profileTime = 0;
+    callStack = 0;
+    for (unsigned i = 0; i < NUM_STALL_REASONS; i++)
+      stallCycles[i] = 0;
+    stallStart = 0;
+    stallReason = STALL_OTHER;
     regs[KEP] = 0;
     regs[KSP] = 0;
     regs[SPC] = 0;
@@ -176,6 +171,18 @@ public:
 
   void setParent(Core &p) { parent = &p; }
 
+  /// Record that the thread is being descheduled at the current time. The
+  /// resource is the one the thread is paused on, or null if the thread is
+  /// waiting for an event.
+  void beginStall(const Resource *res);
+  /// Add the time since the thread was descheduled to its stall cycles.
+  void endStall()
+  {
+    if (time > stallStart)
+      stallCycles[stallReason] += time - stallStart;
+  }
+  static const char *getStallReasonName(StallReason reason);
+
   Core &getParent() { return *parent; }
   const Core &getParent() const { return *parent; }
     
@@ -207,10 +214,16 @@ public:
     sync = 0;
     ssync = true;
     time = t;
+    nextProfileSample = 0;
+    profileTime = t;
+    if (callStack)
+      resetCallStack();
     pausedOn = 0;
   }
 
 private:
+  void resetCallStack();
+
   void setSync(Synchroniser &s)
   {
     assert(!sync && "Synchroniser set twice");
@@ -314,10 +327,45 @@ private:
   }
 
 public:
+  /// Features the dispatch loop is specialised on. Each combination has its
+  /// own instantiation of the dispatch loop so disabled features cost nothing.
+  enum DispatchFeature {
+    DISPATCH_TRACING = 1 << 0,
+    DISPATCH_STATS = 1 << 1,
+    DISPATCH_MEMORY_LATENCY = 1 << 2,
+    DISPATCH_PROFILING = 1 << 3,
+    DISPATCH_ALL_FEATURES = (1 << 4) - 1
+  };
+
   bool isExecuting() const;
   void run(ticks_t time);
+  /// Select the dispatch loop to use based on the current tracing, statistics,
+  /// latency and profiling configuration. Must be called before any thread is run.
+  static void selectDispatchLoop();
+#ifdef TAIL_CALL_DISPATCH
+  /// Handlers for translated blocks. Specialisations are defined in the
+  /// shared objects produced by axe-aot.
+  template <unsigned block>
+  static void nativeBlock(Thread &thread, uint32_t pc);
+#endif
 private:
-  template <bool tracing> void runAux(ticks_t time);
+  typedef void (Thread::*DispatchLoop)(ticks_t);
+  static DispatchLoop dispatchLoop;
+  /// If non null, the dispatch loop used for threads the trace filter
+  /// selects. Other threads use dispatchLoop, which doesn't trace.
+  static DispatchLoop tracingDispatchLoop;
+  template <unsigned features> void runAux(ticks_t time);
+#ifdef TAIL_CALL_DISPATCH
+  // One handler per instruction. Each handler executes the instruction at pc
+  // on the thread and tail calls the handler for the next instruction.
+#define EMIT_INSTRUCTION_LIST
+#define DO_INSTRUCTION(inst) \
+  template <unsigned features> \
+  static void inst ## _handler(Thread &thread, uint32_t pc);
+#include "InstructionGenOutput.inc"
+#undef EMIT_INSTRUCTION_LIST
+#undef DO_INSTRUCTION
+#endif
   bool setSRSlowPath(sr_t old);
   uint32_t exception(Core &state, uint32_t pc, int et, uint32_t ed);
   bool setC(ticks_t time, ResourceID resID, uint32_t val);
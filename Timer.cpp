@@ -13,10 +13,19 @@ bool Timer::conditionMet(ticks_t time) const
   return ((int32_t)(time / CYCLES_PER_TICK) - (int32_t)data) > 0;
 }
 
+void Timer::cancelUnneededUpdate()
+{
+  // If events are enabled again the wake up is rescheduled by
+  // seeEventEnable().
+  if (!pausedIn && !eventsPermitted())
+    cancelUpdate();
+}
+
 bool Timer::
 setCondition(Thread &thread, Condition c, ticks_t time)
 {
   updateOwner(thread);
+  cancelUnneededUpdate();
   switch (c) {
   default: return false;
   case COND_FULL:
@@ -33,6 +42,7 @@ bool Timer::
 setData(Thread &thread, uint32_t d, ticks_t time)
 {
   updateOwner(thread);
+  cancelUnneededUpdate();
   data = d;
   return true;
 }
@@ -58,6 +68,16 @@ ticks_t Timer::getEarliestReadyTime(ticks_t time) const
   return time + wait * CYCLES_PER_TICK;
 }
 
+bool Timer::inputsReadyBetween(ticks_t start, ticks_t end) const
+{
+  if (!after)
+    return true;
+  // The condition holds for a contiguous range of just under 2^31 timer
+  // values, so it holds over any shorter range on which it holds at both ends.
+  return conditionMet(start) && conditionMet(end) &&
+         (end / CYCLES_PER_TICK) - (start / CYCLES_PER_TICK) < (1U << 31);
+}
+
 void Timer::run(ticks_t time)
 {
   if (!conditionMet(time))
@@ -17,6 +17,9 @@ private:
 
   /// Return whether the condition is met for the specified time.
   bool conditionMet(ticks_t time) const;
+  /// Remove the timer from the scheduler if nothing is waiting on it so a
+  /// wake up scheduled for an earlier wait doesn't run after it is reused.
+  void cancelUnneededUpdate();
 public:
   Timer() :
     EventableResource(RES_TYPE_TIMER),
@@ -33,6 +36,8 @@ public:
 
   bool free()
   {
+    if (isInUse())
+      cancelUnneededUpdate();
     eventableSetInUseOff();
     return true;
   }
@@ -44,6 +49,10 @@ public:
 
   /// Returns the earliest time at which the timer will become ready.
   ticks_t getEarliestReadyTime(ticks_t time) const;
+
+  /// Returns whether inputs at all times between start and end (inclusive)
+  /// complete without pausing.
+  bool inputsReadyBetween(ticks_t start, ticks_t end) const;
   
   void run(ticks_t time);
 
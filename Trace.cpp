@@ -9,30 +9,20 @@
 #include "Core.h"
 #include "Resource.h"
 #include "Exceptions.h"
-#include <iomanip>
-#include <sstream>
-#include <cstring>
-
-const unsigned mnemonicColumn = 49;
-const unsigned regWriteColumn = 87;
+#include <csignal>
 
 Tracer Tracer::instance;
 
 Tracer::PushLineState::PushLineState() :
-  needRestore(false),
-  line(Tracer::get().line.pending)
+  lineThread(Tracer::get().lineThread)
 {
-  if (Tracer::get().line.thread) {
-    std::swap(Tracer::get().line, line);
-    needRestore = true;
-  }
+  Tracer::get().out->pushLine();
 }
 
 Tracer::PushLineState::~PushLineState()
 {
-  if (needRestore) {
-    std::swap(Tracer::get().line, line);
-  }
+  Tracer::get().out->popLine();
+  Tracer::get().lineThread = lineThread;
 }
 
 void Tracer::setSymbolInfo(std::auto_ptr<SymbolInfo> &si)
@@ -40,171 +30,138 @@ void Tracer::setSymbolInfo(std::auto_ptr<SymbolInfo> &si)
   symInfo = si;
 }
 
-void Tracer::setColour(bool enable)
+bool Tracer::setBinaryOutput(const std::string &filename)
 {
-  colours = enable ? TerminalColours::ansi : TerminalColours::null;
+  std::auto_ptr<BinaryTraceFileSink> fileSink(new BinaryTraceFileSink);
+  if (!fileSink->open(filename))
+    return false;
+  sink.reset(fileSink.release());
+  return true;
 }
 
-void Tracer::escapeCode(const char *s)
+static void flushTraceAndRaise(int sig)
 {
-  *line.buf << s;
-  line.numEscapeChars += std::strlen(s);
+  std::signal(sig, SIG_DFL);
+  Tracer::get().flushFromSignal();
+  std::raise(sig);
 }
 
-void Tracer::printCommonEnd()
+static void installSignalHandlers()
 {
-  *line.buf << '\n';
-  if (line.out) {
-    *line.out << line.buf->str() << line.pending->str();
-    line.buf->str("");
+  const int signals[] = {
+    SIGABRT, SIGFPE, SIGILL, SIGINT, SIGSEGV, SIGTERM,
+#ifdef SIGBUS
+    SIGBUS,
+#endif
+#ifdef SIGHUP
+    SIGHUP,
+#endif
+  };
+  for (unsigned i = 0; i < sizeof(signals) / sizeof(signals[0]); i++) {
+    std::signal(signals[i], flushTraceAndRaise);
   }
-  line.thread = 0;
 }
 
-void Tracer::printCommonStart()
+void Tracer::setTracingEnabled(bool enable)
 {
-  if (line.pending) {
-    line.pending->str("");
-  }
-  line.numEscapeChars = 0;
-  line.hadRegWrite = false;
-  line.thread = 0;
+  tracingEnabled = enable;
+  if (!enable || writer.get())
+    return;
+  if (!sink.get())
+    sink.reset(new BinaryTraceDecodingSink(formatter));
+  writer.reset(new BinaryTraceWriter(*sink));
+  out = writer.get();
+  installSignalHandlers();
 }
 
-void Tracer::printThreadName()
+void Tracer::flushFromSignal()
 {
-  *line.buf << line.thread->getParent().getCoreName();
-  *line.buf << ":t" << line.thread->getNum();
+  if (writer.get())
+    writer->flushFromSignal();
 }
 
-void Tracer::printCommonStart(const Thread &t)
+unsigned Tracer::addCore(const Core &core)
 {
-  printCommonStart();
-  line.thread = &t;
-
-  // TODO add option to show cycles?
-  *line.buf << std::setw(6) << (uint64_t)line.thread->time;
-  *line.buf << ' ';
-  green();
-  *line.buf << '<';
-  printThreadName();
-  *line.buf << '>';
-  reset();
+  std::pair<std::map<const Core*,unsigned>::iterator,bool> result =
+    coreIDs.insert(std::make_pair(&core, coreIDs.size()));
+  if (result.second) {
+    const CoreSymbolInfo *symbols =
+      symInfo.get() ? symInfo->getCoreSymbolInfo(&core) : 0;
+    out->addCore(result.first->second, core.getCoreName(), symbols);
+  }
+  return result.first->second;
 }
 
-void Tracer::printCommonStart(const Node &n)
+void Tracer::printCommonEnd()
 {
-  printCommonStart();
+  out->endLine();
+  lineThread = 0;
+}
 
-  green();
-  *line.buf << '<';
-  *line.buf << 'n' << n.getNodeID();
-  *line.buf << '>';
-  reset();
+void Tracer::printCommonStart()
+{
+  out->startLine();
+  lineThread = 0;
 }
 
-void Tracer::printThreadPC()
+void Tracer::printCommonStart(const Thread &t)
 {
-  unsigned pc = line.thread->getParent().targetPc(line.thread->pc);  
-  const Core *core = &line.thread->getParent();
-  const ElfSymbol *sym;
-  if (symInfo.get() && (sym = symInfo->getFunctionSymbol(core, pc))) {
-    *line.buf << sym->name;
-    if (sym->value != pc)
-      *line.buf << '+' << (pc - sym->value);
-    *line.buf << "(0x" << std::hex << pc << std::dec << ')';
-  } else {
-    *line.buf << "0x" << std::hex << pc << std::dec;
-  }
+  out->startThreadLine(t.time, getCoreID(t.getParent()), t.getNum());
+  lineThread = &t;
 }
 
-void Tracer::printInstructionStart(const Thread &t)
+void Tracer::printCommonStart(const Node &n)
 {
-  printCommonStart(t);
-  *line.buf << ' ';
-  printThreadPC();
-  *line.buf << ": ";
-
-  // Align
-  size_t pos = line.buf->str().size() - line.numEscapeChars;
-  if (pos < mnemonicColumn) {
-    *line.buf << std::setw(mnemonicColumn - pos) << "";
-  }
+  out->startNodeLine(n.getNodeID());
+  lineThread = 0;
 }
 
-void Tracer::printOperand(Register op)
+void Tracer::printThreadPC(const Thread &t)
 {
-  *line.buf << op;
+  out->pc(t.getParent().targetPc(t.pc));
+}
+
+bool Tracer::printInstructionStart(const Thread &t)
+{
+  suppressLine = !filterThread(t);
+  if (suppressLine)
+    return false;
+  printCommonStart(t);
+  out->text(" ");
+  printThreadPC(t);
+  out->text(": ");
+  out->alignMnemonic();
+  return true;
 }
 
 void Tracer::printOperand(SrcRegister op)
 {
   Register reg = op.getRegister();
-  *line.buf << reg << "(0x" << std::hex << line.thread->regs[reg] << ')'
-       << std::dec;
+  out->srcReg(reg, lineThread->regs[reg]);
 }
 
 void Tracer::printOperand(CPRelOffset op)
 {
-  uint32_t cpValue = line.thread->regs[CP];
-  uint32_t address = cpValue + (op.getOffset() << 2);
-  const Core *core = &line.thread->getParent();
-  const ElfSymbol *sym, *cpSym;
-  if (symInfo.get() &&
-      (sym = symInfo->getDataSymbol(core, address)) &&
-      sym->value == address &&
-      (cpSym = symInfo->getGlobalSymbol(core, "_cp")) &&
-      cpSym->value == cpValue) {
-    *line.buf << sym->name;
-    *line.buf << "(0x" << std::hex << address << ')';
-  } else {
-    *line.buf << op.getOffset();
-  }
+  out->cpRelOffset(op.getOffset(), lineThread->regs[CP]);
 }
 
 void Tracer::printOperand(DPRelOffset op)
 {
-  uint32_t dpValue = line.thread->regs[DP];
-  uint32_t address = dpValue + (op.getOffset() << 2);
-  const Core *core = &line.thread->getParent();
-  const ElfSymbol *sym, *dpSym;
-  if (symInfo.get() &&
-      (sym = symInfo->getDataSymbol(core, address)) &&
-      sym->value == address &&
-      (dpSym = symInfo->getGlobalSymbol(core, "_dp")) &&
-      dpSym->value == dpValue) {
-    *line.buf << sym->name;
-    *line.buf << "(0x" << std::hex << address << std::dec << ')';
-  } else {
-    *line.buf << op.getOffset();
-  }
-}
-
-void Tracer::regWrite(Register reg, uint32_t value)
-{
-  if (!line.hadRegWrite) {
-    *line.buf << ' ';
-    // Align
-    size_t pos = line.buf->str().size() - line.numEscapeChars;
-    if (pos < regWriteColumn) {
-      *line.buf << std::setw(regWriteColumn - pos) << "";
-    }
-    *line.buf << "# ";
-  } else {
-    *line.buf << ", ";
-  }
-  *line.buf << reg << "=0x" << std::hex << value << std::dec;
-  line.hadRegWrite = true;
+  out->dpRelOffset(op.getOffset(), lineThread->regs[DP]);
 }
 
 void Tracer::SSwitchRead(const Node &node, uint32_t retAddress, uint16_t regNum)
 {
+  if (!filter.getEnabled())
+    return;
   PushLineState save;
   printCommonStart(node);
   red();
-  *line.buf << " SSwitch read: ";
-  *line.buf << "register 0x" << std::hex << regNum;
-  *line.buf << ", reply address 0x" << retAddress << std::dec;
+  out->text(" SSwitch read: ");
+  out->text("register 0x");
+  out->hexValue(regNum);
+  out->text(", reply address 0x");
+  out->hexValue(retAddress);
   reset();
   printCommonEnd();
 }
@@ -213,47 +170,62 @@ void Tracer::
 SSwitchWrite(const Node &node, uint32_t retAddress, uint16_t regNum,
              uint32_t value)
 {
+  if (!filter.getEnabled())
+    return;
   PushLineState save;
   printCommonStart(node);
   red();
-  *line.buf << " SSwitch write: ";
-  *line.buf << "register 0x" << std::hex << regNum;
-  *line.buf << ", value 0x" << value;
-  *line.buf << ", reply address 0x" << retAddress << std::dec;
+  out->text(" SSwitch write: ");
+  out->text("register 0x");
+  out->hexValue(regNum);
+  out->text(", value 0x");
+  out->hexValue(value);
+  out->text(", reply address 0x");
+  out->hexValue(retAddress);
   reset();
   printCommonEnd();
 }
 
 void Tracer::SSwitchNack(const Node &node, uint32_t dest)
 {
+  if (!filter.getEnabled())
+    return;
   PushLineState save;
   printCommonStart(node);
   red();
-  *line.buf << " SSwitch reply: NACK";
-  *line.buf << ", destintion 0x" << std::hex << dest << std::dec;
+  out->text(" SSwitch reply: NACK");
+  out->text(", destintion 0x");
+  out->hexValue(dest);
   reset();
   printCommonEnd();
 }
 
 void Tracer::SSwitchAck(const Node &node, uint32_t dest)
 {
+  if (!filter.getEnabled())
+    return;
   PushLineState save;
   printCommonStart(node);
   red();
-  *line.buf << " SSwitch reply: ACK";
-  *line.buf << ", destintion 0x" << std::hex << dest << std::dec;
+  out->text(" SSwitch reply: ACK");
+  out->text(", destintion 0x");
+  out->hexValue(dest);
   reset();
   printCommonEnd();
 }
 
 void Tracer::SSwitchAck(const Node &node, uint32_t data, uint32_t dest)
 {
+  if (!filter.getEnabled())
+    return;
   PushLineState save;
   printCommonStart(node);
   red();
-  *line.buf << " SSwitch reply: ACK";
-  *line.buf << ", data 0x" << std::hex << data;
-  *line.buf << ", destintion 0x" << dest << std::dec;
+  out->text(" SSwitch reply: ACK");
+  out->text(", data 0x");
+  out->hexValue(data);
+  out->text(", destintion 0x");
+  out->hexValue(dest);
   reset();
   printCommonEnd();
 }
@@ -262,14 +234,17 @@ void Tracer::
 event(const Thread &t, const EventableResource &res, uint32_t pc,
       uint32_t ev)
 {
+  if (!filterThread(t))
+    return;
   PushLineState save;
   printCommonStart(t);
   red();
-  *line.buf << " Event caused by "
-       << Resource::getResourceName(static_cast<const Resource&>(res).getType())
-       << " 0x" << std::hex << (uint32_t)res.getID() << std::dec;
+  out->text(" Event caused by ");
+  out->text(Resource::getResourceName(static_cast<const Resource&>(res).getType()));
+  out->text(" 0x");
+  out->hexValue((uint32_t)res.getID());
   reset();
-  regWrite(ED, ev);
+  out->regWrite(ED, ev);
   printCommonEnd();
 }
 
@@ -277,17 +252,20 @@ void Tracer::
 interrupt(const Thread &t, const EventableResource &res, uint32_t pc,
           uint32_t ssr, uint32_t spc, uint32_t sed, uint32_t ed)
 {
+  if (!filterThread(t))
+    return;
   PushLineState save;
   printCommonStart(t);
   red();
-  *line.buf << " Interrupt caused by "
-       << Resource::getResourceName(static_cast<const Resource&>(res).getType())
-       << " 0x" << std::hex << (uint32_t)res.getID() << std::dec;
+  out->text(" Interrupt caused by ");
+  out->text(Resource::getResourceName(static_cast<const Resource&>(res).getType()));
+  out->text(" 0x");
+  out->hexValue((uint32_t)res.getID());
   reset();
-  regWrite(ED, ed);
-  regWrite(SSR, ssr);
-  regWrite(SPC, spc);
-  regWrite(SED, sed);
+  out->regWrite(ED, ed);
+  out->regWrite(SSR, ssr);
+  out->regWrite(SPC, spc);
+  out->regWrite(SED, sed);
   printCommonEnd();
 }
 
@@ -295,55 +273,64 @@ void Tracer::
 exception(const Thread &t, uint32_t et, uint32_t ed, 
           uint32_t sed, uint32_t ssr, uint32_t spc)
 {
+  if (!filterThread(t))
+    return;
   PushLineState save;
   printCommonStart(t);
   red();
-  *line.buf << ' ' << Exceptions::getExceptionName(et) << " exception";
+  out->text(" ");
+  out->text(Exceptions::getExceptionName(et));
+  out->text(" exception");
   reset();
-  regWrite(ET, et);
-  regWrite(ED, ed);
-  regWrite(SSR, ssr);
-  regWrite(SPC, spc);
-  regWrite(SED, sed);
+  out->regWrite(ET, et);
+  out->regWrite(ED, ed);
+  out->regWrite(SSR, ssr);
+  out->regWrite(SPC, spc);
+  out->regWrite(SED, sed);
   printCommonEnd();
 }
 
-void Tracer::
+bool Tracer::
 syscallBegin(const Thread &t)
 {
+  suppressLine = !filterThread(t);
+  if (suppressLine)
+    return false;
   printCommonStart(t);
   red();
-  *line.buf << " Syscall ";
+  out->text(" Syscall ");
+  return true;
 }
 
 void Tracer::dumpThreadSummary(const Core &core)
 {
-  for (unsigned i = 0; i < NUM_THREADS; i++) {
-    const Thread &t = core.getThread(i);
-    if (!t.isInUse())
+  for (unsigned i = 0; i < core.getNumThreads(); i++) {
+    const Thread *t = core.findThread(i);
+    if (!t || !t->isInUse())
       continue;
-    const Thread &ts = t;
+    const Thread &ts = *t;
     printCommonStart();
-    line.thread = &ts;
-    *line.buf << "Thread ";
-    printThreadName();
+    out->setLineThread(getCoreID(core), ts.getNum());
+    out->text("Thread ");
+    out->threadName();
     if (ts.waiting()) {
       if (Resource *res = ts.pausedOn) {
-        *line.buf << " paused on ";
-        *line.buf << Resource::getResourceName(res->getType());
-        *line.buf << " 0x" << std::hex << res->getID();
+        out->text(" paused on ");
+        out->text(Resource::getResourceName(res->getType()));
+        out->text(" 0x");
+        out->hexValue(res->getID());
       } else if (ts.eeble()) {
-        *line.buf << " waiting for events";
+        out->text(" waiting for events");
         if (ts.ieble())
-          *line.buf << " or interrupts";
+          out->text(" or interrupts");
       } else if (ts.ieble()) {
-        *line.buf << " waiting for interrupts";
+        out->text(" waiting for interrupts");
       } else {
-        *line.buf << " paused";
+        out->text(" paused");
       }
     }
-    *line.buf << " at ";
-    printThreadPC();
+    out->text(" at ");
+    printThreadPC(ts);
     printCommonEnd();
   }
 }
@@ -364,9 +351,8 @@ void Tracer::noRunnableThreads(const SystemState &system)
 {
   printCommonStart();
   red();
-  *line.buf << "No more runnable threads";
+  out->text("No more runnable threads");
   reset();
   printCommonEnd();
   dumpThreadSummary(system);
 }
-
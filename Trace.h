@@ -8,11 +8,14 @@
 
 #include "SymbolInfo.h"
 #include "Thread.h"
-#include "TerminalColours.h"
+#include "TraceFormatter.h"
+#include "BinaryTrace.h"
+#include "TraceFilter.h"
 #include <iostream>
 #include <sstream>
 #include <string>
 #include <memory>
+#include <map>
 
 class EventableResource;
 class SystemState;
@@ -44,64 +47,77 @@ class Tracer {
 private:
   Tracer() :
     tracingEnabled(false),
-    line(std::cout, buf, pendingBuf),
-    colours(TerminalColours::null) {}
-  struct LineState {
-    LineState(std::ostringstream *b) :
-      thread(0),
-      out(0),
-      buf(b),
-      pending(0) {}
-    LineState(std::ostream &o, std::ostringstream &b, std::ostringstream &pendingBuf) :
-      thread(0),
-      out(&o),
-      buf(&b),
-      pending(&pendingBuf) {}
-    const Thread *thread;
-    bool hadRegWrite;
-    size_t numEscapeChars;
-    std::ostream *out;
-    std::ostringstream *buf;
-    std::ostringstream *pending;
-  };
+    formatter(std::cout),
+    out(&formatter),
+    lineThread(0),
+    suppressLine(false),
+    lastCore(0),
+    lastCoreID(0) {}
   class PushLineState {
   private:
-    bool needRestore;
-    LineState line;
+    const Thread *lineThread;
   public:
     PushLineState();
     ~PushLineState();
-    bool getRestore() const { return needRestore; }
   };
   bool tracingEnabled;
-  std::ostringstream buf;
-  std::ostringstream pendingBuf;
-  LineState line;
+  TraceFormatter formatter;
+  std::auto_ptr<TraceSink> sink;
+  /// Trace records are encoded by the writer and passed to the sink on a
+  /// background thread.
+  std::auto_ptr<BinaryTraceWriter> writer;
+  TraceOutput *out;
+  /// Thread whose registers are printed by SrcRegister operands.
+  const Thread *lineThread;
+  TraceFilter filter;
+  /// Set if the filter rejected the current instruction or syscall. Register
+  /// writes and the end of the line are ignored until the next line starts.
+  bool suppressLine;
   std::auto_ptr<SymbolInfo> symInfo;
-  TerminalColours colours;
+  std::map<const Core*,unsigned> coreIDs;
+  const Core *lastCore;
+  unsigned lastCoreID;
 
   static Tracer instance;
 
-  void escapeCode(const char *s);
-  void reset() { escapeCode(colours.reset); }
-  void red() { escapeCode(colours.red); }
-  void green() { escapeCode(colours.green); }
+  unsigned addCore(const Core &core);
+  unsigned getCoreID(const Core &core)
+  {
+    if (&core == lastCore)
+      return lastCoreID;
+    lastCoreID = addCore(core);
+    lastCore = &core;
+    return lastCoreID;
+  }
+
+  void reset() { out->colour(TraceOutput::COLOUR_RESET); }
+  void red() { out->colour(TraceOutput::COLOUR_RED); }
+  void green() { out->colour(TraceOutput::COLOUR_GREEN); }
 
-  void printThreadName();
   void printCommonStart();
   void printCommonStart(const Node &n);
   void printCommonStart(const Thread &t);
   void printCommonEnd();
-  void printThreadPC();
-  void printInstructionStart(const Thread &t);
+  void printThreadPC(const Thread &t);
+  bool printInstructionStart(const Thread &t);
+  /// Returns false if the filter rejects lines for the thread.
+  bool filterThread(const Thread &t)
+  {
+    return !filter.isActive() || filter.matches(t);
+  }
 
   template <typename T>
     void printOperand(const T &op)
   {
-    *line.buf << op;
+    std::ostringstream buf;
+    buf << op;
+    out->text(buf.str());
   }
 
-  void printOperand(Register op);
+  void printOperand(const char *op) { out->text(op); }
+  void printOperand(uint32_t op) { out->unsignedValue(op); }
+  void printOperand(int32_t op) { out->signedValue(op); }
+  void printOperand(Register op) { out->reg(op); }
   void printOperand(SrcRegister op);
   void printOperand(CPRelOffset op);
   void printOperand(DPRelOffset op);
@@ -110,22 +126,32 @@ private:
   void dumpThreadSummary(const SystemState &system);
 public:
 
-  void setTracingEnabled(bool enable) { tracingEnabled = enable; }
+  void setTracingEnabled(bool enable);
   bool getTracingEnabled() const { return tracingEnabled; }
   void setSymbolInfo(std::auto_ptr<SymbolInfo> &si);
-  void setColour(bool enable);
+  void setColour(bool enable) { formatter.setColour(enable); }
+  TraceFilter &getFilter() { return filter; }
+  /// Write the trace to the specified file in the binary trace format instead
+  /// of printing it. Returns false if the file cannot be opened.
+  bool setBinaryOutput(const std::string &filename);
+  /// Wait until all trace output has been written.
+  void flush() { out->flush(); }
+  /// Write out as much of the trace as possible from a signal handler.
+  void flushFromSignal();
 
   template<typename T0>
   void trace(const Thread &t, T0 op0)
   {
-    printInstructionStart(t);
+    if (!printInstructionStart(t))
+      return;
     printOperand(op0);
   }
   
   template<typename T0, typename T1>
   void trace(const Thread &t, T0 op0, T1 op1)
   {
-    printInstructionStart(t);
+    if (!printInstructionStart(t))
+      return;
     printOperand(op0);
     printOperand(op1);
   }
@@ -133,7 +159,8 @@ public:
   template<typename T0, typename T1, typename T2>
   void trace(const Thread &t, T0 op0, T1 op1, T2 op2)
   {
-    printInstructionStart(t);
+    if (!printInstructionStart(t))
+      return;
     printOperand(op0);
     printOperand(op1);
     printOperand(op2);
@@ -143,7 +170,8 @@ public:
   void trace(const Thread &t, T0 op0, T1 op1, T2 op2,
              T3 op3)
   {
-    printInstructionStart(t);
+    if (!printInstructionStart(t))
+      return;
     printOperand(op0);
     printOperand(op1);
     printOperand(op2);
@@ -153,7 +181,8 @@ public:
   template<typename T0, typename T1, typename T2, typename T3, typename T4>
   void trace(const Thread &t, T0 op0, T1 op1, T2 op2, T3 op3, T4 op4)
   {
-    printInstructionStart(t);
+    if (!printInstructionStart(t))
+      return;
     printOperand(op0);
     printOperand(op1);
     printOperand(op2);
@@ -166,7 +195,8 @@ public:
   void trace(const Thread &t, T0 op0, T1 op1, T2 op2, T3 op3, T4 op4,
              T5 op5)
   {
-    printInstructionStart(t);
+    if (!printInstructionStart(t))
+      return;
     printOperand(op0);
     printOperand(op1);
     printOperand(op2);
@@ -180,7 +210,8 @@ public:
   void trace(const Thread &t, T0 op0, T1 op1, T2 op2, T3 op3, T4 op4,
              T5 op5, T6 op6)
   {
-    printInstructionStart(t);
+    if (!printInstructionStart(t))
+      return;
     printOperand(op0);
     printOperand(op1);
     printOperand(op2);
@@ -195,7 +226,8 @@ public:
   void trace(const Thread &t, T0 op0, T1 op1, T2 op2, T3 op3, T4 op4,
              T5 op5, T6 op6, T7 op7)
   {
-    printInstructionStart(t);
+    if (!printInstructionStart(t))
+      return;
     printOperand(op0);
     printOperand(op1);
     printOperand(op2);
@@ -211,7 +243,8 @@ public:
   void trace(const Thread &t, T0 op0, T1 op1, T2 op2, T3 op3, T4 op4,
              T5 op5, T6 op6, T7 op7, T8 op8)
   {
-    printInstructionStart(t);
+    if (!printInstructionStart(t))
+      return;
     printOperand(op0);
     printOperand(op1);
     printOperand(op2);
@@ -228,7 +261,8 @@ public:
   void trace(const Thread &t, T0 op0, T1 op1, T2 op2, T3 op3, T4 op4,
              T5 op5, T6 op6, T7 op7, T8 op8, T9 op9)
   {
-    printInstructionStart(t);
+    if (!printInstructionStart(t))
+      return;
     printOperand(op0);
     printOperand(op1);
     printOperand(op2);
@@ -246,7 +280,8 @@ public:
   void trace(const Thread &t, T0 op0, T1 op1, T2 op2, T3 op3, T4 op4,
              T5 op5, T6 op6, T7 op7, T8 op8, T9 op9, T10 op10)
   {
-    printInstructionStart(t);
+    if (!printInstructionStart(t))
+      return;
     printOperand(op0);
     printOperand(op1);
     printOperand(op2);
@@ -266,7 +301,8 @@ public:
   void trace(const Thread &t, T0 op0, T1 op1, T2 op2, T3 op3, T4 op4,
              T5 op5, T6 op6, T7 op7, T8 op8, T9 op9, T10 op10, T11 op11)
   {
-    printInstructionStart(t);
+    if (!printInstructionStart(t))
+      return;
     printOperand(op0);
     printOperand(op1);
     printOperand(op2);
@@ -281,9 +317,17 @@ public:
     printOperand(op11);
   }
 
-  void regWrite(Register reg, uint32_t value);
+  void regWrite(Register reg, uint32_t value)
+  {
+    if (!suppressLine)
+      out->regWrite(reg, value);
+  }
 
   void traceEnd() {
+    if (suppressLine) {
+      suppressLine = false;
+      return;
+    }
     printCommonEnd();
   }
 
@@ -303,18 +347,24 @@ public:
   void interrupt(const Thread &t, const EventableResource &res, uint32_t pc,
                  uint32_t ssr, uint32_t spc, uint32_t sed, uint32_t ed);
 
-  void syscallBegin(const Thread &t);
+  bool syscallBegin(const Thread &t);
 
-  void syscall(const Thread &t, const std::string &s) {
-    syscallBegin(t);
-    *line.buf << s << "()";
+  void syscall(const Thread &t, const char *s) {
+    if (!syscallBegin(t))
+      return;
+    out->text(s);
+    out->text("()");
     reset();
   }
   template<typename T0>
-  void syscall(const Thread &t, const std::string &s,
+  void syscall(const Thread &t, const char *s,
                T0 op0) {
-    syscallBegin(t);
-    *line.buf << s << '(' << op0 << ')';
+    if (!syscallBegin(t))
+      return;
+    out->text(s);
+    out->text("(");
+    printOperand(op0);
+    out->text(")");
     reset();
   }
   void syscallEnd() {
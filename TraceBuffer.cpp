@@ -0,0 +1,189 @@
+// Copyright (c) 2012, Richard Osborne, All rights reserved
+// This software is freely distributable under a derivative of the
+// University of Illinois/NCSA Open Source License posted in
+// LICENSE.txt and at <http://github.xcore.com/>
+
+#include "TraceBuffer.h"
+#ifndef _WIN32
+#include <sys/time.h>
+#include <unistd.h>
+#endif
+
+#ifndef _WIN32
+static inline void memoryBarrier()
+{
+  __sync_synchronize();
+}
+#else
+static inline void memoryBarrier() {}
+#endif
+
+TraceBuffer::TraceBuffer(TraceSink &s) :
+  sink(s),
+  storage(numBlocks * blockSize),
+  writeIndex(0),
+  readIndex(0),
+  flushRequests(0),
+  flushesDone(0),
+  stopping(false)
+{
+#ifndef _WIN32
+  pthread_mutex_init(&mutex, 0);
+  pthread_cond_init(&cond, 0);
+  threadStarted = pthread_create(&thread, 0, threadEntry, this) == 0;
+#endif
+}
+
+TraceBuffer::~TraceBuffer()
+{
+#ifndef _WIN32
+  if (threadStarted) {
+    pthread_mutex_lock(&mutex);
+    stopping = true;
+    pthread_cond_broadcast(&cond);
+    pthread_mutex_unlock(&mutex);
+    pthread_join(thread, 0);
+  }
+  pthread_cond_destroy(&cond);
+  pthread_mutex_destroy(&mutex);
+#endif
+}
+
+void TraceBuffer::consumeBlock()
+{
+  memoryBarrier();
+  unsigned index = readIndex;
+  sink.write(getBlock(index), blockSizes[index % numBlocks]);
+  memoryBarrier();
+  readIndex = index + 1;
+}
+
+void TraceBuffer::drain()
+{
+  while (readIndex != writeIndex)
+    consumeBlock();
+}
+
+#ifndef _WIN32
+void *TraceBuffer::threadEntry(void *arg)
+{
+  static_cast<TraceBuffer*>(arg)->run();
+  return 0;
+}
+
+void TraceBuffer::run()
+{
+  pthread_mutex_lock(&mutex);
+  while (true) {
+    if (readIndex != writeIndex) {
+      pthread_mutex_unlock(&mutex);
+      consumeBlock();
+      pthread_mutex_lock(&mutex);
+      // Wake the producer if it is waiting for a free block.
+      pthread_cond_broadcast(&cond);
+      continue;
+    }
+    if (flushesDone != flushRequests) {
+      // All blocks committed before the request have been consumed.
+      unsigned requested = flushRequests;
+      pthread_mutex_unlock(&mutex);
+      sink.flush();
+      pthread_mutex_lock(&mutex);
+      flushesDone = requested;
+      pthread_cond_broadcast(&cond);
+      continue;
+    }
+    if (stopping)
+      break;
+    wait();
+  }
+  pthread_mutex_unlock(&mutex);
+}
+
+void TraceBuffer::wake()
+{
+  pthread_mutex_lock(&mutex);
+  pthread_cond_broadcast(&cond);
+  pthread_mutex_unlock(&mutex);
+}
+
+/// Wait on the condition variable. Wake up periodically so blocks committed by
+/// flushFromSignal(), which can't signal the condition variable, are noticed.
+void TraceBuffer::wait()
+{
+  struct timeval now;
+  gettimeofday(&now, 0);
+  const long timeoutUs = 10000;
+  long usec = now.tv_usec + timeoutUs;
+  struct timespec timeout;
+  timeout.tv_sec = now.tv_sec + usec / 1000000;
+  timeout.tv_nsec = (usec % 1000000) * 1000;
+  pthread_cond_timedwait(&cond, &mutex, &timeout);
+}
+#endif
+
+uint8_t *TraceBuffer::getBlock()
+{
+#ifndef _WIN32
+  if (writeIndex - readIndex == numBlocks) {
+    pthread_mutex_lock(&mutex);
+    while (writeIndex - readIndex == numBlocks)
+      pthread_cond_wait(&cond, &mutex);
+    pthread_mutex_unlock(&mutex);
+  }
+#endif
+  memoryBarrier();
+  return getBlock(writeIndex);
+}
+
+void TraceBuffer::commit(size_t size)
+{
+  blockSizes[writeIndex % numBlocks] = size;
+  memoryBarrier();
+  writeIndex = writeIndex + 1;
+#ifndef _WIN32
+  if (threadStarted) {
+    wake();
+    return;
+  }
+#endif
+  drain();
+}
+
+void TraceBuffer::flush()
+{
+#ifndef _WIN32
+  if (threadStarted) {
+    pthread_mutex_lock(&mutex);
+    unsigned request = ++flushRequests;
+    pthread_cond_broadcast(&cond);
+    while (flushesDone != request)
+      pthread_cond_wait(&cond, &mutex);
+    pthread_mutex_unlock(&mutex);
+    return;
+  }
+#endif
+  drain();
+  sink.flush();
+}
+
+void TraceBuffer::flushFromSignal(size_t size)
+{
+  blockSizes[writeIndex % numBlocks] = size;
+  memoryBarrier();
+  writeIndex = writeIndex + 1;
+#ifndef _WIN32
+  if (threadStarted) {
+    memoryBarrier();
+    unsigned request = flushRequests + 1;
+    flushRequests = request;
+    // Give up after 2 seconds.
+    for (unsigned i = 0; i < 2000 && flushesDone != request; i++) {
+      usleep(1000);
+    }
+    return;
+  }
+#endif
+  drain();
+  sink.flush();
+}
@@ -0,0 +1,83 @@
+// Copyright (c) 2012, Richard Osborne, All rights reserved
+// This software is freely distributable under a derivative of the
+// University of Illinois/NCSA Open Source License posted in
+// LICENSE.txt and at <http://github.xcore.com/>
+
+#ifndef _TraceBuffer_h_
+#define _TraceBuffer_h_
+
+#include <stdint.h>
+#include <cstddef>
+#include <vector>
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+/// Consumer of the data written to a TraceBuffer.
+class TraceSink {
+public:
+  virtual ~TraceSink() {}
+  virtual void write(const uint8_t *data, size_t size) = 0;
+  virtual void flush() = 0;
+};
+
+/// Bounded single producer, single consumer queue of blocks. The producer
+/// fills a block in place and commits it. A background thread passes committed
+/// blocks to the sink. If all blocks are waiting to be consumed the producer
+/// waits, so the memory used is bounded. The indices are only updated by one
+/// side each, so no lock is needed to pass blocks between the threads. On
+/// platforms without pthreads blocks are passed to the sink on commit.
+class TraceBuffer {
+public:
+  static const size_t blockSize = 256 * 1024;
+  static const unsigned numBlocks = 16;
+private:
+  TraceSink &sink;
+  std::vector<uint8_t> storage;
+  size_t blockSizes[numBlocks];
+  /// Number of blocks committed by the producer.
+  volatile unsigned writeIndex;
+  /// Number of blocks consumed by the background thread.
+  volatile unsigned readIndex;
+  volatile unsigned flushRequests;
+  volatile unsigned flushesDone;
+  volatile bool stopping;
+#ifndef _WIN32
+  bool threadStarted;
+  pthread_t thread;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+
+  static void *threadEntry(void *arg);
+  void run();
+  void wake();
+  void wait();
+#endif
+
+  TraceBuffer(const TraceBuffer &); // Not implemented.
+  void operator=(const TraceBuffer &); // Not implemented.
+
+  uint8_t *getBlock(unsigned index)
+  {
+    return &storage[(index % numBlocks) * blockSize];
+  }
+  void consumeBlock();
+  /// Consume all committed blocks on the calling thread.
+  void drain();
+public:
+  TraceBuffer(TraceSink &s);
+  ~TraceBuffer();
+  /// Returns the block to fill next, waiting for the background thread if no
+  /// block is free.
+  uint8_t *getBlock();
+  /// Pass the first size bytes of the block returned by getBlock() to the sink.
+  void commit(size_t size);
+  /// Wait until everything committed has been written to the sink and the
+  /// sink has been flushed.
+  void flush();
+  /// Like commit() followed by flush() but safe to call from a signal handler.
+  /// Gives up if the background thread makes no progress.
+  void flushFromSignal(size_t size);
+};
+
+#endif // _TraceBuffer_h_
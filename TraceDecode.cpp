@@ -0,0 +1,85 @@
+// Copyright (c) 2012, Richard Osborne, All rights reserved
+// This software is freely distributable under a derivative of the
+// University of Illinois/NCSA Open Source License posted in
+// LICENSE.txt and at <http://github.xcore.com/>
+
+// axe-trace: print a binary trace written by axe --binary-trace in the same
+// format as axe -t, or convert a waveform written by axe --waveform to VCD.
+
+#include <iostream>
+#include <string>
+#include <cstdio>
+#include <unistd.h>
+
+#include "BinaryTrace.h"
+#include "TraceFormatter.h"
+#include "Waveform.h"
+
+static void printUsage(const char *ProgName) {
+  std::cout << "Usage: " << ProgName << " [options] trace\n";
+  std::cout << "Waveforms in the compact format are written to stdout as VCD.\n";
+  std::cout <<
+"General Options:\n"
+"  -h        Display this information\n"
+"  -c        Colour the output even if it is not a terminal\n"
+"\n";
+}
+
+int main(int argc, char **argv) {
+  const char *file = 0;
+  bool colour = false;
+#ifndef _WIN32
+  colour = isatty(fileno(stdout));
+#endif
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "-h") {
+      printUsage(argv[0]);
+      return 0;
+    } else if (arg == "-c") {
+      colour = true;
+    } else if (!file) {
+      file = argv[i];
+    } else {
+      printUsage(argv[0]);
+      return 1;
+    }
+  }
+  if (!file) {
+    printUsage(argv[0]);
+    return 1;
+  }
+  std::FILE *f = std::fopen(file, "rb");
+  if (!f) {
+    std::cerr << "Error opening \"" << file << "\"" << std::endl;
+    return 1;
+  }
+  if (isCompactWaveform(f)) {
+    VcdWriter writer(stdout);
+    std::string error;
+    bool success = convertCompactWaveform(f, writer, error);
+    std::fclose(f);
+    if (!success) {
+      std::cerr << "Error reading \"" << file << "\": " << error << std::endl;
+      return 1;
+    }
+    if (uint64_t clamped = writer.getClampedChanges()) {
+      std::cerr << "Warning: " << clamped << " waveform changes arrived "
+                << "outside the reordering window and were written late"
+                << std::endl;
+    }
+    return 0;
+  }
+  TraceFormatter formatter(std::cout);
+  formatter.setColour(colour);
+  BinaryTraceReader reader;
+  bool success = reader.read(f, formatter);
+  formatter.flush();
+  std::fclose(f);
+  if (!success) {
+    std::cerr << "Error reading \"" << file << "\": " << reader.getError()
+              << std::endl;
+    return 1;
+  }
+  return 0;
+}
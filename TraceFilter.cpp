@@ -0,0 +1,217 @@
+// Copyright (c) 2012, Richard Osborne, All rights reserved
+// This software is freely distributable under a derivative of the
+// University of Illinois/NCSA Open Source License posted in
+// LICENSE.txt and at <http://github.xcore.com/>
+
+#include "TraceFilter.h"
+#include "SystemState.h"
+#include "SymbolInfo.h"
+#include "Node.h"
+#include "Core.h"
+#include "RunnableQueue.h"
+#include <cstdlib>
+#include <iostream>
+
+TraceFilter::TraceFilter() :
+  active(false),
+  enabled(true),
+  hasTimeWindow(false),
+  startTime(0),
+  endTime(0),
+  lastCore(0),
+  lastCoreState(0)
+{
+}
+
+static bool parseNumber(const std::string &s, uint64_t &value)
+{
+  if (s.empty())
+    return false;
+  char *end;
+  value = std::strtoull(s.c_str(), &end, 0);
+  return *end == '\0';
+}
+
+bool TraceFilter::
+parseRange(const std::string &s, uint64_t &start, uint64_t &end)
+{
+  std::string::size_type dash = s.find('-');
+  if (dash == std::string::npos)
+    return false;
+  std::string first = s.substr(0, dash);
+  std::string second = s.substr(dash + 1);
+  start = 0;
+  end = ~uint64_t(0);
+  if (!first.empty() && !parseNumber(first, start))
+    return false;
+  if (!second.empty() && !parseNumber(second, end))
+    return false;
+  return start < end;
+}
+
+void TraceFilter::addCore(const std::string &spec)
+{
+  coreSpecs.push_back(spec);
+  active = true;
+}
+
+void TraceFilter::addThread(unsigned num)
+{
+  threads.push_back(num);
+  active = true;
+}
+
+void TraceFilter::addAddressRange(uint32_t start, uint32_t end)
+{
+  addressRanges.push_back(std::make_pair(start, end));
+  active = true;
+}
+
+void TraceFilter::addSymbol(const std::string &name)
+{
+  symbols.push_back(name);
+  active = true;
+}
+
+void TraceFilter::setTimeWindow(ticks_t start, ticks_t end)
+{
+  hasTimeWindow = true;
+  startTime = start;
+  endTime = end;
+  active = true;
+}
+
+void TraceFilter::WindowEdge::
+schedule(RunnableQueue &queue, ticks_t start, ticks_t end)
+{
+  scheduler = &queue;
+  endTime = end;
+  scheduler->push(*this, start);
+}
+
+void TraceFilter::WindowEdge::run(ticks_t time)
+{
+  if (time < endTime && endTime != ~ticks_t(0))
+    scheduler->push(*this, endTime);
+}
+
+void TraceFilter::schedule(RunnableQueue &scheduler)
+{
+  if (hasTimeWindow)
+    windowEdge.schedule(scheduler, startTime, endTime);
+}
+
+void TraceFilter::startDisabled()
+{
+  enabled = false;
+  active = true;
+}
+
+static bool matchesCoreSpec(const std::string &spec, const Core &core)
+{
+  uint64_t id;
+  return spec == core.getCoreName() ||
+         (parseNumber(spec, id) && id == core.getCoreID());
+}
+
+void TraceFilter::
+addPCRange(const Core &core, CoreState &state, uint32_t start, uint32_t end)
+{
+  // Clamp to the core's memory.
+  uint32_t ramEnd = core.ram_base + core.ram_size;
+  start = std::max(start, core.ram_base);
+  end = std::min(end, ramEnd);
+  if (start >= end)
+    return;
+  state.pcRanges.push_back(std::make_pair(core.physicalAddress(start) >> 1,
+                                          (core.physicalAddress(end - 1) >> 1)
+                                          + 1));
+}
+
+static const ElfSymbol *
+findFunction(const CoreSymbolInfo &symbols, const std::string &name)
+{
+  if (const ElfSymbol *sym = symbols.getGlobalSymbol(name))
+    return sym;
+  // Look for a local symbol.
+  const std::vector<ElfSymbol> &all = symbols.getSymbols();
+  for (std::vector<ElfSymbol>::const_iterator it = all.begin(), e = all.end();
+       it != e; ++it) {
+    if (it->name == name)
+      return &*it;
+  }
+  return 0;
+}
+
+bool TraceFilter::resolve(const SystemState &system, const SymbolInfo &symInfo)
+{
+  std::vector<bool> coreSpecFound(coreSpecs.size());
+  std::vector<bool> symbolFound(symbols.size());
+  for (SystemState::const_node_iterator outerIt = system.node_begin(),
+       outerE = system.node_end(); outerIt != outerE; ++outerIt) {
+    const Node &node = **outerIt;
+    for (Node::const_core_iterator innerIt = node.core_begin(),
+         innerE = node.core_end(); innerIt != innerE; ++innerIt) {
+      const Core &core = **innerIt;
+      CoreState &state = cores[&core];
+      state.traced = coreSpecs.empty();
+      for (unsigned i = 0; i < coreSpecs.size(); i++) {
+        if (matchesCoreSpec(coreSpecs[i], core)) {
+          coreSpecFound[i] = true;
+          state.traced = true;
+        }
+      }
+      if (!hasPCFilter())
+        continue;
+      for (RangeList::const_iterator it = addressRanges.begin(),
+           e = addressRanges.end(); it != e; ++it) {
+        addPCRange(core, state, it->first, it->second);
+      }
+      const CoreSymbolInfo *coreSymbols = symInfo.getCoreSymbolInfo(&core);
+      for (unsigned i = 0; coreSymbols && i < symbols.size(); i++) {
+        const ElfSymbol *sym = findFunction(*coreSymbols, symbols[i]);
+        if (!sym)
+          continue;
+        symbolFound[i] = true;
+        // Symbols have no size. Assume the function extends to the next one.
+        const ElfSymbol *next = coreSymbols->getNextFunctionSymbol(sym->value);
+        uint32_t end = next ? next->value : core.ram_base + core.ram_size;
+        addPCRange(core, state, sym->value, end);
+      }
+      if (state.pcRanges.empty())
+        state.traced = false;
+    }
+  }
+  lastCore = 0;
+  lastCoreState = 0;
+  for (unsigned i = 0; i < coreSpecs.size(); i++) {
+    if (!coreSpecFound[i]) {
+      std::cerr << "Error: no core named \"" << coreSpecs[i] << "\""
+                << std::endl;
+      return false;
+    }
+  }
+  for (unsigned i = 0; i < symbols.size(); i++) {
+    if (!symbolFound[i]) {
+      std::cerr << "Error: function \"" << symbols[i] << "\" not found"
+                << std::endl;
+      return false;
+    }
+  }
+  return true;
+}
+
+bool TraceFilter::matches(const Thread &t)
+{
+  if (!mayTrace(t))
+    return false;
+  if (!hasPCFilter())
+    return true;
+  const RangeList &ranges = getCoreState(t.getParent()).pcRanges;
+  for (RangeList::const_iterator it = ranges.begin(), e = ranges.end();
+       it != e; ++it) {
+    if (t.pc - it->first < it->second - it->first)
+      return true;
+  }
+  return false;
+}
@@ -0,0 +1,126 @@
+// Copyright (c) 2012, Richard Osborne, All rights reserved
+// This software is freely distributable under a derivative of the
+// University of Illinois/NCSA Open Source License posted in
+// LICENSE.txt and at <http://github.xcore.com/>
+
+#ifndef _TraceFilter_h_
+#define _TraceFilter_h_
+
+#include "Config.h"
+#include "Runnable.h"
+#include "Thread.h"
+#include <algorithm>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+class Core;
+class RunnableQueue;
+class SystemState;
+class SymbolInfo;
+
+/// Selects which threads and instructions are traced. Threads can be selected
+/// by core and thread number, instructions by address range or function and
+/// by the simulated time. The traced program can turn tracing on and off with
+/// trace marker system calls.
+class TraceFilter {
+private:
+  typedef std::vector<std::pair<uint32_t,uint32_t> > RangeList;
+  /// Returns running threads to the scheduler at the edges of the time
+  /// window. A thread only switches between the tracing and non tracing
+  /// dispatch loops when it is scheduled and a thread running on its own is
+  /// otherwise never descheduled.
+  class WindowEdge : public Runnable {
+    RunnableQueue *scheduler;
+    ticks_t endTime;
+  public:
+    WindowEdge() : scheduler(0), endTime(0) {}
+    void schedule(RunnableQueue &queue, ticks_t start, ticks_t end);
+    void run(ticks_t time);
+  };
+  struct CoreState {
+    bool traced;
+    /// Ranges of pc values (in the units of Thread::pc) that are traced.
+    RangeList pcRanges;
+    CoreState() : traced(false) {}
+  };
+  bool active;
+  bool enabled;
+  std::vector<std::string> coreSpecs;
+  std::vector<unsigned> threads;
+  /// Virtual address ranges and function names used to build the pc ranges.
+  RangeList addressRanges;
+  std::vector<std::string> symbols;
+  bool hasTimeWindow;
+  ticks_t startTime;
+  ticks_t endTime;
+  WindowEdge windowEdge;
+  std::map<const Core*,CoreState> cores;
+  const Core *lastCore;
+  const CoreState *lastCoreState;
+
+  bool hasPCFilter() const
+  {
+    return !addressRanges.empty() || !symbols.empty();
+  }
+  const CoreState &getCoreState(const Core &core)
+  {
+    if (&core != lastCore) {
+      lastCoreState = &cores[&core];
+      lastCore = &core;
+    }
+    return *lastCoreState;
+  }
+  void addPCRange(const Core &core, CoreState &state, uint32_t start,
+                  uint32_t end);
+public:
+  TraceFilter();
+
+  /// Parse a range of the form start-end. Either bound may be omitted.
+  static bool parseRange(const std::string &s, uint64_t &start,
+                         uint64_t &end);
+
+  /// Trace the core with the specified name or ID.
+  void addCore(const std::string &spec);
+  void addThread(unsigned num);
+  /// Trace instructions in the range [start, end).
+  void addAddressRange(uint32_t start, uint32_t end);
+  /// Trace instructions in the specified function.
+  void addSymbol(const std::string &name);
+  /// Trace instructions executed at a time in the range [start, end).
+  void setTimeWindow(ticks_t start, ticks_t end);
+  /// Enable or disable tracing. Called for trace markers in the program.
+  void setEnabled(bool value) { enabled = value; }
+  bool getEnabled() const { return enabled; }
+  /// Leave tracing disabled until the program enables it.
+  void startDisabled();
+  /// Returns whether anything is filtered out of the trace.
+  bool isActive() const { return active; }
+
+  /// Resolve core names and functions. Returns false if a core or function
+  /// can't be found.
+  bool resolve(const SystemState &system, const SymbolInfo &symInfo);
+  /// Schedule the switches between the dispatch loops at the edges of the
+  /// time window.
+  void schedule(RunnableQueue &scheduler);
+
+  /// Returns true if instructions of the thread may be traced, ignoring the
+  /// address of the instruction.
+  bool mayTrace(const Thread &t)
+  {
+    if (!enabled)
+      return false;
+    if (hasTimeWindow && (t.time < startTime || t.time >= endTime))
+      return false;
+    if (!threads.empty() &&
+        std::find(threads.begin(), threads.end(), t.getNum()) == threads.end())
+      return false;
+    return getCoreState(t.getParent()).traced;
+  }
+  /// Returns true if the instruction the thread is about to execute should be
+  /// traced.
+  bool matches(const Thread &t);
+};
+
+#endif // _TraceFilter_h_
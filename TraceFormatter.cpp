@@ -0,0 +1,245 @@
+// Copyright (c) 2012, Richard Osborne, All rights reserved
+// This software is freely distributable under a derivative of the
+// University of Illinois/NCSA Open Source License posted in
+// LICENSE.txt and at <http://github.xcore.com/>
+
+#include "TraceFormatter.h"
+#include "SymbolInfo.h"
+#include <iomanip>
+#include <cstring>
+
+const unsigned mnemonicColumn = 49;
+const unsigned regWriteColumn = 87;
+
+void TraceFormatter::setColour(bool enable)
+{
+  colours = enable ? TerminalColours::ansi : TerminalColours::null;
+}
+
+void TraceFormatter::escapeCode(const char *s)
+{
+  *line.buf << s;
+  line.numEscapeChars += std::strlen(s);
+}
+
+void TraceFormatter::
+addCore(unsigned core, const std::string &name, const CoreSymbolInfo *symbols)
+{
+  if (core >= cores.size())
+    cores.resize(core + 1);
+  cores[core].name = name;
+  cores[core].symbols = symbols;
+}
+
+void TraceFormatter::startLine()
+{
+  if (line.pending) {
+    line.pending->str("");
+  }
+  line.numEscapeChars = 0;
+  line.hadRegWrite = false;
+  line.hasThread = false;
+}
+
+void TraceFormatter::startThreadLine(ticks_t time, unsigned core,
+                                     unsigned thread)
+{
+  startLine();
+  setLineThread(core, thread);
+
+  // TODO add option to show cycles?
+  *line.buf << std::setw(6) << (uint64_t)time;
+  *line.buf << ' ';
+  escapeCode(colours.green);
+  *line.buf << '<';
+  threadName();
+  *line.buf << '>';
+  escapeCode(colours.reset);
+}
+
+void TraceFormatter::startNodeLine(unsigned nodeID)
+{
+  startLine();
+
+  escapeCode(colours.green);
+  *line.buf << '<';
+  *line.buf << 'n' << nodeID;
+  *line.buf << '>';
+  escapeCode(colours.reset);
+}
+
+void TraceFormatter::setLineThread(unsigned core, unsigned thread)
+{
+  line.hasThread = true;
+  line.core = core;
+  line.thread = thread;
+}
+
+void TraceFormatter::pushLine()
+{
+  if (!line.hasThread) {
+    needRestore.push_back(false);
+    return;
+  }
+  savedLines.push_back(LineState(line.pending));
+  std::swap(line, savedLines.back());
+  needRestore.push_back(true);
+}
+
+void TraceFormatter::popLine()
+{
+  bool restore = needRestore.back();
+  needRestore.pop_back();
+  if (!restore)
+    return;
+  std::swap(line, savedLines.back());
+  savedLines.pop_back();
+}
+
+void TraceFormatter::endLine()
+{
+  *line.buf << '\n';
+  if (line.out) {
+    *line.out << line.buf->str() << line.pending->str();
+    line.buf->str("");
+  }
+  line.hasThread = false;
+}
+
+void TraceFormatter::threadName()
+{
+  *line.buf << cores[line.core].name;
+  *line.buf << ":t" << line.thread;
+}
+
+void TraceFormatter::pc(uint32_t address)
+{
+  const CoreSymbolInfo *symbols = getSymbols();
+  const ElfSymbol *sym;
+  if (symbols && (sym = symbols->getFunctionSymbol(address))) {
+    *line.buf << sym->name;
+    if (sym->value != address)
+      *line.buf << '+' << (address - sym->value);
+    *line.buf << "(0x" << std::hex << address << std::dec << ')';
+  } else {
+    *line.buf << "0x" << std::hex << address << std::dec;
+  }
+}
+
+void TraceFormatter::alignMnemonic()
+{
+  size_t pos = line.buf->str().size() - line.numEscapeChars;
+  if (pos < mnemonicColumn) {
+    *line.buf << std::setw(mnemonicColumn - pos) << "";
+  }
+}
+
+void TraceFormatter::colour(Colour c)
+{
+  switch (c) {
+  case COLOUR_RESET:
+    escapeCode(colours.reset);
+    break;
+  case COLOUR_RED:
+    escapeCode(colours.red);
+    break;
+  case COLOUR_GREEN:
+    escapeCode(colours.green);
+    break;
+  }
+}
+
+void TraceFormatter::text(const char *s)
+{
+  *line.buf << s;
+}
+
+void TraceFormatter::text(const std::string &s)
+{
+  *line.buf << s;
+}
+
+void TraceFormatter::unsignedValue(uint32_t value)
+{
+  *line.buf << value;
+}
+
+void TraceFormatter::signedValue(int32_t value)
+{
+  *line.buf << value;
+}
+
+void TraceFormatter::hexValue(uint32_t value)
+{
+  *line.buf << std::hex << value << std::dec;
+}
+
+void TraceFormatter::reg(Register reg)
+{
+  *line.buf << reg;
+}
+
+void TraceFormatter::srcReg(Register reg, uint32_t value)
+{
+  *line.buf << reg << "(0x" << std::hex << value << ')' << std::dec;
+}
+
+const ElfSymbol *TraceFormatter::
+getRelOffsetSymbol(uint32_t address, uint32_t base, const char *baseName) const
+{
+  const CoreSymbolInfo *symbols = getSymbols();
+  const ElfSymbol *sym, *baseSym;
+  if (symbols &&
+      (sym = symbols->getDataSymbol(address)) &&
+      sym->value == address &&
+      (baseSym = symbols->getGlobalSymbol(baseName)) &&
+      baseSym->value == base) {
+    return sym;
+  }
+  return 0;
+}
+
+void TraceFormatter::cpRelOffset(uint32_t offset, uint32_t cpValue)
+{
+  uint32_t address = cpValue + (offset << 2);
+  if (const ElfSymbol *sym = getRelOffsetSymbol(address, cpValue, "_cp")) {
+    *line.buf << sym->name;
+    *line.buf << "(0x" << std::hex << address << ')';
+  } else {
+    *line.buf << offset;
+  }
+}
+
+void TraceFormatter::dpRelOffset(uint32_t offset, uint32_t dpValue)
+{
+  uint32_t address = dpValue + (offset << 2);
+  if (const ElfSymbol *sym = getRelOffsetSymbol(address, dpValue, "_dp")) {
+    *line.buf << sym->name;
+    *line.buf << "(0x" << std::hex << address << std::dec << ')';
+  } else {
+    *line.buf << offset;
+  }
+}
+
+void TraceFormatter::regWrite(Register reg, uint32_t value)
+{
+  if (!line.hadRegWrite) {
+    *line.buf << ' ';
+    // Align
+    size_t pos = line.buf->str().size() - line.numEscapeChars;
+    if (pos < regWriteColumn) {
+      *line.buf << std::setw(regWriteColumn - pos) << "";
+    }
+    *line.buf << "# ";
+  } else {
+    *line.buf << ", ";
+  }
+  *line.buf << reg << "=0x" << std::hex << value << std::dec;
+  line.hadRegWrite = true;
+}
+
+void TraceFormatter::flush()
+{
+  if (line.out)
+    line.out->flush();
+}
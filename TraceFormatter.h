@@ -0,0 +1,91 @@
+// Copyright (c) 2012, Richard Osborne, All rights reserved
+// This software is freely distributable under a derivative of the
+// University of Illinois/NCSA Open Source License posted in
+// LICENSE.txt and at <http://github.xcore.com/>
+
+#ifndef _TraceFormatter_h_
+#define _TraceFormatter_h_
+
+#include "TraceOutput.h"
+#include "TerminalColours.h"
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+class ElfSymbol;
+
+/// Formats the trace as text.
+class TraceFormatter : public TraceOutput {
+private:
+  struct LineState {
+    LineState(std::ostringstream *b) :
+      hasThread(false),
+      out(0),
+      buf(b),
+      pending(0) {}
+    LineState(std::ostream &o, std::ostringstream &b, std::ostringstream &pendingBuf) :
+      hasThread(false),
+      out(&o),
+      buf(&b),
+      pending(&pendingBuf) {}
+    bool hasThread;
+    unsigned core;
+    unsigned thread;
+    bool hadRegWrite;
+    size_t numEscapeChars;
+    std::ostream *out;
+    std::ostringstream *buf;
+    std::ostringstream *pending;
+  };
+  struct CoreInfo {
+    std::string name;
+    const CoreSymbolInfo *symbols;
+  };
+  std::ostringstream buf;
+  std::ostringstream pendingBuf;
+  LineState line;
+  /// Lines saved by pushLine().
+  std::vector<LineState> savedLines;
+  /// Whether each unmatched pushLine() saved a line.
+  std::vector<bool> needRestore;
+  std::vector<CoreInfo> cores;
+  TerminalColours colours;
+
+  void escapeCode(const char *s);
+  const CoreSymbolInfo *getSymbols() const { return cores[line.core].symbols; }
+  const ElfSymbol *getRelOffsetSymbol(uint32_t address, uint32_t base,
+                                      const char *baseName) const;
+public:
+  TraceFormatter(std::ostream &out) :
+    line(out, buf, pendingBuf),
+    colours(TerminalColours::null) {}
+
+  void setColour(bool enable);
+
+  virtual void addCore(unsigned core, const std::string &name,
+                       const CoreSymbolInfo *symbols);
+  virtual void startLine();
+  virtual void startThreadLine(ticks_t time, unsigned core, unsigned thread);
+  virtual void startNodeLine(unsigned nodeID);
+  virtual void setLineThread(unsigned core, unsigned thread);
+  virtual void pushLine();
+  virtual void popLine();
+  virtual void endLine();
+  virtual void threadName();
+  virtual void pc(uint32_t address);
+  virtual void alignMnemonic();
+  virtual void colour(Colour c);
+  virtual void text(const char *s);
+  virtual void text(const std::string &s);
+  virtual void unsignedValue(uint32_t value);
+  virtual void signedValue(int32_t value);
+  virtual void hexValue(uint32_t value);
+  virtual void reg(Register reg);
+  virtual void srcReg(Register reg, uint32_t value);
+  virtual void cpRelOffset(uint32_t offset, uint32_t cpValue);
+  virtual void dpRelOffset(uint32_t offset, uint32_t dpValue);
+  virtual void regWrite(Register reg, uint32_t value);
+  virtual void flush();
+};
+
+#endif // _TraceFormatter_h_
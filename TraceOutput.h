@@ -0,0 +1,70 @@
+// Copyright (c) 2012, Richard Osborne, All rights reserved
+// This software is freely distributable under a derivative of the
+// University of Illinois/NCSA Open Source License posted in
+// LICENSE.txt and at <http://github.xcore.com/>
+
+#ifndef _TraceOutput_h_
+#define _TraceOutput_h_
+
+#include "Config.h"
+#include "Register.h"
+#include <string>
+
+class CoreSymbolInfo;
+
+/// Destination for trace output. The tracer describes each line of the trace
+/// as a sequence of calls on this interface. Cores are referred to by a small
+/// integer assigned by the tracer.
+class TraceOutput {
+public:
+  enum Colour {
+    COLOUR_RESET,
+    COLOUR_RED,
+    COLOUR_GREEN
+  };
+
+  virtual ~TraceOutput() {}
+
+  /// Describe a core. Must be called before the core is first referenced.
+  virtual void addCore(unsigned core, const std::string &name,
+                       const CoreSymbolInfo *symbols) = 0;
+
+  virtual void startLine() = 0;
+  /// Start a line for a thread, prefixed by the time and the thread name.
+  virtual void startThreadLine(ticks_t time, unsigned core,
+                               unsigned thread) = 0;
+  /// Start a line for a node, prefixed by the node name.
+  virtual void startNodeLine(unsigned nodeID) = 0;
+  /// Associate the current line with a thread without printing anything.
+  virtual void setLineThread(unsigned core, unsigned thread) = 0;
+  /// Save the current line if it belongs to a thread. A line started before
+  /// the matching popLine() is printed after the saved line.
+  virtual void pushLine() = 0;
+  virtual void popLine() = 0;
+  virtual void endLine() = 0;
+
+  virtual void threadName() = 0;
+  /// Print an address in the current line's core, using symbols if possible.
+  virtual void pc(uint32_t address) = 0;
+  /// Pad the line to the column where the mnemonic starts.
+  virtual void alignMnemonic() = 0;
+  virtual void colour(Colour c) = 0;
+  /// Print a string. The string must have static storage duration.
+  virtual void text(const char *s) = 0;
+  virtual void text(const std::string &s) = 0;
+  virtual void unsignedValue(uint32_t value) = 0;
+  virtual void signedValue(int32_t value) = 0;
+  /// Print a value in hexadecimal without a prefix.
+  virtual void hexValue(uint32_t value) = 0;
+  virtual void reg(Register reg) = 0;
+  /// Print a register followed by its value.
+  virtual void srcReg(Register reg, uint32_t value) = 0;
+  virtual void cpRelOffset(uint32_t offset, uint32_t cpValue) = 0;
+  virtual void dpRelOffset(uint32_t offset, uint32_t dpValue) = 0;
+  virtual void regWrite(Register reg, uint32_t value) = 0;
+
+  /// Write out any buffered output.
+  virtual void flush() {}
+};
+
+#endif // _TraceOutput_h_
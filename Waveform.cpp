@@ -0,0 +1,413 @@
+// Copyright (c) 2012, Richard Osborne, All rights reserved
+// This software is freely distributable under a derivative of the
+// University of Illinois/NCSA Open Source License posted in
+// LICENSE.txt and at <http://github.xcore.com/>
+
+#include "Waveform.h"
+#include <iostream>
+#include <sstream>
+
+namespace {
+  const char compactMagic[8] = { 'A', 'X', 'E', 'W', 'A', 'V', 'E', 'S' };
+  const unsigned compactVersion = 1;
+  enum CompactRecordType {
+    DEFINE_SIGNAL,
+    CHANGE
+  };
+  /// Picoseconds per tick.
+  const uint64_t psPerTick = 1000000 / (100 * CYCLES_PER_TICK);
+}
+
+VcdWriter::VcdWriter(std::FILE *f) :
+  file(f),
+  wroteHeader(false),
+  maxTime(0),
+  currentTime(0),
+  wroteTime(false),
+  clampedChanges(0)
+{
+}
+
+void VcdWriter::
+addSignal(unsigned id, const std::string &scope, const std::string &name,
+          unsigned width)
+{
+  if (id >= signals.size())
+    signals.resize(id + 1);
+  SignalState &signal = signals[id];
+  signal.scope = scope;
+  signal.name = name;
+  signal.width = width;
+  signal.nextEdge = 0;
+  // Identifier codes are written in base 94 using the printable characters.
+  unsigned n = id;
+  do {
+    signal.code += char('!' + n % 94);
+    n /= 94;
+  } while (n);
+}
+
+void VcdWriter::writeHeader()
+{
+  std::fprintf(file, "$timescale 1ps $end\n");
+  std::string scope;
+  for (std::vector<SignalState>::const_iterator it = signals.begin(),
+       e = signals.end(); it != e; ++it) {
+    if (it->width == 0)
+      continue;
+    if (it->scope != scope) {
+      if (!scope.empty())
+        std::fprintf(file, "$upscope $end\n");
+      scope = it->scope;
+      std::fprintf(file, "$scope module %s $end\n", scope.c_str());
+    }
+    std::fprintf(file, "$var wire %u %s %s $end\n", it->width,
+                 it->code.c_str(), it->name.c_str());
+  }
+  if (!scope.empty())
+    std::fprintf(file, "$upscope $end\n");
+  std::fprintf(file, "$enddefinitions $end\n");
+  writeTime(0);
+  std::fprintf(file, "$dumpvars\n");
+  for (std::vector<SignalState>::const_iterator it = signals.begin(),
+       e = signals.end(); it != e; ++it) {
+    if (it->width != 0)
+      writeValue(*it, 0);
+  }
+  std::fprintf(file, "$end\n");
+  wroteHeader = true;
+}
+
+void VcdWriter::writeTime(ticks_t time)
+{
+  if (wroteTime && time == currentTime)
+    return;
+  std::fprintf(file, "#%llu\n", (unsigned long long)(time * psPerTick));
+  currentTime = time;
+  wroteTime = true;
+}
+
+void VcdWriter::writeValue(const SignalState &signal, uint32_t value)
+{
+  if (signal.width == 1) {
+    std::fprintf(file, "%c%s\n", (value & 1) ? '1' : '0', signal.code.c_str());
+    return;
+  }
+  char bits[33];
+  char *p = &bits[32];
+  *p = '\0';
+  do {
+    *--p = (value & 1) ? '1' : '0';
+    value >>= 1;
+  } while (value);
+  std::fprintf(file, "b%s %s\n", p, signal.code.c_str());
+}
+
+void VcdWriter::advanceClocks(ticks_t time)
+{
+  while (true) {
+    SignalState *next = 0;
+    for (std::vector<SignalState>::iterator it = signals.begin(),
+         e = signals.end(); it != e; ++it) {
+      if (it->value.isClock() && it->nextEdge <= time &&
+          (!next || it->nextEdge < next->nextEdge))
+        next = &*it;
+    }
+    if (!next)
+      return;
+    writeTime(next->nextEdge);
+    writeValue(*next, next->value.getValue(next->nextEdge));
+    next->nextEdge += next->value.halfPeriod;
+  }
+}
+
+void VcdWriter::apply(const WaveformChange &change)
+{
+  if (change.signal >= signals.size() || signals[change.signal].width == 0)
+    return;
+  // Changes that arrive too late are written at the current time.
+  ticks_t time = change.time;
+  if (time < currentTime) {
+    time = currentTime;
+    ++clampedChanges;
+  }
+  advanceClocks(time);
+  SignalState &signal = signals[change.signal];
+  Signal value;
+  value.halfPeriod = change.halfPeriod;
+  value.value = change.value;
+  if (value == signal.value)
+    return;
+  bool wasClock = signal.value.isClock();
+  uint32_t oldValue = signal.value.getValue(time);
+  signal.value = value;
+  if (value.isClock()) {
+    // Find the first edge after the change.
+    ticks_t period = ticks_t(value.halfPeriod) * 2;
+    ticks_t sinceEdge = (time + period - value.value % period) %
+                        value.halfPeriod;
+    signal.nextEdge = time + value.halfPeriod - sinceEdge;
+  }
+  uint32_t newValue = value.getValue(time);
+  if (wasClock || newValue != oldValue) {
+    writeTime(time);
+    writeValue(signal, newValue);
+  }
+}
+
+void VcdWriter::emitUpTo(ticks_t time)
+{
+  std::multimap<ticks_t,WaveformChange>::iterator it = pending.begin();
+  for (; it != pending.end() && it->first <= time; ++it)
+    apply(it->second);
+  pending.erase(pending.begin(), it);
+}
+
+void VcdWriter::change(const WaveformChange &change)
+{
+  if (!wroteHeader)
+    writeHeader();
+  pending.insert(pending.end(), std::make_pair(change.time, change));
+  if (change.time <= maxTime)
+    return;
+  maxTime = change.time;
+  if (maxTime > reorderWindow)
+    emitUpTo(maxTime - reorderWindow);
+}
+
+void VcdWriter::finish()
+{
+  if (!wroteHeader)
+    writeHeader();
+  emitUpTo(maxTime);
+  advanceClocks(maxTime);
+  std::fflush(file);
+}
+
+namespace {
+  /// Writes the waveform as a VCD file.
+  class VcdSink : public WaveformSink {
+    std::FILE *file;
+    VcdWriter writer;
+  public:
+    VcdSink(std::FILE *f) : file(f), writer(f) {}
+    ~VcdSink() { std::fclose(file); }
+    virtual void addSignal(unsigned id, const std::string &scope,
+                           const std::string &name, unsigned width)
+    {
+      writer.addSignal(id, scope, name, width);
+    }
+    virtual void write(const uint8_t *data, size_t size)
+    {
+      for (; size >= sizeof(WaveformChange);
+           data += sizeof(WaveformChange), size -= sizeof(WaveformChange)) {
+        WaveformChange change;
+        std::memcpy(&change, data, sizeof(change));
+        writer.change(change);
+      }
+    }
+    virtual void flush() { std::fflush(file); }
+    virtual void finish()
+    {
+      writer.finish();
+      if (uint64_t clamped = writer.getClampedChanges()) {
+        std::cerr << "Warning: " << clamped << " waveform changes arrived "
+                  << "outside the reordering window and were written late"
+                  << std::endl;
+      }
+    }
+  };
+
+  /// Writes the waveform in the compact format. Integers are encoded as
+  /// LEB128 varints and times as the signed difference from the previous
+  /// change.
+  class CompactSink : public WaveformSink {
+    std::FILE *file;
+    ticks_t lastTime;
+    void writeUnsigned(uint64_t value)
+    {
+      while (value >= 0x80) {
+        std::putc(int(value & 0x7f) | 0x80, file);
+        value >>= 7;
+      }
+      std::putc(int(value), file);
+    }
+    void writeSigned(int64_t value)
+    {
+      writeUnsigned((uint64_t(value) << 1) ^ uint64_t(value >> 63));
+    }
+    void writeString(const std::string &s)
+    {
+      writeUnsigned(s.size());
+      std::fwrite(s.data(), 1, s.size(), file);
+    }
+  public:
+    CompactSink(std::FILE *f) : file(f), lastTime(0)
+    {
+      std::fwrite(compactMagic, 1, sizeof(compactMagic), file);
+      writeUnsigned(compactVersion);
+    }
+    ~CompactSink() { std::fclose(file); }
+    virtual void addSignal(unsigned id, const std::string &scope,
+                           const std::string &name, unsigned width)
+    {
+      std::putc(DEFINE_SIGNAL, file);
+      writeUnsigned(id);
+      writeString(scope);
+      writeString(name);
+      writeUnsigned(width);
+    }
+    virtual void write(const uint8_t *data, size_t size)
+    {
+      for (; size >= sizeof(WaveformChange);
+           data += sizeof(WaveformChange), size -= sizeof(WaveformChange)) {
+        WaveformChange change;
+        std::memcpy(&change, data, sizeof(change));
+        std::putc(CHANGE, file);
+        writeSigned(int64_t(change.time - lastTime));
+        lastTime = change.time;
+        writeUnsigned(change.signal);
+        writeUnsigned(change.halfPeriod);
+        writeUnsigned(change.value);
+      }
+    }
+    virtual void flush() { std::fflush(file); }
+    virtual void finish() { std::fflush(file); }
+  };
+}
+
+Waveform::Waveform(WaveformSink *s) :
+  sink(s),
+  buffer(*s),
+  numSignals(0)
+{
+  start = pos = buffer.getBlock();
+  end = start + TraceBuffer::blockSize;
+}
+
+Waveform::~Waveform()
+{
+  flush();
+  sink->finish();
+}
+
+Waveform *Waveform::open(const std::string &filename)
+{
+  std::FILE *f = std::fopen(filename.c_str(), "wb");
+  if (!f)
+    return 0;
+  std::string::size_type dot = filename.rfind('.');
+  if (dot != std::string::npos && filename.substr(dot) == ".vcd")
+    return new Waveform(new VcdSink(f));
+  return new Waveform(new CompactSink(f));
+}
+
+unsigned Waveform::
+addSignal(const std::string &scope, const std::string &name, unsigned width)
+{
+  unsigned id = numSignals++;
+  sink->addSignal(id, scope, name, width);
+  return id;
+}
+
+void Waveform::switchBuffer()
+{
+  buffer.commit(pos - start);
+  start = pos = buffer.getBlock();
+  end = start + TraceBuffer::blockSize;
+}
+
+void Waveform::flush()
+{
+  switchBuffer();
+  buffer.flush();
+}
+
+bool isCompactWaveform(std::FILE *file)
+{
+  char magic[sizeof(compactMagic)];
+  long offset = std::ftell(file);
+  size_t size = std::fread(magic, 1, sizeof(magic), file);
+  std::fseek(file, offset, SEEK_SET);
+  return size == sizeof(magic) &&
+         std::memcmp(magic, compactMagic, sizeof(magic)) == 0;
+}
+
+static bool readUnsigned(std::FILE *in, uint64_t &value)
+{
+  value = 0;
+  for (unsigned shift = 0; shift < 64; shift += 7) {
+    int byte = std::getc(in);
+    if (byte == EOF)
+      return false;
+    value |= uint64_t(byte & 0x7f) << shift;
+    if (!(byte & 0x80))
+      return true;
+  }
+  return false;
+}
+
+static bool readString(std::FILE *in, std::string &s)
+{
+  uint64_t size;
+  if (!readUnsigned(in, size))
+    return false;
+  s.resize(size);
+  return size == 0 || std::fread(&s[0], 1, size, in) == size;
+}
+
+bool convertCompactWaveform(std::FILE *in, VcdWriter &out, std::string &error)
+{
+  char magic[sizeof(compactMagic)];
+  uint64_t version;
+  if (std::fread(magic, 1, sizeof(magic), in) != sizeof(magic) ||
+      std::memcmp(magic, compactMagic, sizeof(magic)) != 0) {
+    error = "not a waveform";
+    return false;
+  }
+  if (!readUnsigned(in, version) || version != compactVersion) {
+    error = "unsupported waveform version";
+    return false;
+  }
+  ticks_t lastTime = 0;
+  int type;
+  while ((type = std::getc(in)) != EOF) {
+    switch (type) {
+    default: {
+      std::ostringstream message;
+      message << "unknown record type " << type;
+      error = message.str();
+      return false;
+    }
+    case DEFINE_SIGNAL: {
+      uint64_t id, width;
+      std::string scope, name;
+      if (!readUnsigned(in, id) || !readString(in, scope) ||
+          !readString(in, name) || !readUnsigned(in, width)) {
+        error = "truncated signal definition";
+        return false;
+      }
+      out.addSignal(id, scope, name, width);
+      break;
+    }
+    case CHANGE: {
+      uint64_t delta, signal, halfPeriod, value;
+      if (!readUnsigned(in, delta) || !readUnsigned(in, signal) ||
+          !readUnsigned(in, halfPeriod) || !readUnsigned(in, value)) {
+        error = "truncated change";
+        return false;
+      }
+      lastTime += int64_t(delta >> 1) ^ -int64_t(delta & 1);
+      WaveformChange change;
+      change.time = lastTime;
+      change.signal = signal;
+      change.halfPeriod = halfPeriod;
+      change.value = value;
+      out.change(change);
+      break;
+    }
+    }
+  }
+  out.finish();
+  return true;
+}
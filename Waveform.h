@@ -0,0 +1,134 @@
+// Copyright (c) 2012, Richard Osborne, All rights reserved
+// This software is freely distributable under a derivative of the
+// University of Illinois/NCSA Open Source License posted in
+// LICENSE.txt and at <http://github.xcore.com/>
+
+#ifndef _Waveform_h_
+#define _Waveform_h_
+
+#include "Config.h"
+#include "Signal.h"
+#include "TraceBuffer.h"
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Changes to the value on the pins of selected ports are recorded as fixed
+// size records in the blocks of a TraceBuffer. The background thread either
+// writes them as a VCD file or encodes them in a compact binary format which
+// axe-trace converts to VCD. Clocks are recorded as a period and phase rather
+// than as individual edges.
+
+/// A change to the value of a signal.
+struct WaveformChange {
+  ticks_t time;
+  uint32_t signal;
+  /// The fields of the Signal.
+  uint32_t halfPeriod;
+  uint32_t value;
+};
+
+/// Writes signal changes as a VCD file. Changes may arrive slightly out of
+/// order since ports are updated lazily, so changes are held back until they
+/// are older than a window behind the latest change seen. Clocks are expanded
+/// into edges as the output advances.
+class VcdWriter {
+  struct SignalState {
+    std::string scope;
+    std::string name;
+    unsigned width;
+    std::string code;
+    Signal value;
+    /// Time of the next edge if the signal is a clock.
+    ticks_t nextEdge;
+  };
+  std::FILE *file;
+  std::vector<SignalState> signals;
+  std::multimap<ticks_t,WaveformChange> pending;
+  bool wroteHeader;
+  ticks_t maxTime;
+  ticks_t currentTime;
+  bool wroteTime;
+  /// Number of changes written later than they happened.
+  uint64_t clampedChanges;
+
+  void writeHeader();
+  void writeTime(ticks_t time);
+  void writeValue(const SignalState &signal, uint32_t value);
+  /// Write the edges of all clocks up to and including the specified time.
+  void advanceClocks(ticks_t time);
+  void apply(const WaveformChange &change);
+  void emitUpTo(ticks_t time);
+public:
+  /// Changes older than this many ticks behind the latest change are written.
+  static const ticks_t reorderWindow = 1 << 20;
+
+  VcdWriter(std::FILE *f);
+  void addSignal(unsigned id, const std::string &scope,
+                 const std::string &name, unsigned width);
+  void change(const WaveformChange &change);
+  /// Write all remaining changes.
+  void finish();
+  /// Returns the number of changes that arrived after the output had already
+  /// advanced past them and so were written at a later time.
+  uint64_t getClampedChanges() const { return clampedChanges; }
+};
+
+/// Consumer of waveform records.
+class WaveformSink : public TraceSink {
+public:
+  virtual void addSignal(unsigned id, const std::string &scope,
+                         const std::string &name, unsigned width) = 0;
+  /// Called once all changes have been written.
+  virtual void finish() = 0;
+};
+
+/// Records the changes of the selected signals.
+class Waveform {
+  std::auto_ptr<WaveformSink> sink;
+  TraceBuffer buffer;
+  uint8_t *start;
+  uint8_t *pos;
+  uint8_t *end;
+  unsigned numSignals;
+
+  Waveform(WaveformSink *s);
+  Waveform(const Waveform &); // Not implemented.
+  void operator=(const Waveform &); // Not implemented.
+  void switchBuffer();
+public:
+  ~Waveform();
+  /// Open a waveform file. Files with a .vcd extension are written in the VCD
+  /// format, other files in the compact format. Returns 0 on failure.
+  static Waveform *open(const std::string &filename);
+  /// Add a signal. All signals must be added before any changes are recorded.
+  unsigned addSignal(const std::string &scope, const std::string &name,
+                     unsigned width);
+  void change(unsigned signal, const Signal &value, ticks_t time)
+  {
+    if (size_t(end - pos) < sizeof(WaveformChange))
+      switchBuffer();
+    WaveformChange record;
+    record.time = time;
+    record.signal = signal;
+    record.halfPeriod = value.halfPeriod;
+    record.value = value.value;
+    std::memcpy(pos, &record, sizeof(record));
+    pos += sizeof(record);
+  }
+  /// Write everything recorded so far.
+  void flush();
+};
+
+/// Returns true if the file starts with the magic of the compact format. The
+/// position in the file is unchanged.
+bool isCompactWaveform(std::FILE *file);
+
+/// Convert a waveform in the compact format to VCD. Returns false and sets the
+/// error if the file is malformed.
+bool convertCompactWaveform(std::FILE *in, VcdWriter &out, std::string &error);
+
+#endif // _Waveform_h_
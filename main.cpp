@@ -20,11 +20,22 @@
 #include <climits>
 #include <set>
 #include <map>
+#include <sstream>
+#include <utility>
+#include <vector>
+#if defined(TAIL_CALL_DISPATCH) && !defined(_WIN32)
+#include <dlfcn.h>
+#endif
 
 #include "Trace.h"
 #include "Stats.h"
+#include "Profiler.h"
 #include "Resource.h"
 #include "Core.h"
+#include "Port.h"
+#include "HostPort.h"
+#include "Waveform.h"
+#include "Plugin.h"
 #include "SyscallHandler.h"
 #include "SymbolInfo.h"
 #include "XE.h"
@@ -35,6 +46,9 @@
 #include "Node.h"
 #include "SystemState.h"
 #include "LatencyModel.h"
+#include "HugePages.h"
+#include "NativeCode.h"
+#include "Heartbeat.h"
 
 #define XCORE_ELF_MACHINE_OLD 0xB49E
 #define XCORE_ELF_MACHINE 0xCB
@@ -52,9 +66,70 @@ static void printUsage(const char *ProgName) {
 "  -s <file> Load an 'se' executable\n"
 "  -p        Display the simulation parameters\n"
 "  -t        Enable instruction tracing\n"
+"  --binary-trace <file>\n"
+"            Write the instruction trace to a file in binary format\n"
+"  --trace-core <name|id>\n"
+"            Only trace the specified core\n"
+"  --trace-thread <n>\n"
+"            Only trace the specified thread number\n"
+"  --trace-pc <start>-<end>|<function>\n"
+"            Only trace instructions in the address range or function\n"
+"  --trace-time <start>-<end>\n"
+"            Only trace instructions executed between the specified times\n"
+"  --trace-off\n"
+"            Don't trace until the program calls the trace start syscall\n"
 "  -S        Display system statistics\n"
+"  --heartbeat <file|unix:path>\n"
+"            Report the progress of the simulation to a file or Unix domain\n"
+"            socket\n"
+"  --heartbeat-interval <seconds>\n"
+"            Time between progress reports (default 5)\n"
+"  --stats-json <file>\n"
+"            Write the system statistics and simulation performance to a\n"
+"            file in JSON format\n"
 "  -T        Display thread statistics\n"
 "  -I        Display instruction statistics\n"
+"  --profile <n>\n"
+"            Sample the pc of each thread every n cycles and report the\n"
+"            functions where the most time is spent\n"
+"  --profile-instructions <n>\n"
+"            Sample the pc of each thread every n instructions\n"
+"  --profile-output <file>\n"
+"            Write the profile to a file in callgrind format\n"
+"  --profile-exact <file>\n"
+"            Count every instruction executed and write an annotated\n"
+"            listing of each function to a file\n"
+"  --profile-callgraph <file>\n"
+"            Track the calls and returns of each thread, report the inclusive\n"
+"            and exclusive cycles of each function and write the call stacks\n"
+"            to a file in the collapsed format used by flame graph tools\n"
+"  --loopback <port1> <port2>\n"
+"            Connect the pins of two ports. A port is a resource ID or a\n"
+"            name such as XS1_PORT_1A, optionally prefixed by the name or ID\n"
+"            of its core and a colon (default first core)\n"
+"  --port-in <port> <file> <rate>\n"
+"            Drive the pins of a port on the first core with samples read\n"
+"            from a file at the specified rate in Hz (- for stdin)\n"
+"  --port-out <port> <file> <rate>\n"
+"            Write the value on the pins of a port on the first core to a\n"
+"            file at the specified rate in Hz, or on every change if the\n"
+"            rate is 0 (- for stdout)\n"
+"  --plugin <file> <args>\n"
+"            Load a peripheral plugin from a shared object, passing it the\n"
+"            arguments separated by whitespace\n"
+"  --waveform <file>\n"
+"            Record the pins of the ports selected with --waveform-port in a\n"
+"            VCD file if the name ends in .vcd, otherwise in a compact format\n"
+"            which axe-trace converts to VCD\n"
+"  --waveform-port <port>\n"
+"            Record the pins of a port on the first core\n"
+"  --huge-pages <mode>\n"
+"            Back core memory with huge pages (off, transparent, explicit)\n"
+"  --native <file>\n"
+"            Use code translated by axe-aot\n"
+"  --unbuffered-output\n"
+"            Write the output of the program to stdout and stderr as soon as\n"
+"            it is written instead of buffering it\n"
 "\n";
 }
 
@@ -244,6 +319,13 @@ static long readNumberAttribute(xmlNode *node, const char *name)
   return value;
 }
 
+static void readOptionalNumberAttribute(xmlNode *node, const char *name,
+                                        unsigned &value)
+{
+  if (findAttribute(node, name))
+    value = readNumberAttribute(node, name);
+}
+
 static inline std::auto_ptr<Core>
 createCoreFromConfig(xmlNode *config)
 {
@@ -253,7 +335,23 @@ createCoreFromConfig(xmlNode *config)
   xmlNode *ram = findChild(memoryController, "Ram");
   ram_base = readNumberAttribute(ram, "base");
   ram_size = readNumberAttribute(ram, "size");
-  std::auto_ptr<Core> core(new Core(ram_size, ram_base));
+  // Resource counts default to those in the configuration file but can be
+  // overridden per processor.
+  CoreParams params = Config::get().coreParams;
+  readOptionalNumberAttribute(config, "numThreads", params.numThreads);
+  readOptionalNumberAttribute(config, "numSynchronisers", params.numSyncs);
+  readOptionalNumberAttribute(config, "numLocks", params.numLocks);
+  readOptionalNumberAttribute(config, "numTimers", params.numTimers);
+  readOptionalNumberAttribute(config, "numChanends", params.numChanends);
+  readOptionalNumberAttribute(config, "numClockBlocks", params.numClkBlks);
+  readOptionalNumberAttribute(config, "num1BitPorts", params.num1BitPorts);
+  readOptionalNumberAttribute(config, "num4BitPorts", params.num4BitPorts);
+  readOptionalNumberAttribute(config, "num8BitPorts", params.num8BitPorts);
+  readOptionalNumberAttribute(config, "num16BitPorts", params.num16BitPorts);
+  readOptionalNumberAttribute(config, "num32BitPorts", params.num32BitPorts);
+  if (!params.validate())
+    std::exit(1);
+  std::auto_ptr<Core> core(new Core(ram_size, ram_base, params));
   core->setCoreNumber(readNumberAttribute(config, "number"));
   //if (xmlAttr *codeReference = findAttribute(config, "codeReference")) {
   //  core->setCodeReference((char*)codeReference->children->content);
@@ -406,7 +504,10 @@ readXEWithoutConfig(const char *filename, SymbolInfo &SI,
 
   // Create child cores
   for (int i=0; i<numCores; i++) {
-    std::auto_ptr<Core> core(new Core(RAM_SIZE, RAM_BASE));
+    const CoreParams &params = Config::get().coreParams;
+    // The ram base is equal to the ram size.
+    std::auto_ptr<Core> core(new Core(params.getRamSize(),
+                                      params.getRamSize(), params));
     core->setCoreNumber(i);
     node->addCore(core);
     //std::cout<<"Created core "<<i<<"\n";
@@ -522,7 +623,10 @@ createSESystem(const char *filename, int numCores)
 
   // Create child cores
   for (int i=0; i<numCores; i++) {
-    std::auto_ptr<Core> core(new Core(RAM_SIZE, RAM_BASE));
+    const CoreParams &params = Config::get().coreParams;
+    // The ram base is equal to the ram size.
+    std::auto_ptr<Core> core(new Core(params.getRamSize(),
+                                      params.getRamSize(), params));
     core->setCoreNumber(i);
     node->addCore(core);
     //std::cout<<"Created core "<<i<<"\n";
@@ -596,8 +700,282 @@ readSE(const char *filename, SymbolInfo &SI, std::set<Core*> &coresWithImage,
   return system;
 }
 
+static bool loadNativeCode(const char *filename, SystemState &sys)
+{
+#if defined(TAIL_CALL_DISPATCH) && !defined(_WIN32)
+  // The shared object is never unloaded as the handlers it contains are used
+  // until the simulation ends.
+  void *handle = dlopen(filename, RTLD_NOW);
+  if (!handle) {
+    std::cerr << "Error loading \"" << filename << "\": " << dlerror()
+              << std::endl;
+    return false;
+  }
+  const unsigned *version =
+    static_cast<const unsigned*>(dlsym(handle, NATIVE_CODE_VERSION_SYMBOL));
+  const NativeImage *images =
+    static_cast<const NativeImage*>(dlsym(handle, NATIVE_IMAGES_SYMBOL));
+  const unsigned *numImages =
+    static_cast<const unsigned*>(dlsym(handle, NUM_NATIVE_IMAGES_SYMBOL));
+  if (!version || !images || !numImages || *version != NATIVE_CODE_VERSION) {
+    std::cerr << "Error: \"" << filename << "\" was not produced by a"
+              << " compatible version of axe-aot" << std::endl;
+    return false;
+  }
+  std::map<std::pair<unsigned, unsigned>,Core*> coreMap;
+  addToCoreMap(coreMap, sys);
+  for (unsigned i = 0; i < *numImages; i++) {
+    const NativeImage &image = images[i];
+    Core *core = coreMap[std::make_pair(image.jtagIndex, image.core)];
+    if (!core || !core->setNativeCode(image)) {
+      std::cout << "Warning: translated code for node " << image.jtagIndex
+                << ", core " << image.core << " does not match the image\n";
+    }
+  }
+  return true;
+#else
+  std::cerr << "Error: translated code requires a build with"
+            << " AXE_TAIL_CALL_DISPATCH enabled" << std::endl;
+  return false;
+#endif
+}
+
+/// A port bound to a file on the host.
+struct HostPortBinding {
+  uint32_t port;
+  std::string filename;
+  /// Sample rate in Hz.
+  uint64_t rate;
+  bool input;
+};
+
+/// A port given on the command line.
+struct PortSpec {
+  /// Name or ID of the core, or empty for the first core.
+  std::string core;
+  uint32_t id;
+};
+
+/// Connections to the pins of ports and ports to record given on the command
+/// line.
+struct PortOptions {
+  std::vector<std::pair<PortSpec,PortSpec> > loopbacks;
+  std::vector<HostPortBinding> hostPorts;
+  const char *waveformFile;
+  std::vector<uint32_t> waveformPorts;
+  /// Shared objects and their arguments.
+  std::vector<std::pair<std::string,std::string> > plugins;
+  PortOptions() : waveformFile(0) {}
+};
+
+/// Owns the loaded plugins.
+struct PluginSet {
+  std::vector<AXEPlugin*> plugins;
+  ~PluginSet()
+  {
+    for (std::vector<AXEPlugin*>::iterator it = plugins.begin(),
+         e = plugins.end(); it != e; ++it) {
+      delete *it;
+    }
+  }
+};
+
+static const struct {
+  const char *name;
+  uint32_t id;
+} portNames[] = {
+  { "PORT_1A", 0x10200 }, { "PORT_1B", 0x10000 }, { "PORT_1C", 0x10100 },
+  { "PORT_1D", 0x10300 }, { "PORT_1E", 0x10600 }, { "PORT_1F", 0x10400 },
+  { "PORT_1G", 0x10500 }, { "PORT_1H", 0x10700 }, { "PORT_1I", 0x10a00 },
+  { "PORT_1J", 0x10800 }, { "PORT_1K", 0x10900 }, { "PORT_1L", 0x10b00 },
+  { "PORT_1M", 0x10c00 }, { "PORT_1N", 0x10d00 }, { "PORT_1O", 0x10e00 },
+  { "PORT_1P", 0x10f00 },
+  { "PORT_4A", 0x40000 }, { "PORT_4B", 0x40100 }, { "PORT_4C", 0x40200 },
+  { "PORT_4D", 0x40300 }, { "PORT_4E", 0x40400 }, { "PORT_4F", 0x40500 },
+  { "PORT_8A", 0x80000 }, { "PORT_8B", 0x80100 }, { "PORT_8C", 0x80200 },
+  { "PORT_8D", 0x80300 },
+  { "PORT_16A", 0x100000 }, { "PORT_16B", 0x100100 },
+  { "PORT_16C", 0x100200 }, { "PORT_16D", 0x100300 },
+  { "PORT_32A", 0x200000 }, { "PORT_32B", 0x200100 },
+};
+
+/// Parse a port resource ID or a port name as used in xs1.h, with or without
+/// the XS1_ prefix.
+static bool parsePortID(const std::string &s, uint32_t &id)
+{
+  std::string name = s.compare(0, 4, "XS1_") == 0 ? s.substr(4) : s;
+  for (unsigned i = 0; i < sizeof(portNames) / sizeof(portNames[0]); i++) {
+    if (name == portNames[i].name) {
+      id = portNames[i].id;
+      return true;
+    }
+  }
+  char *end;
+  unsigned long value = std::strtoul(s.c_str(), &end, 0);
+  if (s.empty() || *end != '\0')
+    return false;
+  id = value;
+  return true;
+}
+
+/// Parse a port of the form [<core>:]<port>.
+static bool parsePortSpec(const std::string &s, PortSpec &spec)
+{
+  std::string::size_type colon = s.rfind(':');
+  if (colon == std::string::npos) {
+    spec.core.clear();
+    return parsePortID(s, spec.id);
+  }
+  spec.core = s.substr(0, colon);
+  return !spec.core.empty() && parsePortID(s.substr(colon + 1), spec.id);
+}
+
+static Core *getFirstCore(SystemState &sys)
+{
+  if (sys.node_begin() == sys.node_end() ||
+      (*sys.node_begin())->core_begin() == (*sys.node_begin())->core_end()) {
+    std::cerr << "Error: no core to connect ports on" << std::endl;
+    return 0;
+  }
+  return *(*sys.node_begin())->core_begin();
+}
+
+static Port *getUnconnectedPort(Core &core, uint32_t id)
+{
+  Port *p = core.getPhysicalPort(ResourceID(id));
+  if (!p) {
+    std::cerr << "Error: 0x" << std::hex << id << std::dec
+              << " is not a valid port" << std::endl;
+    return 0;
+  }
+  if (p->isConnected()) {
+    std::cerr << "Error: port 0x" << std::hex << id << std::dec
+              << " is already connected" << std::endl;
+    return 0;
+  }
+  return p;
+}
+
+static Port *getUnconnectedPort(SystemState &sys, const PortSpec &spec)
+{
+  Core *core;
+  if (spec.core.empty()) {
+    core = getFirstCore(sys);
+    if (!core)
+      return 0;
+  } else {
+    core = sys.findCore(spec.core.c_str());
+    if (!core) {
+      std::cerr << "Error: no core named \"" << spec.core << "\""
+                << std::endl;
+      return 0;
+    }
+  }
+  return getUnconnectedPort(*core, spec.id);
+}
+
+/// Connect the ports given on the command line. Loopbacks may connect ports
+/// on different cores, other connections are made on the first core.
+static bool connectPorts(SystemState &sys, const PortOptions &connections)
+{
+  for (std::vector<std::pair<PortSpec,PortSpec> >::const_iterator
+       it = connections.loopbacks.begin(), e = connections.loopbacks.end();
+       it != e; ++it) {
+    Port *first = getUnconnectedPort(sys, it->first);
+    if (!first)
+      return false;
+    Port *second = getUnconnectedPort(sys, it->second);
+    if (!second)
+      return false;
+    if (first == second) {
+      std::cerr << "Error: can't connect port 0x" << std::hex
+                << it->first.id << std::dec << " to itself" << std::endl;
+      return false;
+    }
+    first->connect(new LoopbackWire(sys, *second));
+    second->connect(new LoopbackWire(sys, *first));
+  }
+  if (connections.hostPorts.empty())
+    return true;
+  Core *firstCore = getFirstCore(sys);
+  if (!firstCore)
+    return false;
+  Core &core = *firstCore;
+  for (std::vector<HostPortBinding>::const_iterator
+       it = connections.hostPorts.begin(), e = connections.hostPorts.end();
+       it != e; ++it) {
+    Port *port = getUnconnectedPort(core, it->port);
+    if (!port)
+      return false;
+    std::FILE *f = HostPort::open(it->filename, it->input);
+    if (!f) {
+      std::cerr << "Error opening \"" << it->filename << "\"" << std::endl;
+      return false;
+    }
+    ticks_t period = HostPort::getPeriod(it->rate);
+    if (it->input) {
+      HostPortInput *input = new HostPortInput(sys, *port, f, period);
+      port->connect(input);
+      input->start();
+    } else {
+      port->connect(new HostPortOutput(*port, f, period));
+    }
+  }
+  return true;
+}
+
+static bool loadPlugins(SystemState &sys, const PortOptions &options,
+                        PluginSet &loaded)
+{
+  for (std::vector<std::pair<std::string,std::string> >::const_iterator
+       it = options.plugins.begin(), e = options.plugins.end(); it != e; ++it) {
+    AXEPlugin *plugin = AXEPlugin::load(sys, it->first, it->second);
+    if (!plugin)
+      return false;
+    loaded.plugins.push_back(plugin);
+  }
+  return true;
+}
+
+/// Record the pins of the selected ports on the first core of the system.
+static bool recordWaveform(SystemState &sys, const PortOptions &options,
+                           std::auto_ptr<Waveform> &waveform)
+{
+  if (!options.waveformFile)
+    return true;
+  Core *core = getFirstCore(sys);
+  if (!core)
+    return false;
+  waveform.reset(Waveform::open(options.waveformFile));
+  if (!waveform.get()) {
+    std::cerr << "Error opening \"" << options.waveformFile << "\""
+              << std::endl;
+    return false;
+  }
+  for (std::vector<uint32_t>::const_iterator it = options.waveformPorts.begin(),
+       e = options.waveformPorts.end(); it != e; ++it) {
+    Port *port = core->getPhysicalPort(ResourceID(*it));
+    if (!port) {
+      std::cerr << "Error: 0x" << std::hex << *it << std::dec
+                << " is not a valid port" << std::endl;
+      return false;
+    }
+    std::ostringstream name;
+    name << "port_" << std::hex << *it;
+    port->setWaveform(waveform.get(),
+                      waveform->addSignal(core->getCoreName(), name.str(),
+                                          port->getPortWidth()));
+  }
+  return true;
+}
+
 int loop(const char *filename, bool tracing, bool se, 
-    bool systemStats, bool threadStats, bool instStats) {
+    bool systemStats, bool threadStats, bool instStats,
+    const char *nativeFile, const char *profileFile,
+    const char *exactProfileFile, const char *callGraphFile,
+    const char *statsFile, const char *heartbeatDest,
+    double heartbeatInterval, const PortOptions &portOptions) {
+  HostTime startTime = HostTime::now();
   std::auto_ptr<SymbolInfo> SI(new SymbolInfo);
   std::set<Core*> coresWithImage;
   std::map<Core*,uint32_t> entryPoints;
@@ -606,6 +984,21 @@ int loop(const char *filename, bool tracing, bool se,
     readXE(filename, *SI, coresWithImage, entryPoints);
   SystemState &sys = *statePtr;
 
+  if (HugePageAllocator::get().getMode() != HugePageAllocator::OFF)
+    HugePageAllocator::get().report();
+
+  if (nativeFile && !loadNativeCode(nativeFile, sys))
+    return 1;
+
+  if (!connectPorts(sys, portOptions))
+    return 1;
+  PluginSet plugins;
+  if (!loadPlugins(sys, portOptions, plugins))
+    return 1;
+  std::auto_ptr<Waveform> waveform;
+  if (!recordWaveform(sys, portOptions, waveform))
+    return 1;
+
   for (std::set<Core*>::iterator it = coresWithImage.begin(),
        e = coresWithImage.end(); it != e; ++it) {
     Core *core = *it;
@@ -641,26 +1034,80 @@ int loop(const char *filename, bool tracing, bool se,
  
   // Inisialise instruction statistics
   if (instStats) {
-    Stats::get().initStats(coresWithImage.size());
+    unsigned threadsPerCore = 0;
+    for (std::set<Core*>::iterator it = coresWithImage.begin(),
+         e = coresWithImage.end(); it != e; ++it) {
+      threadsPerCore = std::max(threadsPerCore, (*it)->getNumThreads());
+    }
+    Stats::get().initStats(coresWithImage.size(), threadsPerCore);
     Stats::get().setEnabled(true);
   }
  
+  if (exactProfileFile)
+    Profiler::get().initExact(sys);
+
   // Initialise tracing
+  if (tracing && !Tracer::get().getFilter().resolve(sys, *SI))
+    return 1;
+  // The tracer takes ownership of the symbol information.
+  const SymbolInfo &symbols = *SI;
   Tracer::get().setSymbolInfo(SI);
+  if (callGraphFile)
+    Profiler::get().initCallGraph(sys, symbols);
   if (tracing) {
     Tracer::get().setTracingEnabled(tracing);
+    Tracer::get().getFilter().schedule(sys.getScheduler());
+  }
+
+  std::auto_ptr<Heartbeat> heartbeat;
+  if (heartbeatDest) {
+    heartbeat.reset(new Heartbeat(sys));
+    if (!heartbeat->open(heartbeatDest))
+      return 1;
+    if (!heartbeat->start(heartbeatInterval)) {
+      std::cerr << "Error: failed to start the heartbeat" << std::endl;
+      return 1;
+    }
   }
 
   // Run the simulation
+  Thread::selectDispatchLoop();
+  sys.setLoadTime(HostTime::now() - startTime);
   int status = sys.run();
+  SyscallHandler::flushOutput();
+  if (tracing)
+    Tracer::get().flush();
 
   // Display statistics
   if (systemStats)
     sys.systemStats();
+  if (statsFile && !sys.writeStatsJSON(statsFile)) {
+    std::cerr << "Error writing \"" << statsFile << "\"" << std::endl;
+    return 1;
+  }
   if (threadStats)
     sys.threadStats();
   if (instStats)
     Stats::get().dump();
+  if (Profiler::get().getSampling()) {
+    Profiler::get().report(std::cout, symbols);
+    if (profileFile && !Profiler::get().writeCallgrind(profileFile, symbols)) {
+      std::cerr << "Error writing \"" << profileFile << "\"" << std::endl;
+      return 1;
+    }
+  }
+  if (exactProfileFile &&
+      !Profiler::get().writeExact(exactProfileFile, sys, symbols)) {
+    std::cerr << "Error writing \"" << exactProfileFile << "\"" << std::endl;
+    return 1;
+  }
+  if (callGraphFile) {
+    Profiler::get().reportCallGraph(std::cout, symbols);
+    if (!Profiler::get().writeCallGraph(callGraphFile, symbols)) {
+      std::cerr << "Error writing \"" << callGraphFile << "\"" << std::endl;
+      return 1;
+    }
+  }
 
   return status;
 }
@@ -678,11 +1125,66 @@ main(int argc, char **argv) {
   bool systemStats = false;
   bool threadStats = false;
   bool instStats = false;
+  const char *nativeFile = 0;
+  const char *profileFile = 0;
+  const char *exactProfileFile = 0;
+  const char *callGraphFile = 0;
+  const char *statsFile = 0;
+  const char *heartbeatDest = 0;
+  double heartbeatInterval = 5;
+  PortOptions portOptions;
   std::string arg;
   for (int i = 1; i < argc; i++) {
     arg = argv[i];
     if (arg == "-t") {
       tracing = true;
+    } else if (arg == "--binary-trace") {
+      if (i + 1 >= argc) {
+        printUsage(argv[0]);
+        return 1;
+      }
+      if (!Tracer::get().setBinaryOutput(argv[i + 1])) {
+        std::cerr << "Error opening \"" << argv[i + 1] << "\"" << std::endl;
+        return 1;
+      }
+      tracing = true;
+      i++;
+    } else if (arg == "--trace-core" || arg == "--trace-thread" ||
+               arg == "--trace-pc" || arg == "--trace-time") {
+      if (i + 1 >= argc) {
+        printUsage(argv[0]);
+        return 1;
+      }
+      std::string value = argv[i + 1];
+      TraceFilter &filter = Tracer::get().getFilter();
+      uint64_t start, end;
+      if (arg == "--trace-core") {
+        filter.addCore(value);
+      } else if (arg == "--trace-thread") {
+        char *endp;
+        unsigned long num = std::strtoul(value.c_str(), &endp, 0);
+        if (value.empty() || *endp != '\0') {
+          printUsage(argv[0]);
+          return 1;
+        }
+        filter.addThread(num);
+      } else if (arg == "--trace-pc") {
+        if (TraceFilter::parseRange(value, start, end))
+          filter.addAddressRange(start, std::min(end, uint64_t(0xffffffff)));
+        else
+          filter.addSymbol(value);
+      } else {
+        if (!TraceFilter::parseRange(value, start, end)) {
+          printUsage(argv[0]);
+          return 1;
+        }
+        filter.setTimeWindow(start, end);
+      }
+      tracing = true;
+      i++;
+    } else if (arg == "--trace-off") {
+      Tracer::get().getFilter().startDisabled();
+      tracing = true;
     } else if (arg == "-s") {
       loadSE = true;
     } else if (arg == "-p") {
@@ -697,10 +1199,140 @@ main(int argc, char **argv) {
       i++;
     } else if (arg == "-S") {
       systemStats = true;
+    } else if (arg == "--heartbeat") {
+      if (i + 1 >= argc) {
+        printUsage(argv[0]);
+        return 1;
+      }
+      heartbeatDest = argv[i + 1];
+      i++;
+    } else if (arg == "--heartbeat-interval") {
+      char *endp = 0;
+      heartbeatInterval = i + 1 < argc ? std::strtod(argv[i + 1], &endp) : 0;
+      if (heartbeatInterval <= 0 || *endp != '\0') {
+        printUsage(argv[0]);
+        return 1;
+      }
+      i++;
+    } else if (arg == "--stats-json") {
+      if (i + 1 >= argc) {
+        printUsage(argv[0]);
+        return 1;
+      }
+      statsFile = argv[i + 1];
+      i++;
     } else if (arg == "-T") {
       threadStats = true;
     } else if (arg == "-I") {
       instStats = true;
+    } else if (arg == "--profile" || arg == "--profile-instructions") {
+      char *endp = 0;
+      unsigned long long period =
+        i + 1 < argc ? std::strtoull(argv[i + 1], &endp, 0) : 0;
+      if (period == 0 || *endp != '\0') {
+        printUsage(argv[0]);
+        return 1;
+      }
+      Profiler::get().setSampling(arg == "--profile" ?
+                                  Profiler::SAMPLE_CYCLES :
+                                  Profiler::SAMPLE_INSTRUCTIONS, period);
+      i++;
+    } else if (arg == "--profile-output") {
+      if (i + 1 >= argc) {
+        printUsage(argv[0]);
+        return 1;
+      }
+      profileFile = argv[i + 1];
+      i++;
+    } else if (arg == "--profile-exact") {
+      if (i + 1 >= argc) {
+        printUsage(argv[0]);
+        return 1;
+      }
+      exactProfileFile = argv[i + 1];
+      Profiler::get().setExact();
+      i++;
+    } else if (arg == "--profile-callgraph") {
+      if (i + 1 >= argc) {
+        printUsage(argv[0]);
+        return 1;
+      }
+      callGraphFile = argv[i + 1];
+      Profiler::get().setCallGraph();
+      i++;
+    } else if (arg == "--loopback") {
+      if (i + 2 >= argc) {
+        printUsage(argv[0]);
+        return 1;
+      }
+      PortSpec first, second;
+      if (!parsePortSpec(argv[i + 1], first) ||
+          !parsePortSpec(argv[i + 2], second)) {
+        printUsage(argv[0]);
+        return 1;
+      }
+      portOptions.loopbacks.push_back(std::make_pair(first, second));
+      i += 2;
+    } else if (arg == "--port-in" || arg == "--port-out") {
+      if (i + 3 >= argc) {
+        printUsage(argv[0]);
+        return 1;
+      }
+      HostPortBinding binding;
+      char *endp1, *endp2;
+      binding.port = std::strtoul(argv[i + 1], &endp1, 0);
+      binding.filename = argv[i + 2];
+      binding.rate = std::strtoull(argv[i + 3], &endp2, 0);
+      binding.input = arg == "--port-in";
+      if (*argv[i + 1] == '\0' || *endp1 != '\0' ||
+          *argv[i + 3] == '\0' || *endp2 != '\0' ||
+          (binding.input && binding.rate == 0)) {
+        printUsage(argv[0]);
+        return 1;
+      }
+      portOptions.hostPorts.push_back(binding);
+      i += 3;
+    } else if (arg == "--plugin") {
+      if (i + 2 >= argc) {
+        printUsage(argv[0]);
+        return 1;
+      }
+      portOptions.plugins.push_back(std::make_pair(std::string(argv[i + 1]),
+                                                   std::string(argv[i + 2])));
+      i += 2;
+    } else if (arg == "--waveform") {
+      if (i + 1 >= argc) {
+        printUsage(argv[0]);
+        return 1;
+      }
+      portOptions.waveformFile = argv[i + 1];
+      i++;
+    } else if (arg == "--waveform-port") {
+      char *endp = 0;
+      unsigned long id = i + 1 < argc ? std::strtoul(argv[i + 1], &endp, 0) : 0;
+      if (!endp || *argv[i + 1] == '\0' || *endp != '\0') {
+        printUsage(argv[0]);
+        return 1;
+      }
+      portOptions.waveformPorts.push_back(id);
+      i++;
+    } else if (arg == "--huge-pages") {
+      HugePageAllocator::Mode mode;
+      if (i + 1 >= argc || !HugePageAllocator::parseMode(argv[i + 1], mode)) {
+        printUsage(argv[0]);
+        return 1;
+      }
+      HugePageAllocator::get().setMode(mode);
+      i++;
+    } else if (arg == "--native") {
+      if (i + 1 >= argc) {
+        printUsage(argv[0]);
+        return 1;
+      }
+      nativeFile = argv[i + 1];
+      i++;
+    } else if (arg == "--unbuffered-output") {
+      SyscallHandler::setOutputBuffering(false);
     } else if (arg == "-h") {
       printUsage(argv[0]);
       return 0;
@@ -724,5 +1356,17 @@ main(int argc, char **argv) {
   if(displayConfig) {
     Config::get().display();
   }
-  return loop(file, tracing, loadSE, systemStats, threadStats, instStats);
+  if (portOptions.waveformFile && portOptions.waveformPorts.empty()) {
+    std::cerr << "Error: --waveform requires at least one --waveform-port"
+              << std::endl;
+    return 1;
+  }
+  if (profileFile && !Profiler::get().getSampling()) {
+    std::cerr << "Error: --profile-output requires --profile or"
+              << " --profile-instructions" << std::endl;
+    return 1;
+  }
+  return loop(file, tracing, loadSE, systemStats, threadStats, instStats,
+              nativeFile, profileFile, exactProfileFile, callGraphFile,
+              statsFile, heartbeatDest, heartbeatInterval, portOptions);
 }
@@ -0,0 +1,162 @@
+// Copyright (c) 2012, Richard Osborne, All rights reserved
+// This software is freely distributable under a derivative of the
+// University of Illinois/NCSA Open Source License posted in
+// LICENSE.txt and at <http://github.xcore.com/>
+
+#ifndef _small_vector_h_
+#define _small_vector_h_
+
+#include <algorithm>
+
+/// Vector that stores up to InlineSize elements without allocating. Intended
+/// for the small sets and queues of pointers held by resources where the
+/// common case is zero or one element. Kind must be default constructible and
+/// copyable.
+template <typename Kind, unsigned InlineSize>
+class small_vector {
+private:
+  Kind *ptr;
+  unsigned numEntries;
+  unsigned cap;
+  Kind inlineBuf[InlineSize];
+
+  bool isInline() const
+  {
+    return ptr == inlineBuf;
+  }
+
+  void grow()
+  {
+    unsigned newCap = cap * 2;
+    Kind *newPtr = new Kind[newCap];
+    std::copy(ptr, ptr + numEntries, newPtr);
+    if (!isInline())
+      delete[] ptr;
+    ptr = newPtr;
+    cap = newCap;
+  }
+public:
+  typedef Kind *iterator;
+  typedef const Kind *const_iterator;
+
+  small_vector()
+    : ptr(inlineBuf),
+      numEntries(0),
+      cap(InlineSize) {}
+
+  small_vector(const small_vector &other)
+    : ptr(inlineBuf),
+      numEntries(0),
+      cap(InlineSize)
+  {
+    *this = other;
+  }
+
+  ~small_vector()
+  {
+    if (!isInline())
+      delete[] ptr;
+  }
+
+  small_vector &operator=(const small_vector &other)
+  {
+    if (this == &other)
+      return *this;
+    clear();
+    while (cap < other.numEntries)
+      grow();
+    std::copy(other.begin(), other.end(), ptr);
+    numEntries = other.numEntries;
+    return *this;
+  }
+
+  bool empty() const
+  {
+    return numEntries == 0;
+  }
+
+  unsigned size() const
+  {
+    return numEntries;
+  }
+
+  iterator begin() { return ptr; }
+  iterator end() { return ptr + numEntries; }
+  const_iterator begin() const { return ptr; }
+  const_iterator end() const { return ptr + numEntries; }
+
+  Kind &operator[](unsigned idx)
+  {
+    return ptr[idx];
+  }
+
+  const Kind &operator[](unsigned idx) const
+  {
+    return ptr[idx];
+  }
+
+  Kind &front()
+  {
+    return ptr[0];
+  }
+
+  const Kind &front() const
+  {
+    return ptr[0];
+  }
+
+  void push_back(const Kind &value)
+  {
+    if (numEntries == cap)
+      grow();
+    ptr[numEntries++] = value;
+  }
+
+  /// Erase the element at the specified position, preserving the order of the
+  /// remaining elements.
+  void erase(iterator it)
+  {
+    std::copy(it + 1, end(), it);
+    --numEntries;
+  }
+
+  /// Erase the element at the specified position in constant time by moving
+  /// the last element into its place. The order of the remaining elements is
+  /// not preserved.
+  void swap_erase(iterator it)
+  {
+    *it = ptr[--numEntries];
+  }
+
+  void pop_front()
+  {
+    erase(begin());
+  }
+
+  void clear()
+  {
+    numEntries = 0;
+  }
+
+  iterator find(const Kind &value)
+  {
+    return std::find(begin(), end(), value);
+  }
+
+  /// Add the value if it is not already present.
+  void insert_unique(const Kind &value)
+  {
+    if (find(value) == end())
+      push_back(value);
+  }
+
+  /// Remove the value if it is present.
+  void erase_value(const Kind &value)
+  {
+    iterator it = find(value);
+    if (it != end())
+      erase(it);
+  }
+};
+
+#endif // _small_vector_h_
@@ -0,0 +1,27 @@
+// RUN: xcc -O2 -target=XC-5 %s -o %t1.xe
+// RUN: not axe %t1.xe > %t2.txt 2>&1
+// RUN: awk '{ print } /^Register state:/ { exit }' %t2.txt > %t3.txt
+// RUN: cmp %t3.txt %s.expect
+// RUN: not axe %t1.xe --unbuffered-output > %t4.txt 2>&1
+// RUN: awk '{ print } /^Register state:/ { exit }' %t4.txt > %t5.txt
+// RUN: cmp %t5.txt %s.expect
+
+// The output of the program must be flushed before the report of an unhandled
+// exception. The register dump after it isn't checked.
+
+#include <string.h>
+#include <unistd.h>
+
+static void put(int fd, const char *s)
+{
+  write(fd, s, strlen(s));
+}
+
+int main()
+{
+  put(1, "out\n");
+  put(2, "err\n");
+  put(1, "partial ");
+  __asm__ volatile("ecallf %0" : : "r"(0));
+  return 0;
+}
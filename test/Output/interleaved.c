@@ -0,0 +1,29 @@
+// RUN: xcc -O2 -target=XC-5 %s -o %t1.xe
+// RUN: axe %t1.xe > %t2.txt 2>&1
+// RUN: cmp %t2.txt %s.expect
+// RUN: axe %t1.xe --unbuffered-output > %t3.txt 2>&1
+// RUN: cmp %t3.txt %s.expect
+
+// Output to stdout and stderr must appear in the order it was written. The
+// last write has no newline and is only flushed on exit.
+
+#include <string.h>
+#include <unistd.h>
+
+static void put(int fd, const char *s)
+{
+  write(fd, s, strlen(s));
+}
+
+int main()
+{
+  put(1, "out 1 ");
+  put(2, "err 1\n");
+  put(1, "out 2\n");
+  put(1, "out 3 ");
+  put(1, "continued\n");
+  put(2, "err 2 ");
+  put(1, "out 4\n");
+  put(2, "err 3");
+  return 0;
+}
@@ -0,0 +1,85 @@
+/* Copyright (c) 2012, Richard Osborne, All rights reserved
+ * This software is freely distributable under a derivative of the
+ * University of Illinois/NCSA Open Source License posted in
+ * LICENSE.txt and at <http://github.xcore.com/>
+ */
+
+/* Example plugin used by the tests. It drives the values output on one port
+ * onto the pins of another port after a delay in 400MHz cycles:
+ *
+ *   axe --plugin echo_plugin.so "-from 0x10200 -to 0x10000 -delay 400" ...
+ */
+
+#include "AXEPlugin.h"
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+  AXEPlugin *plugin;
+  const AXEPluginHost *host;
+  int from;
+  int to;
+  axe_ticks_t delay;
+} Echo;
+
+static void pinsChanged(void *data, int port, const AXEPinChange *changes,
+                        unsigned numChanges)
+{
+  Echo *echo = (Echo*)data;
+  unsigned i;
+  if (port != echo->from)
+    return;
+  for (i = 0; i < numChanges; i++) {
+    /* Clocks aren't echoed. */
+    if (changes[i].halfPeriod != 0)
+      continue;
+    echo->host->drivePins(echo->plugin, echo->to, changes[i].value,
+                          changes[i].time + echo->delay);
+  }
+}
+
+static void finish(void *data)
+{
+  free(data);
+}
+
+int axe_plugin_init(AXEPlugin *plugin, const AXEPluginHost *host, int argc,
+                    char **argv)
+{
+  AXEPluginCallbacks callbacks;
+  uint32_t from = 0, to = 0;
+  axe_ticks_t delay = 0;
+  Echo *echo;
+  int i;
+  if (host->version != AXE_PLUGIN_API_VERSION)
+    return 1;
+  for (i = 1; i + 1 < argc; i += 2) {
+    if (strcmp(argv[i], "-from") == 0)
+      from = strtoul(argv[i + 1], 0, 0);
+    else if (strcmp(argv[i], "-to") == 0)
+      to = strtoul(argv[i + 1], 0, 0);
+    else if (strcmp(argv[i], "-delay") == 0)
+      delay = strtoul(argv[i + 1], 0, 0);
+    else
+      return 1;
+  }
+  if (i != argc)
+    return 1;
+  echo = (Echo*)malloc(sizeof(Echo));
+  if (!echo)
+    return 1;
+  echo->plugin = plugin;
+  echo->host = host;
+  echo->delay = delay;
+  echo->from = host->attachPort(plugin, 0, from);
+  echo->to = host->attachPort(plugin, 0, to);
+  if (echo->from < 0 || echo->to < 0) {
+    free(echo);
+    return 1;
+  }
+  callbacks.pinsChanged = pinsChanged;
+  callbacks.wake = 0;
+  callbacks.finish = finish;
+  host->setCallbacks(plugin, &callbacks, echo);
+  return 0;
+}
@@ -0,0 +1,129 @@
+/* Copyright (c) 2012, Richard Osborne, All rights reserved
+ * This software is freely distributable under a derivative of the
+ * University of Illinois/NCSA Open Source License posted in
+ * LICENSE.txt and at <http://github.xcore.com/>
+ */
+
+/* UART receiver plugin used by the tests. It decodes the bytes output on a
+ * 1-bit port (8 data bits, no parity, 1 stop bit) and writes them to stdout:
+ *
+ *   axe --plugin uart_plugin.so "-port 0x10200 -bitrate 115200" ...
+ *
+ * Each bit is sampled in the middle of its bit time, measured from the
+ * falling edge of the start bit. Bytes with a bad stop bit are dropped. */
+
+#include "AXEPlugin.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CYCLES_PER_SECOND 400000000ULL
+
+typedef struct {
+  int port;
+  uint32_t bitRate;
+  uint32_t level;
+  int receiving;
+  axe_ticks_t startTime;
+  unsigned bit;
+  unsigned byte;
+} UART;
+
+/* Time of the middle of the specified bit of the current byte, where bit 0 is
+ * the start bit and bit 9 is the stop bit. */
+static axe_ticks_t sampleTime(const UART *uart, unsigned bit)
+{
+  return uart->startTime +
+         ((2 * bit + 1) * CYCLES_PER_SECOND) / (2 * uart->bitRate);
+}
+
+/* Take the samples that fall before the specified time. The pins hold the
+ * current level until then. */
+static void advance(UART *uart, axe_ticks_t time)
+{
+  while (uart->receiving && sampleTime(uart, uart->bit) < time) {
+    if (uart->bit == 0) {
+      /* False start. */
+      if (uart->level != 0)
+        uart->receiving = 0;
+    } else if (uart->bit <= 8) {
+      uart->byte |= uart->level << (uart->bit - 1);
+    } else {
+      if (uart->level != 0)
+        putchar(uart->byte);
+      uart->receiving = 0;
+    }
+    uart->bit++;
+  }
+}
+
+static void pinsChanged(void *data, int port, const AXEPinChange *changes,
+                        unsigned numChanges)
+{
+  UART *uart = (UART*)data;
+  unsigned i;
+  if (port != uart->port)
+    return;
+  for (i = 0; i < numChanges; i++) {
+    uint32_t value;
+    /* Clocks aren't decoded. */
+    if (changes[i].halfPeriod != 0)
+      continue;
+    value = changes[i].value & 1;
+    advance(uart, changes[i].time);
+    if (!uart->receiving && uart->level == 1 && value == 0) {
+      uart->receiving = 1;
+      uart->startTime = changes[i].time;
+      uart->bit = 0;
+      uart->byte = 0;
+    }
+    uart->level = value;
+  }
+}
+
+static void finish(void *data)
+{
+  UART *uart = (UART*)data;
+  advance(uart, ~(axe_ticks_t)0);
+  fflush(stdout);
+  free(uart);
+}
+
+int axe_plugin_init(AXEPlugin *plugin, const AXEPluginHost *host, int argc,
+                    char **argv)
+{
+  AXEPluginCallbacks callbacks;
+  uint32_t port = 0;
+  uint32_t bitRate = 115200;
+  UART *uart;
+  int i;
+  if (host->version != AXE_PLUGIN_API_VERSION)
+    return 1;
+  for (i = 1; i + 1 < argc; i += 2) {
+    if (strcmp(argv[i], "-port") == 0)
+      port = strtoul(argv[i + 1], 0, 0);
+    else if (strcmp(argv[i], "-bitrate") == 0)
+      bitRate = strtoul(argv[i + 1], 0, 0);
+    else
+      return 1;
+  }
+  if (i != argc || bitRate == 0)
+    return 1;
+  uart = (UART*)malloc(sizeof(UART));
+  if (!uart)
+    return 1;
+  uart->bitRate = bitRate;
+  /* The line idles high. */
+  uart->level = 1;
+  uart->receiving = 0;
+  uart->port = host->attachPort(plugin, 0, port);
+  if (uart->port < 0) {
+    free(uart);
+    return 1;
+  }
+  callbacks.pinsChanged = pinsChanged;
+  callbacks.wake = 0;
+  callbacks.finish = finish;
+  host->setCallbacks(plugin, &callbacks, uart);
+  return 0;
+}
@@ -0,0 +1,34 @@
+# Print the collapsed stacks below main without their cycles, then check the
+# report against the stacks. The first file is the report and the second the
+# collapsed stacks.
+FILENAME == ARGV[1] && $1 ~ /[0-9]%$/ {
+  inclusive[$4] = $2
+  exclusive[$4] = $3
+  next
+}
+FILENAME == ARGV[2] {
+  i = index($1, ";main")
+  if (i == 0)
+    next
+  path = substr($1, i + 1)
+  print path
+  cycles[path] = $2
+  leaf = path
+  sub(/.*;/, "", leaf)
+  stackExclusive[leaf] += $2
+  if (path ~ /^main;rec/)
+    recInclusive += $2
+}
+function check(name, expectedInclusive) {
+  if (inclusive[name] == expectedInclusive &&
+      exclusive[name] == stackExclusive[name])
+    print name " ok"
+  else
+    print name " " inclusive[name] " " exclusive[name]
+}
+END {
+  check("inner", cycles["main;outer;inner"])
+  check("outer", exclusive["outer"] + inclusive["inner"])
+  check("rec", recInclusive)
+  check("main", exclusive["main"] + inclusive["outer"] + inclusive["rec"])
+}
@@ -0,0 +1,36 @@
+# Print the instruction counts of the test's functions from the listing
+# without the cycles and addresses, with the blocks in address order.
+BEGIN { n = split("main outer inner", order, " ") }
+/^Function / {
+  name = $2
+  sub(/:$/, "", name)
+  instructions[name] = $3
+  next
+}
+/^  Block / {
+  i = ++blocks[name]
+  start[name, i] = $2
+  text[name, i] = "  Block: " $3 " executions\n"
+  next
+}
+/^ +[0-9]+ +[0-9]+ +0x/ {
+  text[name, i] = text[name, i] "    " $1 " " $NF "\n"
+}
+END {
+  for (f = 1; f <= n; f++) {
+    name = order[f]
+    print "Function " name ": " instructions[name] " instructions"
+    # The addresses have a fixed width so they sort as strings.
+    for (i = 1; i <= blocks[name]; i++) {
+      for (j = i + 1; j <= blocks[name]; j++) {
+        if (start[name, j] < start[name, i]) {
+          tmp = start[name, i]; start[name, i] = start[name, j]
+          start[name, j] = tmp
+          tmp = text[name, i]; text[name, i] = text[name, j]
+          text[name, j] = tmp
+        }
+      }
+      printf "%s", text[name, i]
+    }
+  }
+}
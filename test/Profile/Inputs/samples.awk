@@ -0,0 +1,10 @@
+# Print the samples of the test's functions from the profile report followed
+# by their total cost in the callgrind file.
+BEGIN { n = split("main outer inner", order, " ") }
+/^ *[0-9.]+% / { report[$3] = $2 }
+/^fn=/ { fn = substr($0, 4) }
+/^0x[0-9a-f]+ [0-9]+$/ { cost[fn] += $2 }
+END {
+  for (i = 1; i <= n; i++)
+    print order[i], report[order[i]], cost[order[i]]
+}
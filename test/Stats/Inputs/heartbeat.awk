@@ -0,0 +1,19 @@
+# Check the lines written by --heartbeat for a single core program.
+{
+  if ($0 !~ /^\{"time": [0-9]+, "instructions": [0-9]+, "mips": [^,]+, "queue_depth": [0-9]+, "running_threads": [0-9]+, "blocked_threads": [0-9]+, "blocked": \{[^}]*\}, "cores": \[\{"name": "[^"]*", "instructions": [0-9]+, "time": [0-9]+\}\]\}$/)
+    malformed++
+  if ($2 + 0 < lastTime || $4 + 0 < lastInstructions)
+    backwards++
+  lastTime = $2 + 0
+  lastInstructions = $4 + 0
+}
+END {
+  if (NR == 0)
+    print "no progress reports"
+  else if (malformed)
+    print malformed " malformed progress reports"
+  else if (backwards)
+    print "progress went backwards"
+  else
+    print "ok"
+}
@@ -0,0 +1,13 @@
+# Print the stall columns with nonzero cycles for threads 0 to 3 of the
+# thread statistics.
+BEGIN {
+  split("Chan in,Chan out,Port,Timer,Lock,Sync,Event,Other", names, ",")
+}
+NF == 12 && $1 ~ /^[0-3]$/ {
+  line = $1 ":"
+  for (i = 5; i <= 12; i++) {
+    if ($i > 0)
+      line = line " " names[i - 4]
+  }
+  print line
+}
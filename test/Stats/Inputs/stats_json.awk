@@ -0,0 +1,44 @@
+# Print the keys of the JSON statistics and check the totals against the
+# per-core entries and the thread statistics. The first file is the output
+# of -T and the second the JSON file.
+FILENAME == ARGV[1] && NF == 12 && $1 ~ /^[0-9]+$/ {
+  threadInstructions += $3
+  if ($2 + 0 > maxTime)
+    maxTime = $2 + 0
+  next
+}
+FILENAME != ARGV[2] {
+  next
+}
+/^  "/ {
+  key = $1
+  gsub(/[":]/, "", key)
+  print key
+  value[key] = $2 + 0
+}
+/^    "/ {
+  key = $1
+  gsub(/[":]/, "", key)
+  print "  " key
+}
+/^    { "name":/ {
+  name = $3
+  gsub(/[",]/, "", name)
+  print "  " name
+  numCores++
+  coreInstructions += $5
+  coreDecoded += $9
+}
+function check(key, expected) {
+  if (value[key] == expected)
+    print key " ok"
+  else
+    print key " " value[key] " expected " expected
+}
+END {
+  check("cores", numCores)
+  check("instructions", coreInstructions)
+  check("instructions", threadInstructions)
+  check("max_thread_cycles", maxTime)
+  check("instructions_decoded", coreDecoded)
+}
@@ -0,0 +1,17 @@
+// RUN: xcc -target=XC-5 %s -o %t1.xe
+// RUN: axe %t1.xe --heartbeat %t2.json --heartbeat-interval 0.001
+// RUN: awk -f %S/Inputs/heartbeat.awk %t2.json > %t3.txt
+// RUN: cmp %t3.txt %s.expect
+
+// The program runs for much longer than the heartbeat interval so at least
+// one progress report must be written. Each report is a line of JSON and
+// the simulated time and instruction count never go backwards.
+
+int main()
+{
+  volatile int sum = 0;
+  int i;
+  for (i = 0; i < 2000000; i++)
+    sum += i;
+  return 0;
+}
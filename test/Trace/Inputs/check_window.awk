@@ -0,0 +1,22 @@
+# Check that every traced instruction lies in the time window [start, end)
+# and that the trace covers the window to within a few instructions.
+$2 ~ /^<.*>$/ && $3 ~ /\):$/ {
+  time = $1 + 0
+  if (count == 0 || time < first)
+    first = time
+  if (count == 0 || time > last)
+    last = time
+  if (time < start || time >= end)
+    outside++
+  count++
+}
+END {
+  if (count == 0)
+    print "no instructions traced"
+  else if (outside)
+    print outside " instructions traced outside the window"
+  else if (first - start > 100 || end - last > 100)
+    print "trace covers " first "-" last
+  else
+    print "ok"
+}
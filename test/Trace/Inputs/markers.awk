@@ -0,0 +1,15 @@
+# Print the trace markers and the runs of instructions in the functions the
+# markers test calls.
+$2 ~ /^<.*>$/ && $3 == "Syscall" && $4 ~ /^trace_/ {
+  print $4
+  last = ""
+}
+$2 ~ /^<.*>$/ && $3 ~ /\):$/ {
+  name = $3
+  sub(/[+(].*/, "", name)
+  if (name != "before" && name != "traced" && name != "after")
+    next
+  if (name != last)
+    print name
+  last = name
+}